@@ -88,7 +88,7 @@ HttpEngine::HttpEngine()
     }
 
 
-    void HttpEngine::DoCurl(const Request &request, const TCookies &cookie, std::string* response, uint64_t requestId, std::string* effectiveUrl)
+    void HttpEngine::DoCurl(const Request &request, const TCookies &cookie, std::string* response, uint64_t requestId, std::string* effectiveUrl, std::function<bool()> isCanceled)
     {
         using namespace Globals;
         kodi::vfs::CFile curl;
@@ -135,7 +135,9 @@ HttpEngine::HttpEngine()
                 char buffer[32*1024]; //32K buffer
                 bytesRead = curl.Read(&buffer[0], sizeof(buffer));
                 response->append(&buffer[0], bytesRead);
-            } while(bytesRead > 0);
+            } while(bytesRead > 0 && !(isCanceled && isCanceled()));
+            if(bytesRead > 0)
+                throw CurlErrorException(std::string("Request is canceled. URL = " + request.Url).c_str());
 
             if (bytesRead < 0)
                 *response = "";
@@ -149,7 +151,7 @@ HttpEngine::HttpEngine()
             if(bytesRead < 0){
                 throw CurlErrorException(std::string("CURL (by Kodi) failed to read from " + request.Url + ". See log for details.").c_str());
             }
-            
+            // Kodi keeps the session alive for next request to the same host
             curl.Close();
         } catch (...) {
             if (curl.IsOpen())
@@ -194,7 +196,14 @@ HttpEngine::HttpEngine()
     }
 
 
-    void HttpEngine::DoCurl(const Request &request, const TCookies &cookie, std::string* response, uint64_t requestId, std::string* effectiveUrl)
+    // Non-zero return value aborts transfer (CURLE_ABORTED_BY_CALLBACK)
+    static int CurlTransferInfo(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+    {
+        const auto isCanceled = static_cast<const std::function<bool()>*>(clientp);
+        return (*isCanceled)() ? 1 : 0;
+    }
+
+    void HttpEngine::DoCurl(const Request &request, const TCookies &cookie, std::string* response, uint64_t requestId, std::string* effectiveUrl, std::function<bool()> isCanceled)
     {
         char errorMessage[CURL_ERROR_SIZE];
         CURL *curl = curl_easy_init();
@@ -207,13 +216,13 @@ HttpEngine::HttpEngine()
         if(request.IsPost()) {
             curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request.PostData.c_str());
         }
+        // NOTE: CURL does not copy headers list, it should live until request is done
+        struct curl_slist *headers = NULL;
         if(!request.Headers.empty()) {
-            struct curl_slist *headers = NULL;
             for (const auto& header : request.Headers) {
                 headers = curl_slist_append(headers, header.c_str());
             }
             curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-            curl_slist_free_all(headers);
         }
         
         curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
@@ -222,6 +231,11 @@ HttpEngine::HttpEngine()
         curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, CurlWriteData);
         curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
         curl_easy_setopt(curl, CURLOPT_TIMEOUT, c_CurlTimeout);
+        if(isCanceled) {
+            curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, CurlTransferInfo);
+            curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &isCanceled);
+            curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+        }
         //curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
         
         
@@ -275,6 +289,7 @@ HttpEngine::HttpEngine()
                 *effectiveUrl = url;
         }
         
+        curl_slist_free_all(headers);
         curl_easy_cleanup(curl);
         if(curlCode != CURLE_OK){
             //delete response;
@@ -36,6 +36,7 @@
 #include <map>
 #include <string>
 #include <exception>
+#include <functional>
 #include "ActionQueue.hpp"
 #include "globals.hpp"
 
@@ -115,7 +116,10 @@ public:
 
     static bool CheckInternetConnection(long timeout);
     
-    static void DoCurl(const Request &request, const TCookies &cookie, std::string* response, uint64_t requestId = 0, std::string* effectiveUrl = nullptr);
+    // isCanceled aborts transfer in progress: external CURL checks it on each progress callback,
+    // Kodi's VFS between reads only (blocking read can't be interrupted).
+    static void DoCurl(const Request &request, const TCookies &cookie, std::string* response, uint64_t requestId = 0, std::string* effectiveUrl = nullptr,
+                       std::function<bool()> isCanceled = nullptr);
     
 private:
     static size_t CurlWriteData(void *buffer, size_t size, size_t nmemb, void *userp);
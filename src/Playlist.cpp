@@ -24,6 +24,11 @@
 #define __STDC_FORMAT_MACROS
 #endif
 #include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <cctype>
+#include <iterator>
 #include "HttpEngine.hpp"
 #include "Playlist.hpp"
 #include "globals.hpp"
@@ -64,6 +69,9 @@ static std::string ToAbsoluteUrl(const std::string& url, const std::string& base
         if(std::string::npos != urlPos) {
             //throw PlaylistException((std::string("No '/' in base URL: ") + baseUrl).c_str());
             urlPath = urlPath.substr(0, urlPos + 1); // +1 for '/'
+        } else {
+            // Base is at site root
+            urlPath.clear();
         }
         urlPath += url;
         absUrl += urlPath;//HttpEngine::Escape(urlPath);
@@ -75,21 +83,249 @@ static std::string ToAbsoluteUrl(const std::string& url, const std::string& base
     
 }
 
-static uint64_t ParseXstreamInfTag(const std::string& data, std::string& url)
+// Non-owning reference to part of playlist content (pointer and length).
+// Parser works on references to avoid copying of every line.
+class StringRef
+{
+public:
+    typedef std::string::size_type size_type;
+    static const size_type npos = std::string::npos;
+    
+    StringRef() : m_data(""), m_size(0) {}
+    StringRef(const char* s) : m_data(s), m_size(strlen(s)) {}
+    StringRef(const char* s, size_type size) : m_data(s), m_size(size) {}
+    StringRef(const std::string& s) : m_data(s.data()), m_size(s.size()) {}
+    
+    const char* data() const { return m_data; }
+    size_type size() const { return m_size; }
+    bool empty() const { return 0 == m_size; }
+    char operator[](size_type pos) const { return m_data[pos]; }
+    char front() const { return m_data[0]; }
+    char back() const { return m_data[m_size - 1]; }
+    void remove_prefix(size_type n) { m_data += n; m_size -= n; }
+    void remove_suffix(size_type n) { m_size -= n; }
+    explicit operator std::string() const { return std::string(m_data, m_size); }
+    
+    StringRef substr(size_type pos, size_type n = npos) const {
+        if(pos > m_size)
+            throw PlaylistException("Invalid playlist format: unexpected end of line.");
+        return StringRef(m_data + pos, std::min(n, m_size - pos));
+    }
+    size_type find(char c, size_type pos = 0) const {
+        if(pos >= m_size)
+            return npos;
+        const void* found = memchr(m_data + pos, c, m_size - pos);
+        return nullptr == found ? npos : (const char*)found - m_data;
+    }
+    size_type find(const StringRef& s, size_type pos = 0) const {
+        if(s.m_size > m_size)
+            return npos;
+        const auto last = m_size - s.m_size;
+        for(; pos <= last; ++pos) {
+            pos = find(s.m_data[0], pos);
+            if(npos == pos || pos > last)
+                return npos;
+            if(memcmp(m_data + pos, s.m_data, s.m_size) == 0)
+                return pos;
+        }
+        return npos;
+    }
+    bool StartsWith(const StringRef& prefix) const {
+        return m_size >= prefix.m_size && memcmp(m_data, prefix.m_data, prefix.m_size) == 0;
+    }
+    friend bool operator==(const StringRef& a, const StringRef& b) {
+        return a.m_size == b.m_size && memcmp(a.m_data, b.m_data, a.m_size) == 0;
+    }
+    friend bool operator!=(const StringRef& a, const StringRef& b) {
+        return !(a == b);
+    }
+    
+private:
+    const char* m_data;
+    size_type m_size;
+};
+
+// Single pass tokenizer of playlist content.
+// Returns trimmed non-empty lines as references to original data, i.e. without copying.
+class PlaylistLines
+{
+public:
+    PlaylistLines(const std::string& data, std::string::size_type pos = 0)
+    : m_data(data)
+    , m_pos(pos)
+    {}
+    
+    bool Next(StringRef& line) {
+        while(m_pos < m_data.size()) {
+            auto eol = m_data.find('\n', m_pos);
+            if(StringRef::npos == eol)
+                eol = m_data.size();
+            line = Trim(m_data.substr(m_pos, eol - m_pos));
+            m_pos = eol + 1;
+            if(!line.empty())
+                return true;
+        }
+        return false;
+    }
+    
+    static StringRef Trim(StringRef s) {
+        while(!s.empty() && std::isspace((unsigned char)s.front()))
+            s.remove_prefix(1);
+        while(!s.empty() && std::isspace((unsigned char)s.back()))
+            s.remove_suffix(1);
+        return s;
+    }
+    
+private:
+    const StringRef m_data;
+    std::string::size_type m_pos;
+};
+
+static inline bool StartsWith(const StringRef& s, const StringRef& prefix)
+{
+    return s.StartsWith(prefix);
+}
+
+static uint64_t ParseInteger(const StringRef& s, const char* tag)
+{
+    StringRef::size_type pos = 0;
+    while(pos < s.size() && std::isspace((unsigned char)s[pos]))
+        ++pos;
+    // Leading decimal digits (without sign), like strtoull() but without null-terminated copy
+    const auto begin = pos;
+    uint64_t value = 0;
+    bool isOverflow = false;
+    for(; pos < s.size() && s[pos] >= '0' && s[pos] <= '9'; ++pos) {
+        const unsigned digit = s[pos] - '0';
+        isOverflow |= value > (UINT64_MAX - digit) / 10;
+        value = value * 10 + digit;
+    }
+    if(begin == pos || isOverflow)
+        throw PlaylistException((std::string("Invalid playlist format: bad numeric value of ") + tag + " tag.").c_str());
+    return value;
+}
+
+// Parses leading float value. Returns amount of consumed chars in *pos
+static float ParseFloat(const StringRef& s, StringRef::size_type* pos)
+{
+    // strtof() requires null-terminated string.
+    char buffer[32];
+    const auto len = std::min(s.size(), sizeof(buffer) - 1);
+    memcpy(buffer, s.data(), len);
+    buffer[len] = '\0';
+    char* end = nullptr;
+    float value = strtof(buffer, &end);
+    if(end == buffer)
+        throw PlaylistException("Invalid playlist format: bad duration value in INF tag.");
+    *pos = end - buffer;
+    return value;
+}
+
+static inline bool IsWholeLine(const std::string& data, std::string::size_type pos, std::string::size_type len)
+{
+    const auto end = pos + len;
+    return (pos == 0 || data[pos - 1] == '\n') && (end == data.size() || data[end] == '\r' || data[end] == '\n');
+}
+
+static uint64_t ParseXstreamInfTag(const StringRef& attributes)
 {
     const char* c_BAND = "BANDWIDTH=";
     
-    auto pos = data.find(c_BAND);
+    auto pos = attributes.find(c_BAND);
     if(std::string::npos == pos)
         throw PlaylistException("Invalid playlist format: missing BANDWIDTH in #EXT-X-STREAM-INF tag.");
-    pos += strlen(c_BAND);
-    uint64_t bandwidth = std::stoull(data.substr(pos), &pos);
-    pos = data.find('\n', pos);
-    if(std::string::npos == pos)
-        throw PlaylistException("Invalid playlist format: missing NEW LINE in #EXT-X-STREAM-INF tag.");
-    url = data.substr(++pos);
-    trim(url);
-    return bandwidth;
+    return ParseInteger(attributes.substr(pos + strlen(c_BAND)), "BANDWIDTH");
+}
+
+// Value of float attribute (NAME=value) in tag's attribute list
+static bool ParseFloatAttribute(const StringRef& attributes, const StringRef& name, float& value)
+{
+    StringRef::size_type pos = 0;
+    while(StringRef::npos != (pos = attributes.find(name, pos))) {
+        // Whole attribute name only (e.g. HOLD-BACK vs PART-HOLD-BACK)
+        if((pos == 0 || attributes[pos - 1] == ',') && pos + name.size() < attributes.size() && attributes[pos + name.size()] == '=') {
+            StringRef::size_type len = 0;
+            value = ParseFloat(attributes.substr(pos + name.size() + 1), &len);
+            return true;
+        }
+        pos += name.size();
+    }
+    return false;
+}
+
+// <length>[@<offset>] value of EXT-X-BYTERANGE tag (or BYTERANGE attribute)
+static bool ParseByteRange(const StringRef& s, uint64_t& length, uint64_t& offset)
+{
+    const auto at = s.find('@');
+    length = ParseInteger(s.substr(0, at), "BYTERANGE");
+    if(StringRef::npos == at)
+        return false;
+    offset = ParseInteger(s.substr(at + 1), "BYTERANGE");
+    return true;
+}
+
+// Value of quoted string attribute (NAME="value") in tag's attribute list
+static bool ParseQuotedAttribute(const StringRef& attributes, const StringRef& name, StringRef& value)
+{
+    StringRef::size_type pos = 0;
+    while(StringRef::npos != (pos = attributes.find(name, pos))) {
+        const auto valuePos = pos + name.size() + 2;
+        if((pos == 0 || attributes[pos - 1] == ',') && valuePos <= attributes.size()
+           && attributes[pos + name.size()] == '=' && attributes[pos + name.size() + 1] == '"') {
+            const auto end = attributes.find('"', valuePos);
+            if(StringRef::npos == end)
+                return false;
+            value = attributes.substr(valuePos, end - valuePos);
+            return true;
+        }
+        pos += name.size();
+    }
+    return false;
+}
+
+// Value of enumerated string or hexadecimal attribute (NAME=value) in tag's attribute list
+static bool ParseEnumAttribute(const StringRef& attributes, const StringRef& name, StringRef& value)
+{
+    StringRef::size_type pos = 0;
+    while(StringRef::npos != (pos = attributes.find(name, pos))) {
+        const auto valuePos = pos + name.size() + 1;
+        if((pos == 0 || attributes[pos - 1] == ',') && valuePos <= attributes.size() && attributes[valuePos - 1] == '=') {
+            const auto end = attributes.find(',', valuePos);
+            value = attributes.substr(valuePos, StringRef::npos == end ? end : end - valuePos);
+            return true;
+        }
+        pos += name.size();
+    }
+    return false;
+}
+
+// 0x prefixed 128 bit hexadecimal value (IV attribute of EXT-X-KEY)
+static std::string ParseIv(const StringRef& s)
+{
+    if(s.size() < 3 || s[0] != '0' || (s[1] != 'x' && s[1] != 'X'))
+        throw PlaylistException("Invalid playlist format: bad IV in #EXT-X-KEY tag.");
+    // Left padded with zeros
+    std::string hex(32, '0');
+    const auto digits = s.substr(2);
+    if(digits.size() > hex.size())
+        throw PlaylistException("Invalid playlist format: bad IV in #EXT-X-KEY tag.");
+    hex.replace(hex.size() - digits.size(), digits.size(), digits.data(), digits.size());
+    std::string iv(16, '\0');
+    for (size_t i = 0; i < iv.size(); ++i) {
+        iv[i] = (char)std::stoul(hex.substr(i * 2, 2), nullptr, 16);
+    }
+    return iv;
+}
+
+// Default IV of encrypted segment is its media sequence number (big endian)
+static std::string SequenceNumberIv(uint64_t sequenceNumber)
+{
+    std::string iv(16, '\0');
+    for (int i = 15; i >= 8; --i) {
+        iv[i] = (char)(sequenceNumber & 0xFF);
+        sequenceNumber >>= 8;
+    }
+    return iv;
 }
 
 static bool IsPlaylistContent(const std::string& content) {
@@ -97,10 +333,24 @@ static bool IsPlaylistContent(const std::string& content) {
     return  content.find(c_M3U) != std::string::npos;
 }
 
-Playlist::Playlist(const std::string &urlOrContent, uint64_t indexOffset)
+Playlist::Playlist(const std::string &urlOrContent, uint64_t indexOffset, uint64_t bandwidthLimit)
 : m_indexOffset(indexOffset)
-, m_targetDuration(0)
 , m_initialInternalIndex(-1)
+, m_targetDuration(0)
+, m_currentVariant(0)
+, m_isIFramesOnly(false)
+, m_hasStartTimeOffset(false)
+, m_startTimeOffset(0.0)
+, m_holdBack(0.0)
+, m_lastRangeEnd(0)
+, m_isUpdated(true)
+, m_isIncremental(false)
+, m_lastMediaSequence(0)
+, m_lastSegmentIndex(-1)
+, m_lastSegmentEnd(std::string::npos)
+, m_partTarget(0.0)
+, m_partHoldBack(0.0)
+, m_canBlockReload(false)
 {
     const std::string* pData (&urlOrContent);
     std::string data;
@@ -119,41 +369,50 @@ Playlist::Playlist(const std::string &urlOrContent, uint64_t indexOffset)
         LoadPlaylist(data);
         pData = &data;
     }
-    SetBestPlaylist(*pData);
+    SetBestPlaylist(*pData, bandwidthLimit);
     
 }
 
-void Playlist::SetBestPlaylist(const std::string& data)
+void Playlist::SetBestPlaylist(const std::string& data, uint64_t bandwidthLimit)
 {
-    const char* c_XINF = "#EXT-X-STREAM-INF:";
+    const StringRef c_XINF = "#EXT-X-STREAM-INF:";
+    const StringRef c_IFRAME_XINF = "#EXT-X-I-FRAME-STREAM-INF:";
     m_loadIterator = 0;
-    auto pos = data.find(c_XINF);
     // Do we have bitstream info to choose best strea?
-    if(std::string::npos != pos) {
+    if(std::string::npos != data.find(c_XINF.data())) {
         //    LogDebug("Variant playlist URL: \n %s", playlistUrl.c_str() );
         //    LogDebug("Variant playlist: \n %s", data.c_str() );
         
-        uint64_t bestRate = 0;
-        while(std::string::npos != pos)
-        {
-            pos += strlen(c_XINF);
-            auto endTag = data.find("#",pos);
-            std::string::size_type tagLen = endTag - pos;
-            if(std::string::npos == endTag)
-                tagLen = std::string::npos;
-            
-            std::string tagBody = data.substr(pos, tagLen);
-            pos = data.find(c_XINF,pos);
-            
-            std::string url;
-            uint64_t rate = ParseXstreamInfTag(tagBody, url);
-            if(rate > bestRate) {
-                m_playListUrl = ToAbsoluteUrl(url, m_effectivePlayListUrl);
-                m_effectivePlayListUrl.clear();
-                bestRate = rate;
+        uint64_t rate = 0;
+        bool waitingForUrl = false;
+        StringRef line;
+        PlaylistLines lines(data);
+        while(lines.Next(line)) {
+            if(StartsWith(line, c_XINF)) {
+                rate = ParseXstreamInfTag(line.substr(c_XINF.size()));
+                waitingForUrl = true;
+            } else if(StartsWith(line, c_IFRAME_XINF)) {
+                // I-frame rendition has URI attribute instead of URI line
+                const auto attributes = line.substr(c_IFRAME_XINF.size());
+                StringRef uri;
+                if(ParseQuotedAttribute(attributes, "URI", uri))
+                    m_iframeVariants.emplace_back(ParseXstreamInfTag(attributes), ToAbsoluteUrl(std::string(uri), m_effectivePlayListUrl) + m_httplHeaders);
+            } else if(waitingForUrl && line[0] != '#') {
+                waitingForUrl = false;
+                m_variants.emplace_back(rate, ToAbsoluteUrl(std::string(line), m_effectivePlayListUrl));
             }
         }
-        //    LogDebug("Best URL (%d): \n %s", bestRate, m_playListUrl.c_str() );
+        if(m_variants.empty())
+            throw PlaylistException("Invalid playlist format: missing URL of #EXT-X-STREAM-INF tag.");
+        auto byBandwidth = [](const VariantInfo& a, const VariantInfo& b) {
+            return a.bandwidth < b.bandwidth;
+        };
+        std::stable_sort(m_variants.begin(), m_variants.end(), byBandwidth);
+        std::stable_sort(m_iframeVariants.begin(), m_iframeVariants.end(), byBandwidth);
+        m_currentVariant = (0 == bandwidthLimit) ? m_variants.size() - 1 : VariantForBandwidth(bandwidthLimit);
+        m_playListUrl = m_variants[m_currentVariant].url;
+        m_effectivePlayListUrl.clear();
+        LogDebug("Playlist: selected variant %d of %d (%" PRIu64 " bps).", (int)m_currentVariant + 1, (int)m_variants.size(), m_variants[m_currentVariant].bandwidth);
         std::string newData;
         LoadPlaylist(newData);
         ParsePlaylist(newData);
@@ -168,86 +427,340 @@ void Playlist::SetBestPlaylist(const std::string& data)
     }
 }
 
-bool Playlist::ParsePlaylist(const std::string& data)
+static const char* c_M3U = "#EXTM3U";
+static const StringRef c_INF = "#EXTINF:";
+static const StringRef c_SEQ = "#EXT-X-MEDIA-SEQUENCE:";
+static const StringRef c_TARGET = "#EXT-X-TARGETDURATION:";
+static const StringRef c_END = "#EXT-X-ENDLIST";
+static const StringRef c_START = "#EXT-X-START:";
+static const StringRef c_SERVER_CONTROL = "#EXT-X-SERVER-CONTROL:";
+static const StringRef c_BYTERANGE = "#EXT-X-BYTERANGE:";
+static const StringRef c_MAP = "#EXT-X-MAP:";
+static const StringRef c_KEY = "#EXT-X-KEY:";
+static const StringRef c_PART_INF = "#EXT-X-PART-INF:";
+static const StringRef c_PART = "#EXT-X-PART:";
+static const StringRef c_PRELOAD_HINT = "#EXT-X-PRELOAD-HINT:";
+static const StringRef c_IFRAMES_ONLY = "#EXT-X-I-FRAMES-ONLY";
+
+// End of EXT-X-BYTERANGE of segment which URI line starts at uriPos.
+// 0 when the range or its offset is missing.
+static uint64_t RangeEndOfSegment(const std::string& data, std::string::size_type uriPos)
 {
-    const char* c_M3U = "#EXTM3U";
-    const char* c_INF = "#EXTINF:";
-    const char* c_SEQ = "#EXT-X-MEDIA-SEQUENCE:";
-    const char* c_TYPE = "#EXT-X-PLAYLIST-TYPE:";
-    const char* c_TARGET = "#EXT-X-TARGETDURATION:";
-    const char* c_CACHE = "#EXT-X-ALLOW-CACHE:"; // removed in v7 but in use by TTV :(
-    const char* c_END = "#EXT-X-ENDLIST";
+    // Tags of the segment are between its #EXTINF and URI lines
+    auto lineEnd = uriPos;
+    while(lineEnd > 1) {
+        const auto lineStart = data.rfind('\n', lineEnd - 2) + 1;
+        const auto line = PlaylistLines::Trim(StringRef(data).substr(lineStart, lineEnd - 1 - lineStart));
+        if(StartsWith(line, c_BYTERANGE)) {
+            uint64_t length = 0, offset = 0;
+            return ParseByteRange(line.substr(c_BYTERANGE.size()), length, offset) ? offset + length : 0;
+        }
+        if(StartsWith(line, c_INF))
+            break;
+        lineEnd = lineStart;
+    }
+    return 0;
+}
+
+// Searches for end of last known segment URI in reloaded playlist.
+// Fills header values and position to continue parsing from.
+bool Playlist::FindResumePosition(const std::string& data, std::string::size_type& pos, int64_t& mediaIndex, int64_t& firstIndex) const
+{
+    if(m_lastSegmentUri.empty() || -1 == m_initialInternalIndex)
+        return false;
+    
+    // Header only, i.e. up to the first segment.
+    bool hasTargetDuration = false;
+    uint64_t mediaSequence = m_initialInternalIndex;
+    PlaylistLines lines(data, pos);
+    StringRef line;
+    while(lines.Next(line) && !StartsWith(line, c_INF)) {
+        if(StartsWith(line, c_TARGET)) {
+            hasTargetDuration = ParseInteger(line.substr(c_TARGET.size()), "#EXT-X-TARGETDURATION") == m_targetDuration;
+        } else if(StartsWith(line, c_SEQ)) {
+            mediaSequence = ParseInteger(line.substr(c_SEQ.size()), "#EXT-X-MEDIA-SEQUENCE");
+        }
+    }
+    firstIndex = m_indexOffset + mediaSequence - m_initialInternalIndex;
+    // Last known segment is out of playlist window
+    if(!hasTargetDuration || m_lastSegmentIndex < firstIndex)
+        return false;
+    
+    const auto uriLength = m_lastSegmentUri.size();
+    std::string::size_type uriPos = std::string::npos;
+    // Same sequence usually means same playlist head, i.e. same offset of last known segment
+    if(mediaSequence == m_lastMediaSequence && m_lastSegmentEnd != std::string::npos
+       && m_lastSegmentEnd <= data.size() && m_lastSegmentEnd >= uriLength
+       && data.compare(m_lastSegmentEnd - uriLength, uriLength, m_lastSegmentUri) == 0) {
+        uriPos = m_lastSegmentEnd - uriLength;
+    } else {
+        // New segments are at the tail. Search backward.
+        uriPos = data.rfind(m_lastSegmentUri);
+        // Byte ranges of the same resource share URI, i.e. the range identifies the segment
+        while(m_lastRangeUri == m_lastSegmentUri && std::string::npos != uriPos
+              && (!IsWholeLine(data, uriPos, uriLength) || RangeEndOfSegment(data, uriPos) != m_lastRangeEnd)) {
+            uriPos = (uriPos > 0) ? data.rfind(m_lastSegmentUri, uriPos - 1) : std::string::npos;
+        }
+    }
+    if(std::string::npos == uriPos || !IsWholeLine(data, uriPos, uriLength))
+        return false;
     
+    pos = uriPos + uriLength;
+    mediaIndex = m_lastSegmentIndex + 1;
+    return true;
+}
+
+void Playlist::RemoveExpiredSegments(int64_t firstIndex)
+{
+    // Segments before playlist window are expired.
+    // Keep ones are not loaded yet.
+    while(!m_segmentUrls.empty()) {
+        const auto first = m_segmentUrls.begin();
+        if(first->first >= firstIndex || first->first >= m_loadIterator)
+            break;
+        m_segmentUrls.erase(first);
+    }
+    m_parts.erase(m_parts.begin(), m_parts.lower_bound(firstIndex));
+}
+
+bool Playlist::ParsePlaylist(const std::string& data)
+{
     try {
         auto pos = data.find(c_M3U);
         if(std::string::npos == pos)
             throw PlaylistException("Invalid playlist format: missing #EXTM3U tag.");
         pos += strlen(c_M3U);
         
-        // Fill target duration value (mandatory tag)
-        pos = data.find(c_TARGET);
-        if(std::string::npos == pos)
-            throw PlaylistException("Invalid playlist format: missing #EXT-X-TARGETDURATION tag.");
-        
-        pos += strlen(c_TARGET);
-        m_targetDuration = std::stoi(data.substr(pos), &pos);
-        
         // Playlist may be sub-sequence of some bigger stream (e.g. archive at Edem)
         // Initial index offset helps to right possitionig of segments range
         int64_t mediaIndex = m_indexOffset;
-        // use playlist indexing
-        std::string  body;
-        pos = data.find(c_SEQ);
-        // If we have media-sequence tag - use it
-        if(std::string::npos != pos) {
-            pos += strlen(c_SEQ);
-            body = data.substr(pos);
-            auto internaIndex = std::stoull(body, &pos);
-            // Initialize internal index of playlist on first loading
-            if(-1 == m_initialInternalIndex) {
-                m_initialInternalIndex = internaIndex;
-            }
-            mediaIndex +=  internaIndex - m_initialInternalIndex;
+        int64_t firstIndex = mediaIndex;
+        bool hasTargetDuration = false;
+        bool hasContent = false;
+        bool waitingForUrl = false;
+        float duration = 0.0;
+        // EXT-X-BYTERANGE of next segment
+        bool hasRange = false;
+        bool hasRangeOffset = false;
+        uint64_t rangeLength = 0;
+        uint64_t rangeOffset = 0;
+        // Parts of next segment (LL-HLS)
+        std::vector<PartInfo> parts;
+        PartInfo hint;
+        m_isVod = false;
+        
+        // On incremental reload skip all known segments
+        StringRef lastSegmentUri;
+        std::string::size_type lastSegmentEnd = std::string::npos;
+        if(m_isIncremental && FindResumePosition(data, pos, mediaIndex, firstIndex)) {
+            hasTargetDuration = hasContent = true;
+            lastSegmentEnd = pos;
+            m_lastMediaSequence = m_initialInternalIndex + firstIndex - m_indexOffset;
+        } else {
+            // Whole playlist parsing, byte ranges start from scratch
+            m_lastRangeUri.clear();
+            m_lastRangeEnd = 0;
         }
         
-        // VOD should contain END tag
-        pos = data.find(c_END);
-        m_isVod = pos != std::string::npos;
-        body=data.substr(0, pos);
+        auto addSegment = [this](int64_t index, float duration, const std::string& url) -> SegmentInfo& {
+            TimeOffset relativeSeegmetStart = GetTimeOffset();
+            // Set reliative segment start time to either previous segment end time or 0.0 for first one
+            auto prevSegment = m_segmentUrls.find(index - 1);
+            if(prevSegment != m_segmentUrls.end()){
+                relativeSeegmetStart = prevSegment->second.startTime + prevSegment->second.duration;
+            }
+            auto& info = m_segmentUrls.emplace_hint(m_segmentUrls.end(), index, TSegmentUrls::mapped_type(relativeSeegmetStart, duration, url, index))->second;
+            // Playlist's own sequence number, i.e. without index offset
+            info.mediaSequence = index - m_indexOffset + (-1 == m_initialInternalIndex ? 0 : m_initialInternalIndex);
+            info.initUrl = m_initUrl;
+            info.initRange = m_initRange;
+            if(!m_keyUrl.empty()) {
+                info.keyUrl = m_keyUrl;
+                info.keyIv = m_keyIv.empty() ? SequenceNumberIv(info.mediaSequence) : m_keyIv;
+            }
+            return info;
+        };
         
-        pos = body.find(c_INF);
-        bool hasContent = false;
-        // Load playlist segments
-        while(std::string::npos != pos) {
-            pos += strlen(c_INF);
-            body = body.substr(pos);
-            float duration = std::stof (body, &pos);
-            if(',' != body[pos++])
-                throw PlaylistException("Invalid playlist format: missing coma after INF tag.");
-            
-            const std::string::size_type urlPos = body.find('\n',pos) + 1;
-            pos = body.find('\n', urlPos);
+        // Single pass over playlist lines.
+        // Only URL of new segment is copied from data.
+        PlaylistLines lines(data, pos);
+        StringRef line;
+        while(lines.Next(line)) {
+            if(line[0] == '#') {
+                if(StartsWith(line, c_INF)) {
+                    StringRef::size_type durationLen = 0;
+                    auto attributes = line.substr(c_INF.size());
+                    duration = ParseFloat(attributes, &durationLen);
+                    if(durationLen >= attributes.size() || ',' != attributes[durationLen])
+                        throw PlaylistException("Invalid playlist format: missing coma after INF tag.");
+                    waitingForUrl = true;
+                } else if(StartsWith(line, c_TARGET)) {
+                    // Target duration value (mandatory tag)
+                    m_targetDuration = (int)ParseInteger(line.substr(c_TARGET.size()), "#EXT-X-TARGETDURATION");
+                    hasTargetDuration = true;
+                } else if(StartsWith(line, c_SEQ)) {
+                    // If we have media-sequence tag - use it
+                    auto internaIndex = ParseInteger(line.substr(c_SEQ.size()), "#EXT-X-MEDIA-SEQUENCE");
+                    // Initialize internal index of playlist on first loading
+                    if(-1 == m_initialInternalIndex) {
+                        m_initialInternalIndex = internaIndex;
+                    }
+                    firstIndex = mediaIndex = m_indexOffset + internaIndex - m_initialInternalIndex;
+                    m_lastMediaSequence = internaIndex;
+                } else if(StartsWith(line, c_END)) {
+                    // VOD should contain END tag
+                    m_isVod = true;
+                    break;
+                } else if(StartsWith(line, c_BYTERANGE)) {
+                    hasRange = true;
+                    hasRangeOffset = ParseByteRange(line.substr(c_BYTERANGE.size()), rangeLength, rangeOffset);
+                } else if(StartsWith(line, c_MAP)) {
+                    const auto attributes = line.substr(c_MAP.size());
+                    StringRef value;
+                    if(!ParseQuotedAttribute(attributes, "URI", value))
+                        throw PlaylistException("Invalid playlist format: missing URI in #EXT-X-MAP tag.");
+                    m_initUrl = ToAbsoluteUrl(std::string(value), m_effectivePlayListUrl) + m_httplHeaders;
+                    m_initRange = ByteRange();
+                    uint64_t length = 0, offset = 0;
+                    if(ParseQuotedAttribute(attributes, "BYTERANGE", value) && ParseByteRange(value, length, offset))
+                        m_initRange = ByteRange(offset, length);
+                } else if(StartsWith(line, c_KEY)) {
+                    // Applies to all following segments up to next key tag
+                    const auto attributes = line.substr(c_KEY.size());
+                    StringRef value;
+                    if(!ParseEnumAttribute(attributes, "METHOD", value))
+                        throw PlaylistException("Invalid playlist format: missing METHOD in #EXT-X-KEY tag.");
+                    m_keyUrl.clear();
+                    m_keyIv.clear();
+                    if("AES-128" == value) {
+                        if(!ParseQuotedAttribute(attributes, "URI", value))
+                            throw PlaylistException("Invalid playlist format: missing URI in #EXT-X-KEY tag.");
+                        m_keyUrl = ToAbsoluteUrl(std::string(value), m_effectivePlayListUrl) + m_httplHeaders;
+                        if(ParseEnumAttribute(attributes, "IV", value))
+                            m_keyIv = ParseIv(value);
+                    } else if("NONE" != value) {
+                        throw PlaylistException("Unsupported encryption method of playlist (#EXT-X-KEY).");
+                    }
+                } else if(StartsWith(line, c_IFRAMES_ONLY)) {
+                    // Each segment is an I-frame, its duration lasts until next one
+                    m_isIFramesOnly = true;
+                } else if(StartsWith(line, c_START)) {
+                    // Preferred start point of playback
+                    m_hasStartTimeOffset = ParseFloatAttribute(line.substr(c_START.size()), "TIME-OFFSET", m_startTimeOffset);
+                } else if(StartsWith(line, c_SERVER_CONTROL)) {
+                    const auto attributes = line.substr(c_SERVER_CONTROL.size());
+                    // Minimal distance from the end of live playlist
+                    if(!ParseFloatAttribute(attributes, "HOLD-BACK", m_holdBack))
+                        m_holdBack = 0.0;
+                    if(!ParseFloatAttribute(attributes, "PART-HOLD-BACK", m_partHoldBack))
+                        m_partHoldBack = 0.0;
+                    StringRef value;
+                    m_canBlockReload = ParseEnumAttribute(attributes, "CAN-BLOCK-RELOAD", value) && "YES" == value;
+                } else if(StartsWith(line, c_PART_INF)) {
+                    if(!ParseFloatAttribute(line.substr(c_PART_INF.size()), "PART-TARGET", m_partTarget))
+                        throw PlaylistException("Invalid playlist format: missing PART-TARGET in #EXT-X-PART-INF tag.");
+                } else if(StartsWith(line, c_PART)) {
+                    // Partial segment of following segment
+                    const auto attributes = line.substr(c_PART.size());
+                    StringRef value;
+                    if(!ParseQuotedAttribute(attributes, "URI", value))
+                        throw PlaylistException("Invalid playlist format: missing URI in #EXT-X-PART tag.");
+                    PartInfo part;
+                    part.url = ToAbsoluteUrl(std::string(value), m_effectivePlayListUrl) + m_httplHeaders;
+                    if(!ParseFloatAttribute(attributes, "DURATION", part.duration))
+                        throw PlaylistException("Invalid playlist format: missing DURATION in #EXT-X-PART tag.");
+                    part.isIndependent = ParseEnumAttribute(attributes, "INDEPENDENT", value) && "YES" == value;
+                    part.isGap = ParseEnumAttribute(attributes, "GAP", value) && "YES" == value;
+                    if(ParseQuotedAttribute(attributes, "BYTERANGE", value)) {
+                        uint64_t length = 0, offset = 0;
+                        // Missing offset means next range of previous part's resource
+                        if(!ParseByteRange(value, length, offset))
+                            offset = (!parts.empty() && parts.back().url == part.url) ? parts.back().range.offset + parts.back().range.length : 0;
+                        part.range = ByteRange(offset, length);
+                    }
+                    parts.push_back(part);
+                    hint = PartInfo();
+                } else if(StartsWith(line, c_PRELOAD_HINT)) {
+                    // Next part, server holds request until it's ready
+                    const auto attributes = line.substr(c_PRELOAD_HINT.size());
+                    StringRef value;
+                    if(ParseEnumAttribute(attributes, "TYPE", value) && "PART" == value && ParseQuotedAttribute(attributes, "URI", value)) {
+                        hint = PartInfo();
+                        hint.url = ToAbsoluteUrl(std::string(value), m_effectivePlayListUrl) + m_httplHeaders;
+                        StringRef start, length;
+                        if(ParseEnumAttribute(attributes, "BYTERANGE-START", start)) {
+                            // Open-ended range is not supported, such part is requested when announced
+                            if(ParseEnumAttribute(attributes, "BYTERANGE-LENGTH", length))
+                                hint.range = ByteRange(ParseInteger(start, "BYTERANGE-START"), ParseInteger(length, "BYTERANGE-LENGTH"));
+                            else
+                                hint.url.clear();
+                        }
+                    }
+                }
+                // Ignore all other tags and comments
+                continue;
+            }
+            // URI line without INF tag
+            if(!waitingForUrl)
+                continue;
+            waitingForUrl = false;
             hasContent = true;
+            ByteRange range;
+            if(hasRange) {
+                // Missing offset means next range of the same resource
+                if(!hasRangeOffset)
+                    rangeOffset = (m_lastRangeUri == line) ? m_lastRangeEnd : 0;
+                range = ByteRange(rangeOffset, rangeLength);
+                m_lastRangeUri.assign(line.data(), line.size());
+                m_lastRangeEnd = rangeOffset + rangeLength;
+                hasRange = false;
+            }
+            lastSegmentUri = line;
+            lastSegmentEnd = line.data() + line.size() - data.data();
+            m_lastSegmentIndex = mediaIndex;
+            // Partial segment (without URL) is completed now
+            auto existing = m_segmentUrls.find(mediaIndex);
+            if(existing != m_segmentUrls.end() && existing->second.url.empty()) {
+                m_segmentUrls.erase(existing);
+                existing = m_segmentUrls.end();
+            }
             // Check whether we have a segment already
-            if(m_segmentUrls.count(mediaIndex) == 0) {
-                std::string::size_type urlLen = pos - urlPos;
-                if(std::string::npos == pos)
-                    urlLen = std::string::npos;
-                auto url = body.substr(urlPos, urlLen);
-                trim(url);
-                url = ToAbsoluteUrl(url, m_effectivePlayListUrl) + m_httplHeaders;
+            if(existing == m_segmentUrls.end()) {
+                auto url = ToAbsoluteUrl(std::string(line), m_effectivePlayListUrl) + m_httplHeaders;
                 LogDebug("Plist::ParsePlist(): new segment URL IDX: #%" PRIu64 " Duration: %f. URL: %s", mediaIndex, duration, url.c_str());
-                TimeOffset relativeSeegmetStart = GetTimeOffset();
-                // Set reliative segment start time to either previous segment end time or 0.0 for first one
-                if(m_segmentUrls.count(mediaIndex - 1)){
-                    const auto& prevSegment = m_segmentUrls.at(mediaIndex - 1);
-                    relativeSeegmetStart = prevSegment.startTime + prevSegment.duration;
-                }
-                m_segmentUrls[mediaIndex] = TSegmentUrls::mapped_type(relativeSeegmetStart, duration, url, mediaIndex);
+                addSegment(mediaIndex, duration, url).range = range;
+            }
+            if(!parts.empty()) {
+                auto& segmentParts = m_parts[mediaIndex];
+                segmentParts.parts.swap(parts);
+                segmentParts.hint = PartInfo();
+                segmentParts.isComplete = true;
+                parts.clear();
             }
             ++mediaIndex;
-            pos = body.find(c_INF, urlPos);
         }
+        // Parts after last segment belong to next (incomplete) one.
+        // It's loaded by parts while announced.
+        if(!m_isVod && (!parts.empty() || !hint.url.empty())) {
+            auto& segmentParts = m_parts[mediaIndex];
+            segmentParts.parts.swap(parts);
+            segmentParts.hint = hint;
+            segmentParts.isComplete = false;
+            if(m_segmentUrls.count(mediaIndex) == 0) {
+                LogDebug("Plist::ParsePlist(): new partial segment IDX: #%" PRIu64 ".", mediaIndex);
+                addSegment(mediaIndex, (float)m_targetDuration, std::string()).isPartial = true;
+            }
+        }
+        if(!hasTargetDuration)
+            throw PlaylistException("Invalid playlist format: missing #EXT-X-TARGETDURATION tag.");
+        
+        if(m_isIncremental) {
+            if(!lastSegmentUri.empty())
+                m_lastSegmentUri.assign(lastSegmentUri.data(), lastSegmentUri.size());
+            m_lastSegmentEnd = lastSegmentEnd;
+            RemoveExpiredSegments(firstIndex);
+        }
+
         LogDebug("m_segmentUrls.size = %d, %s", m_segmentUrls.size(), hasContent ? "Not empty." : "Empty."  );
         return hasContent;
     } catch (std::exception& ex) {
@@ -261,18 +774,32 @@ bool Playlist::ParsePlaylist(const std::string& data)
 }
 
 
-void Playlist::LoadPlaylist(std::string& data) const
+// Delivery directives of blocking reload are appended to playlist URL
+static const char* c_HLS_MSN = "_HLS_msn=";
+
+void Playlist::LoadPlaylist(std::string& data, bool isBlocking, std::function<bool()> isCanceled) const
+{
+    std::string requestUrl = (m_effectivePlayListUrl.empty()) ? m_playListUrl : m_effectivePlayListUrl;
+    if(isBlocking) {
+        // Server responds when part after last known one is available
+        const uint64_t initialSequence = (-1 == m_initialInternalIndex) ? 0 : m_initialInternalIndex;
+        const uint64_t nextSequence = m_lastSegmentIndex + 1 - m_indexOffset + initialSequence;
+        requestUrl += (std::string::npos == requestUrl.find('?')) ? "?" : "&";
+        requestUrl += c_HLS_MSN + std::to_string(nextSequence) + "&_HLS_part=" + std::to_string(NumberOfParts());
+    }
+    DownloadPlaylist(requestUrl, data, m_effectivePlayListUrl, isCanceled);
+    // Next directives will differ
+    const auto directivesPos = m_effectivePlayListUrl.find(c_HLS_MSN);
+    if(isBlocking && std::string::npos != directivesPos && directivesPos > 0)
+        m_effectivePlayListUrl.erase(directivesPos - 1);
+}
+
+void Playlist::DownloadPlaylist(const std::string& requestUrl, std::string& data, std::string& effectiveUrl, std::function<bool()> isCanceled) const
 {
-    char buffer[1024];
-    
-    const std::string& requestUrl = (m_effectivePlayListUrl.empty()) ? m_playListUrl : m_effectivePlayListUrl;
-    
     LogDebug(">>> PlaylistBuffer: (re)loading playlist %s", requestUrl.c_str());
     
     bool succeeded = false;
     try{
-        //m_effectivePlayListUrl.clear();
-        
         std::vector<std::string> headers;
         if(!m_httplHeaders.empty()) {
             auto headerStrings = StringUtils::Split(m_httplHeaders.substr(1), "=");
@@ -288,7 +815,7 @@ void Playlist::LoadPlaylist(std::string& data) const
         }
         
         HttpEngine::Request request(requestUrl, "", headers);
-        HttpEngine::DoCurl(request, HttpEngine::TCookies(), &data, 9999999, &m_effectivePlayListUrl);
+        HttpEngine::DoCurl(request, HttpEngine::TCookies(), &data, 9999999, &effectiveUrl, isCanceled);
         succeeded = true;
         
     }catch (std::exception& ex) {
@@ -300,26 +827,230 @@ void Playlist::LoadPlaylist(std::string& data) const
     if (!succeeded)
         throw PlaylistException("Failed to obtain playlist from server.");
     
-    LogDebug(">>> PlaylistBuffer: playlist effective URL %s", m_effectivePlayListUrl.c_str());
+    LogDebug(">>> PlaylistBuffer: playlist effective URL %s", effectiveUrl.c_str());
     LogDebug(">>> PlaylistBuffer: (re)loading done. Content: \n%s", data.substr(0, 16000).c_str());
     
 }
 
 bool Playlist::Reload() {
+    std::string data;
+    return LoadUpdate(data) && ApplyUpdate(data);
+}
+
+bool Playlist::LoadUpdate(std::string& data, std::function<bool()> isCanceled) const {
     // For VOD plist we can't reload/refresh.
     if(m_isVod)
         return true;
     try {
-        std::string data;
-        LoadPlaylist(data);
+        LoadPlaylist(data, IsLowLatency(), isCanceled);
+        return true;
+    } catch (std::exception& ex) {
+        LogError("Playlist: FAILED to reload playlist. Error: %s", ex.what());
+    }
+    return false;
+}
+
+bool Playlist::ApplyUpdate(const std::string& data) {
+    if(m_isVod)
+        return true;
+    try {
+        const int64_t lastSegmentIndex = m_lastSegmentIndex;
+        const size_t numberOfParts = NumberOfParts();
         // Empty playlist treat as EOF.
-        return ParsePlaylist(data);
+        const bool hasContent = ParsePlaylist(data);
+        m_isUpdated = lastSegmentIndex != m_lastSegmentIndex || numberOfParts != NumberOfParts();
+        return hasContent;
     } catch (std::exception& ex) {
         LogError("Playlist: FAILED to reload playlist. Error: %s", ex.what());
     }
     return false;
 }
 
+size_t Playlist::NumberOfParts() const {
+    // Parts of incomplete segment
+    const auto it = m_parts.find(m_lastSegmentIndex + 1);
+    return it == m_parts.end() ? 0 : it->second.parts.size();
+}
+
+size_t Playlist::VariantForBandwidth(uint64_t bandwidth) const
+{
+    size_t variant = 0;
+    for(size_t i = 1; i < m_variants.size() && m_variants[i].bandwidth <= bandwidth; ++i) {
+        variant = i;
+    }
+    return variant;
+}
+
+bool Playlist::LoadVariant(size_t variant, std::string& data, std::string& effectiveUrl, std::function<bool()> isCanceled) const
+{
+    if(variant >= m_variants.size() || variant == m_currentVariant)
+        return false;
+    try {
+        DownloadPlaylist(m_variants[variant].url, data, effectiveUrl, isCanceled);
+    } catch (std::exception& ex) {
+        LogError("Playlist: failed to load variant %d. Error: %s", (int)variant + 1, ex.what());
+        return false;
+    }
+    return true;
+}
+
+// First media sequence number and number of segments of media playlist
+static void MediaSequenceRange(const std::string& data, uint64_t& first, uint64_t& segments)
+{
+    first = segments = 0;
+    PlaylistLines lines(data);
+    StringRef line;
+    while(lines.Next(line)) {
+        if(StartsWith(line, c_SEQ))
+            first = ParseInteger(line.substr(c_SEQ.size()), "#EXT-X-MEDIA-SEQUENCE");
+        else if(StartsWith(line, c_INF))
+            ++segments;
+    }
+}
+
+bool Playlist::SwitchToVariant(size_t variant, uint64_t fromIndex, const std::string& data, const std::string& effectiveUrl)
+{
+    if(variant >= m_variants.size() || variant == m_currentVariant)
+        return false;
+    
+    // Segment indexes are derived from media sequence numbers.
+    // When the variant does not cover next segment, it is not aligned with current one,
+    // i.e. playback would jump. Keep current variant then.
+    try {
+        uint64_t firstSequence = 0, segments = 0;
+        MediaSequenceRange(data, firstSequence, segments);
+        const int64_t initialSequence = (-1 == m_initialInternalIndex) ? firstSequence : m_initialInternalIndex;
+        const int64_t firstIndex = m_indexOffset + (int64_t)firstSequence - initialSequence;
+        if((int64_t)fromIndex < firstIndex || (int64_t)fromIndex > firstIndex + (int64_t)segments) {
+            LogError("Playlist: media sequence of variant %d [%" PRIu64 ", %" PRIu64 ") does not contain segment #%" PRIu64 ". Variant is not switched.",
+                     (int)variant + 1, firstSequence, firstSequence + segments, fromIndex - m_indexOffset + initialSequence);
+            return false;
+        }
+    } catch (std::exception& ex) {
+        LogError("Playlist: failed to parse variant %d. Error: %s", (int)variant + 1, ex.what());
+        return false;
+    }
+    
+    m_playListUrl = m_variants[variant].url;
+    m_effectivePlayListUrl = effectiveUrl;
+    LogNotice("Playlist: switching from variant %d (%" PRIu64 " bps) to %d (%" PRIu64 " bps) at segment #%" PRIu64 ".",
+              (int)m_currentVariant + 1, m_variants[m_currentVariant].bandwidth,
+              (int)variant + 1, m_variants[variant].bandwidth, fromIndex);
+    m_currentVariant = variant;
+    
+    // Forget not loaded segments of previous variant
+    m_segmentUrls.erase(m_segmentUrls.lower_bound(fromIndex), m_segmentUrls.end());
+    m_parts.erase(m_parts.lower_bound(fromIndex), m_parts.end());
+    m_loadIterator = fromIndex;
+    m_lastSegmentUri.clear();
+    m_lastSegmentEnd = std::string::npos;
+    // Init section and byte ranges belong to rendition
+    m_initUrl.clear();
+    m_initRange = ByteRange();
+    m_lastRangeUri.clear();
+    m_lastRangeEnd = 0;
+    m_keyUrl.clear();
+    m_keyIv.clear();
+    try {
+        ParsePlaylist(data);
+    } catch (std::exception& ex) {
+        // Segments will be restored on next reload
+        LogError("Playlist: failed to parse variant %d. Error: %s", (int)variant + 1, ex.what());
+    }
+    return true;
+}
+
+bool Playlist::LiveStartIndex(unsigned int segmentsFromEnd, uint64_t& index) const {
+    if(m_isVod || m_segmentUrls.empty())
+        return false;
+    
+    auto it = m_segmentUrls.end();
+    if(m_hasStartTimeOffset && m_startTimeOffset >= 0.0) {
+        // Offset from the beginning of playlist
+        float startTime = 0.0;
+        it = m_segmentUrls.begin();
+        while(std::next(it) != m_segmentUrls.end() && startTime + it->second.duration <= m_startTimeOffset) {
+            startTime += it->second.duration;
+            ++it;
+        }
+    } else {
+        // Offset from the end of playlist
+        const float timeFromEnd = m_hasStartTimeOffset ? -m_startTimeOffset : m_holdBack;
+        const unsigned int minSegments = m_hasStartTimeOffset ? 1 : std::max(segmentsFromEnd, 1U);
+        float duration = 0.0;
+        unsigned int segments = 0;
+        do {
+            --it;
+            duration += it->second.duration;
+            ++segments;
+        } while(it != m_segmentUrls.begin() && (segments < minSegments || duration < timeFromEnd));
+    }
+    index = it->first;
+    LogDebug("Playlist: live start from segment #%" PRIu64 " of [%" PRIu64 ", %" PRIu64 "].", index, m_segmentUrls.begin()->first, m_segmentUrls.rbegin()->first);
+    return true;
+}
+
+bool Playlist::LiveStartPart(uint64_t& index, size_t& part) const {
+    if(m_isVod || !IsLowLatency() || m_parts.empty())
+        return false;
+    // Spec recommends at least 3 part targets
+    const float holdBack = m_partHoldBack > 0.0 ? m_partHoldBack : 3 * m_partTarget;
+    float duration = 0.0;
+    for (auto it = m_parts.rbegin(); it != m_parts.rend(); ++it) {
+        const auto segment = m_segmentUrls.find(it->first);
+        if(segment == m_segmentUrls.end())
+            break;
+        // CBC decryption can't start in the middle of segment
+        const bool canStartInside = segment->second.keyUrl.empty();
+        const auto& parts = it->second.parts;
+        for (size_t i = parts.size(); i > 0; --i) {
+            duration += parts[i - 1].duration;
+            const bool isIndependent = 1 == i || (canStartInside && parts[i - 1].isIndependent);
+            if(duration >= holdBack && isIndependent) {
+                index = it->first;
+                part = i - 1;
+                LogDebug("Playlist: live start from part %d of segment #%" PRIu64 " (%0.2f sec from the end).", (int)part, index, duration);
+                return true;
+            }
+        }
+        // Parts should be contiguous
+        const auto prev = std::next(it);
+        if(prev != m_parts.rend() && prev->first + 1 != it->first)
+            break;
+    }
+    return false;
+}
+
+bool Playlist::SetNextPart(uint64_t index, size_t part) {
+    if(!SetNextSegmentIndex(index))
+        return false;
+    auto& info = m_segmentUrls[index];
+    // Complete segment from the beginning is loaded by single request
+    if(part > 0 || info.url.empty()) {
+        info.isPartial = true;
+        info.firstPart = part;
+    }
+    return true;
+}
+
+PartStatus Playlist::Part(uint64_t index, size_t part, PartInfo& info) const {
+    const auto it = m_parts.find(index);
+    if(it == m_parts.end())
+        return k_PartNone;
+    const auto& segmentParts = it->second;
+    if(part < segmentParts.parts.size()) {
+        info = segmentParts.parts[part];
+        return k_PartReady;
+    }
+    if(segmentParts.isComplete)
+        return k_PartNone;
+    if(part == segmentParts.parts.size() && !segmentParts.hint.url.empty()) {
+        info = segmentParts.hint;
+        return k_PartHint;
+    }
+    return k_PartPending;
+}
+
 bool Playlist::NextSegment(SegmentInfo& info, bool& hasMoreSegments) {
     hasMoreSegments = false;
     //        LogDebug("Playlist: searching for segment info #%" PRIu64 "...", m_loadIterator);
@@ -333,6 +1064,29 @@ bool Playlist::NextSegment(SegmentInfo& info, bool& hasMoreSegments) {
     return false;
 }
 
+bool Playlist::SegmentForMediaSequence(uint64_t mediaSequence, SegmentInfo& info) const {
+    const uint64_t initialSequence = (-1 == m_initialInternalIndex) ? 0 : m_initialInternalIndex;
+    if(mediaSequence < initialSequence)
+        return false;
+    const auto it = m_segmentUrls.find(m_indexOffset + mediaSequence - initialSequence);
+    if(it == m_segmentUrls.end())
+        return false;
+    info = it->second;
+    return true;
+}
+
+bool Playlist::SegmentAtTime(TimeOffset time, SegmentInfo& info) const {
+    const TimeOffset startTime = GetTimeOffset() + time;
+    for (const auto& it : m_segmentUrls) {
+        const auto& segment = it.second;
+        if(segment.startTime <= startTime && startTime < segment.startTime + segment.duration && !segment.url.empty()) {
+            info = segment;
+            return true;
+        }
+    }
+    return false;
+}
+
 bool Playlist::SetNextSegmentIndex(uint64_t idx) {
     if(m_segmentUrls.count(idx) == 0) {
         LogDebug("Playlist: failed to set next segment #%" PRIu64 ". m_segmentUrls contains serments [%" PRIu64 ", %" PRIu64 "].", idx, m_segmentUrls.begin()->first, (--m_segmentUrls.end())->first);
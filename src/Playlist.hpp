@@ -26,41 +26,162 @@
 #include <stdio.h>
 #include <string>
 #include <map>
+#include <vector>
 #include <exception>
+#include <functional>
 
 namespace Buffers{
 
 typedef  float TimeOffset;
 
+// Sub-range of resource (EXT-X-BYTERANGE), empty means whole resource
+struct ByteRange {
+    ByteRange() : offset(0), length(0) {}
+    ByteRange(uint64_t o, uint64_t l) : offset(o), length(l) {}
+    bool IsEmpty() const {return 0 == length;}
+    uint64_t offset;
+    uint64_t length;
+};
+
 struct SegmentInfo {
-    SegmentInfo () : startTime(0.0), duration(0.0) , index (-1){}
-    SegmentInfo(float t, float d, const std::string& u, uint64_t i) : startTime(t), url(u), duration(d), index(i){}
-    SegmentInfo(const SegmentInfo& info) : SegmentInfo(info.startTime, info.duration, info.url, info.index) {}
-    SegmentInfo&  operator=(const SegmentInfo&& s) { this->~SegmentInfo(); return *new (this)SegmentInfo(s.startTime, s.duration, s.url, s.index);}
-    SegmentInfo&  operator=(const SegmentInfo& s) { this->~SegmentInfo(); return *new (this)SegmentInfo(s.startTime, s.duration, s.url, s.index);}
+    SegmentInfo () : startTime(0.0), duration(0.0) , index (-1), mediaSequence(0), isPartial(false), firstPart(0){}
+    SegmentInfo(float t, float d, const std::string& u, uint64_t i) : startTime(t), url(u), duration(d), index(i), mediaSequence(0), isPartial(false), firstPart(0){}
+    SegmentInfo(const SegmentInfo& info) : SegmentInfo(info.startTime, info.duration, info.url, info.index) {
+        mediaSequence = info.mediaSequence;
+        isPartial = info.isPartial;
+        firstPart = info.firstPart;
+        range = info.range;
+        initUrl = info.initUrl;
+        initRange = info.initRange;
+        keyUrl = info.keyUrl;
+        keyIv = info.keyIv;
+    }
+    SegmentInfo&  operator=(const SegmentInfo&& s) { this->~SegmentInfo(); return *new (this)SegmentInfo(s);}
+    SegmentInfo&  operator=(const SegmentInfo& s) { this->~SegmentInfo(); return *new (this)SegmentInfo(s);}
     const std::string url;
     // Calculated from playlist's index offset
     const TimeOffset startTime;
     const float duration;
     uint64_t index;
+    // Playlist's own sequence number (without index offset)
+    uint64_t mediaSequence;
+    // Part of url resource
+    ByteRange range;
+    // Media initialization section (EXT-X-MAP), empty when missing
+    std::string initUrl;
+    ByteRange initRange;
+    // AES-128 key (EXT-X-KEY), empty for clear segment
+    std::string keyUrl;
+    // 16 bytes of initialization vector
+    std::string keyIv;
+    // Low-latency HLS: segment is loaded by parts (Playlist::Part()) starting from firstPart.
+    // URL of partial segment is empty until the segment is completed.
+    bool isPartial;
+    size_t firstPart;
+};
+
+// Partial segment (EXT-X-PART) or its preload hint (EXT-X-PRELOAD-HINT)
+struct PartInfo {
+    PartInfo() : duration(0.0), isIndependent(false), isGap(false) {}
+    std::string url;
+    ByteRange range;
+    float duration;
+    bool isIndependent;
+    bool isGap;
+};
+
+enum PartStatus {
+    // Part is announced
+    k_PartReady = 0,
+    // Part is expected soon, server holds request for hint until it is ready
+    k_PartHint,
+    // Part is not known yet (wait for playlist reload)
+    k_PartPending,
+    // No more parts, segment is complete
+    k_PartNone
+};
+
+struct VariantInfo {
+    VariantInfo(uint64_t b, const std::string& u) : bandwidth(b), url(u) {}
+    // Bits per second, as declared by #EXT-X-STREAM-INF
+    uint64_t bandwidth;
+    std::string url;
 };
 
 class Playlist {
 public:
-    Playlist(const std::string &url, uint64_t indexOffset = 0);
+    typedef std::vector<VariantInfo> TVariants;
+    
+    // bandwidthLimit (bits per second) restricts initial variant choice.
+    // 0 means the best variant.
+    Playlist(const std::string &url, uint64_t indexOffset = 0, uint64_t bandwidthLimit = 0);
 //    Playlist(const Playlist& playlist);
     bool NextSegment(SegmentInfo& info, bool& hasMoreSegments);
     bool SetNextSegmentIndex(uint64_t offset);
+    // Segment with playlist's own sequence number, e.g. same segment of mirror stream
+    bool SegmentForMediaSequence(uint64_t mediaSequence, SegmentInfo& info) const;
     bool Reload();
+    // Reload() split into network request (may be held by server on blocking reload)
+    // and parsing. LoadUpdate() does not change segments, i.e. may run concurrently with readers.
+    // isCanceled aborts request in progress (e.g. on stop).
+    bool LoadUpdate(std::string& data, std::function<bool()> isCanceled = nullptr) const;
+    bool ApplyUpdate(const std::string& data);
+    // Last reload brought new segments
+    bool IsUpdated() const {return m_isUpdated;}
+    // Incremental mode parses only segments after last known one on reload
+    // and drops expired (already loaded) segments from the list.
+    void EnableIncrementalReload(bool enable) {m_isIncremental = enable;}
     bool IsVod() const {return m_isVod;}
     int TargetDuration() const {return m_targetDuration;}
     TimeOffset GetTimeOffset() const {return m_targetDuration * m_indexOffset;}
+    // Variants sorted by bandwidth (ascending). Empty for media playlist.
+    const TVariants& Variants() const {return m_variants;}
+    size_t CurrentVariant() const {return m_currentVariant;}
+    // I-frame renditions (EXT-X-I-FRAME-STREAM-INF) sorted by bandwidth, used for trick-play
+    const TVariants& IFrameVariants() const {return m_iframeVariants;}
+    // Playlist of I-frames only (EXT-X-I-FRAMES-ONLY), each segment is a byte range of one I-frame
+    bool IsIFramesOnly() const {return m_isIFramesOnly;}
+    // Segment displayed at time offset from the beginning of playlist
+    bool SegmentAtTime(TimeOffset time, SegmentInfo& info) const;
+    // Index of best variant fitting into bandwidth (lowest when none fits)
+    size_t VariantForBandwidth(uint64_t bandwidth) const;
+    // Variant playlist is loaded without changing this one, i.e. may run concurrently with readers.
+    bool LoadVariant(size_t variant, std::string& data, std::string& effectiveUrl, std::function<bool()> isCanceled = nullptr) const;
+    // Replaces URLs of segments starting from fromIndex with segments of another variant (loaded by LoadVariant()).
+    // Media sequence numbers of variants are expected to be aligned:
+    // false (current variant is kept) when new variant does not contain segment fromIndex.
+    bool SwitchToVariant(size_t variant, uint64_t fromIndex, const std::string& data, const std::string& effectiveUrl);
+    // Index of segment to start live playback from.
+    // EXT-X-START has priority, otherwise segmentsFromEnd segments
+    // but not closer to the end than HOLD-BACK (EXT-X-SERVER-CONTROL).
+    bool LiveStartIndex(unsigned int segmentsFromEnd, uint64_t& index) const;
+    // Low-latency HLS: partial segments are announced and server supports blocking reload
+    bool IsLowLatency() const {return m_canBlockReload && m_partTarget > 0.0;}
+    float PartTarget() const {return m_partTarget;}
+    // Independent part PART-HOLD-BACK seconds from the end of playlist
+    bool LiveStartPart(uint64_t& index, size_t& part) const;
+    // Next segment is loaded by parts starting from given one
+    bool SetNextPart(uint64_t index, size_t part);
+    PartStatus Part(uint64_t index, size_t part, PartInfo& info) const;
 private:
     typedef std::map<uint64_t, SegmentInfo> TSegmentUrls;
+    struct SegmentParts {
+        SegmentParts() : isComplete(false) {}
+        std::vector<PartInfo> parts;
+        // Next part of incomplete segment, empty URL when missing
+        PartInfo hint;
+        bool isComplete;
+    };
+    typedef std::map<uint64_t, SegmentParts> TSegmentParts;
     
     bool ParsePlaylist(const std::string& data);
-    void SetBestPlaylist(const std::string& playlistUrl);
-    void LoadPlaylist(std::string& data) const;
+    bool FindResumePosition(const std::string& data, std::string::size_type& pos, int64_t& mediaIndex, int64_t& firstIndex) const;
+    void RemoveExpiredSegments(int64_t firstIndex);
+    void SetBestPlaylist(const std::string& playlistUrl, uint64_t bandwidthLimit);
+    // Blocking reload waits for next part (segment) on server side
+    void LoadPlaylist(std::string& data, bool isBlocking = false, std::function<bool()> isCanceled = nullptr) const;
+    void DownloadPlaylist(const std::string& requestUrl, std::string& data, std::string& effectiveUrl, std::function<bool()> isCanceled = nullptr) const;
+    size_t NumberOfParts() const;
     
     
     TSegmentUrls m_segmentUrls;
@@ -72,7 +193,36 @@ private:
     uint64_t m_initialInternalIndex;
     int m_targetDuration;
     std::string m_httplHeaders;
-    
+    TVariants m_variants;
+    size_t m_currentVariant;
+    TVariants m_iframeVariants;
+    bool m_isIFramesOnly;
+    // EXT-X-START TIME-OFFSET (negative - from the end of playlist)
+    bool m_hasStartTimeOffset;
+    float m_startTimeOffset;
+    // EXT-X-SERVER-CONTROL HOLD-BACK, 0 when missing
+    float m_holdBack;
+    // Current EXT-X-MAP, applies to all following segments
+    std::string m_initUrl;
+    ByteRange m_initRange;
+    // Current EXT-X-KEY URI and explicit IV (empty - IV from sequence number)
+    std::string m_keyUrl;
+    std::string m_keyIv;
+    // Byte range without offset continues previous range of same resource
+    std::string m_lastRangeUri;
+    uint64_t m_lastRangeEnd;
+    bool m_isUpdated;
+    // Incremental reload state
+    bool m_isIncremental;
+    uint64_t m_lastMediaSequence;
+    int64_t m_lastSegmentIndex;
+    std::string m_lastSegmentUri;
+    std::string::size_type m_lastSegmentEnd;
+    // Low-latency HLS
+    TSegmentParts m_parts;
+    float m_partTarget;
+    float m_partHoldBack;
+    bool m_canBlockReload;
 };
 
 class PlaylistException :  public std::exception
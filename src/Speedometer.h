@@ -11,7 +11,9 @@
 
 #include <stdint.h>
 #include <chrono>
-#include <queue>
+#include <deque>
+#include <vector>
+#include <algorithm>
 
 namespace Helpers {
 
@@ -24,7 +26,7 @@ public:
         Start();
     }
     void Start() {
-        while(!m_steps.empty()) m_steps.pop();
+        m_steps.clear();
         m_totalBytes = 0;
         m_totalSec = 0.0;
         m_stepStart = std::chrono::system_clock::now();
@@ -37,24 +39,60 @@ public:
     }
     void StepDone(ssize_t chunkSize)
     {
-        m_steps.emplace(m_stepStart, std::chrono::system_clock::now(), chunkSize);
+        AddStep(m_stepStart, std::chrono::system_clock::now(), chunkSize);
+    }
+    // Step measured outside, e.g. concurrent download.
+    // Overlapped steps are counted once, i.e. speed is total bytes per wall-clock time.
+    void StepDone(ssize_t chunkSize, float seconds)
+    {
+        const auto to = std::chrono::system_clock::now();
+        const auto from = to - std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::duration<float>(seconds));
+        AddStep(from, to, chunkSize);
+    }
+    
+    uint32_t BytesPerSecond() const { return m_totalSec > 0.0 ? m_totalBytes / m_totalSec : 0; }
+    float KBytesPerSecond() const { return m_totalSec > 0.0 ? m_totalBytes / m_totalSec / 1024 : 0.0; }
+    float MBytesPerSecond() const { return m_totalSec > 0.0 ? m_totalBytes / m_totalSec / 1024 / 1024 : 0.0; }
+private:
+    typedef std::chrono::time_point<std::chrono::system_clock> time_point;
+    
+    void AddStep(const time_point& from, const time_point& to, ssize_t chunkSize)
+    {
+        m_steps.emplace_back(from, to, chunkSize);
         const auto& last = m_steps.back();
         m_totalBytes += last.howMany;
-        m_totalSec += last.Seconds();
         m_stepStart = last.to;
-        while(m_totalBytes > m_dataLimit) {
+        while(m_totalBytes > m_dataLimit && m_steps.size() > 1) {
             const auto& first = m_steps.front();
             m_totalBytes -= first.howMany;
-            m_totalSec -= first.Seconds();
-            m_steps.pop();
+            m_steps.pop_front();
         }
+        m_totalSec = BusySeconds();
+    }
+    
+    // Duration of union of steps' time intervals
+    float BusySeconds() const
+    {
+        std::vector<std::pair<time_point, time_point> > intervals;
+        intervals.reserve(m_steps.size());
+        for (const auto& step : m_steps) {
+            intervals.emplace_back(step.from, step.to);
+        }
+        std::sort(intervals.begin(), intervals.end());
+        std::chrono::duration<float> busy(0);
+        auto runner = intervals.begin();
+        while(runner != intervals.end()) {
+            time_point from = runner->first;
+            time_point to = runner->second;
+            // Merge overlapped intervals
+            while(++runner != intervals.end() && runner->first <= to) {
+                to = std::max(to, runner->second);
+            }
+            busy += to - from;
+        }
+        return busy.count();
     }
     
-    uint32_t BytesPerSecond() const { return m_totalBytes / m_totalSec; }
-    float KBytesPerSecond() const { return m_totalBytes / m_totalSec / 1024; }
-    float MBytesPerSecond() const { return m_totalBytes / m_totalSec / 1024 / 1024 ; }
-private:
-    typedef std::chrono::time_point<std::chrono::system_clock> time_point;
     struct StepInfo
     {
         StepInfo(const time_point& f, const time_point& t, ssize_t d)
@@ -72,7 +110,7 @@ private:
         const time_point to;
         const ssize_t howMany;
     };
-    std::queue<StepInfo> m_steps;
+    std::deque<StepInfo> m_steps;
     const std::uint32_t m_dataLimit;
     uint32_t m_totalBytes;
     float m_totalSec;
@@ -433,6 +433,11 @@ public:
     {
         return m_DataSource->IsRealTimeStream();        
     }
+    
+    void SetSpeed(int speed) override
+    {
+        m_DataSource->SetSpeed(speed);
+    }
 };
 
 ADDONCREATOR(PVRPuzzleTv)
@@ -74,6 +74,7 @@ public:
     virtual bool CanPauseStream() = 0;
     virtual bool CanSeekStream() = 0;
     virtual bool IsRealTimeStream() = 0;
+    virtual void SetSpeed(int speed) = 0;
     virtual PVR_ERROR GetStreamTimes(kodi::addon::PVRStreamTimes& times) = 0;
     virtual int64_t SeekLiveStream(int64_t position, int whence) = 0;
     virtual int64_t PositionLiveStream() = 0;
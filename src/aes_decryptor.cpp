@@ -0,0 +1,309 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <string.h>
+#include "aes_decryptor.hpp"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define AES_X86_HARDWARE
+#include <wmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define AES_NI_TARGET
+#else
+#include <cpuid.h>
+#define AES_NI_TARGET __attribute__((target("aes,sse2")))
+#endif
+#endif
+
+namespace Buffers {
+
+    // Multiplication in GF(2^8)
+    static uint8_t Mul(uint8_t a, uint8_t b)
+    {
+        uint8_t p = 0;
+        while(b) {
+            if(b & 1)
+                p ^= a;
+            a = (uint8_t)((a << 1) ^ ((a & 0x80) ? 0x1B : 0));
+            b >>= 1;
+        }
+        return p;
+    }
+
+    // Lookup tables for software implementation, built once.
+    // Td tables combine inverse substitution and inverse mix columns.
+    struct AesTables
+    {
+        uint8_t sbox[256];
+        uint8_t invSbox[256];
+        uint32_t td[4][256];
+
+        AesTables()
+        {
+            for (int x = 0; x < 256; ++x) {
+                // Multiplicative inverse followed by affine transformation
+                uint8_t inv = 0;
+                for (int y = 1; x != 0 && y < 256; ++y) {
+                    if(Mul((uint8_t)x, (uint8_t)y) == 1) {
+                        inv = (uint8_t)y;
+                        break;
+                    }
+                }
+                uint8_t s = inv;
+                for (int i = 1; i < 5; ++i) {
+                    s ^= (uint8_t)((inv << i) | (inv >> (8 - i)));
+                }
+                s ^= 0x63;
+                sbox[x] = s;
+                invSbox[s] = (uint8_t)x;
+            }
+            // Columns of inverse mix columns matrix
+            static const uint8_t c_columns[4][4] = {{14, 9, 13, 11}, {11, 14, 9, 13}, {13, 11, 14, 9}, {9, 13, 11, 14}};
+            for (int j = 0; j < 4; ++j) {
+                for (int x = 0; x < 256; ++x) {
+                    const uint8_t s = invSbox[x];
+                    td[j][x] = (uint32_t)Mul(s, c_columns[j][0]) | (uint32_t)Mul(s, c_columns[j][1]) << 8
+                             | (uint32_t)Mul(s, c_columns[j][2]) << 16 | (uint32_t)Mul(s, c_columns[j][3]) << 24;
+                }
+            }
+        }
+    };
+
+    static const AesTables& Tables()
+    {
+        static const AesTables tables;
+        return tables;
+    }
+
+    // Column of state, byte order independent of platform
+    static inline uint32_t LoadColumn(const uint8_t* p)
+    {
+        return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+    }
+
+    // Inverse mix columns of one round key
+    static void InvMixColumns(const uint8_t* in, uint8_t* out)
+    {
+        for (int c = 0; c < 4; ++c) {
+            const uint8_t* a = in + 4 * c;
+            uint8_t* b = out + 4 * c;
+            b[0] = Mul(a[0], 14) ^ Mul(a[1], 11) ^ Mul(a[2], 13) ^ Mul(a[3], 9);
+            b[1] = Mul(a[0], 9) ^ Mul(a[1], 14) ^ Mul(a[2], 11) ^ Mul(a[3], 13);
+            b[2] = Mul(a[0], 13) ^ Mul(a[1], 9) ^ Mul(a[2], 14) ^ Mul(a[3], 11);
+            b[3] = Mul(a[0], 11) ^ Mul(a[1], 13) ^ Mul(a[2], 9) ^ Mul(a[3], 14);
+        }
+    }
+
+    // Equivalent inverse cipher (FIPS-197 5.3.5) with decryption key schedule
+    static void DecryptBlockSoftware(const uint8_t* decryptionKeys, const uint8_t* in, uint8_t* out)
+    {
+        const AesTables& t = Tables();
+        uint32_t s[4], n[4];
+        for (int c = 0; c < 4; ++c) {
+            s[c] = LoadColumn(in + 4 * c) ^ LoadColumn(decryptionKeys + 4 * c);
+        }
+        for (int round = 1; round < 10; ++round) {
+            const uint8_t* rk = decryptionKeys + 16 * round;
+            for (int c = 0; c < 4; ++c) {
+                n[c] = t.td[0][s[c] & 0xFF] ^ t.td[1][(s[(c + 3) & 3] >> 8) & 0xFF]
+                     ^ t.td[2][(s[(c + 2) & 3] >> 16) & 0xFF] ^ t.td[3][s[(c + 1) & 3] >> 24]
+                     ^ LoadColumn(rk + 4 * c);
+            }
+            memcpy(s, n, sizeof(s));
+        }
+        const uint8_t* rk = decryptionKeys + 160;
+        for (int c = 0; c < 4; ++c) {
+            for (int r = 0; r < 4; ++r) {
+                out[4 * c + r] = t.invSbox[(s[(c - r) & 3] >> (8 * r)) & 0xFF] ^ rk[4 * c + r];
+            }
+        }
+    }
+
+#ifdef AES_X86_HARDWARE
+    static bool HasAesNi()
+    {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 25)) != 0;
+#else
+        unsigned int a, b, c, d;
+        return __get_cpuid(1, &a, &b, &c, &d) && (c & bit_AES) != 0;
+#endif
+    }
+
+    // CBC decryption is parallel, i.e. 4 blocks are interleaved to fill AES pipeline
+    AES_NI_TARGET
+    static void DecryptCbcHardware(const uint8_t* decryptionKeys, uint8_t* ivBytes, const uint8_t* in, size_t numOfBlocks, uint8_t* out)
+    {
+        const __m128i* dk = (const __m128i*)decryptionKeys;
+        __m128i iv = _mm_loadu_si128((const __m128i*)ivBytes);
+        const __m128i* src = (const __m128i*)in;
+        __m128i* dst = (__m128i*)out;
+        size_t i = 0;
+        for (; i + 4 <= numOfBlocks; i += 4) {
+            const __m128i c0 = _mm_loadu_si128(src + i);
+            const __m128i c1 = _mm_loadu_si128(src + i + 1);
+            const __m128i c2 = _mm_loadu_si128(src + i + 2);
+            const __m128i c3 = _mm_loadu_si128(src + i + 3);
+            __m128i b0 = _mm_xor_si128(c0, dk[0]);
+            __m128i b1 = _mm_xor_si128(c1, dk[0]);
+            __m128i b2 = _mm_xor_si128(c2, dk[0]);
+            __m128i b3 = _mm_xor_si128(c3, dk[0]);
+            for (int r = 1; r < 10; ++r) {
+                b0 = _mm_aesdec_si128(b0, dk[r]);
+                b1 = _mm_aesdec_si128(b1, dk[r]);
+                b2 = _mm_aesdec_si128(b2, dk[r]);
+                b3 = _mm_aesdec_si128(b3, dk[r]);
+            }
+            b0 = _mm_aesdeclast_si128(b0, dk[10]);
+            b1 = _mm_aesdeclast_si128(b1, dk[10]);
+            b2 = _mm_aesdeclast_si128(b2, dk[10]);
+            b3 = _mm_aesdeclast_si128(b3, dk[10]);
+            _mm_storeu_si128(dst + i, _mm_xor_si128(b0, iv));
+            _mm_storeu_si128(dst + i + 1, _mm_xor_si128(b1, c0));
+            _mm_storeu_si128(dst + i + 2, _mm_xor_si128(b2, c1));
+            _mm_storeu_si128(dst + i + 3, _mm_xor_si128(b3, c2));
+            iv = c3;
+        }
+        for (; i < numOfBlocks; ++i) {
+            const __m128i c = _mm_loadu_si128(src + i);
+            __m128i b = _mm_xor_si128(c, dk[0]);
+            for (int r = 1; r < 10; ++r) {
+                b = _mm_aesdec_si128(b, dk[r]);
+            }
+            b = _mm_aesdeclast_si128(b, dk[10]);
+            _mm_storeu_si128(dst + i, _mm_xor_si128(b, iv));
+            iv = c;
+        }
+        _mm_storeu_si128((__m128i*)ivBytes, iv);
+    }
+#endif // AES_X86_HARDWARE
+
+    bool AesDecryptor::IsHardwareAccelerated()
+    {
+#ifdef AES_X86_HARDWARE
+        static const bool hasAesNi = HasAesNi();
+        return hasAesNi;
+#else
+        return false;
+#endif
+    }
+
+    AesDecryptor::AesDecryptor(const uint8_t* key, const uint8_t* iv, bool allowHardware)
+    : m_useHardware(allowHardware && IsHardwareAccelerated())
+    , m_pendingSize(0)
+    {
+        // Key expansion
+        const AesTables& t = Tables();
+        uint8_t roundKeys[176];
+        memcpy(roundKeys, key, KEY_SIZE);
+        uint8_t rcon = 1;
+        for (int i = 16; i < 176; i += 4) {
+            uint8_t w[4] = {roundKeys[i - 4], roundKeys[i - 3], roundKeys[i - 2], roundKeys[i - 1]};
+            if(0 == i % 16) {
+                const uint8_t first = w[0];
+                w[0] = t.sbox[w[1]] ^ rcon;
+                w[1] = t.sbox[w[2]];
+                w[2] = t.sbox[w[3]];
+                w[3] = t.sbox[first];
+                rcon = Mul(rcon, 2);
+            }
+            for (int j = 0; j < 4; ++j) {
+                roundKeys[i + j] = roundKeys[i - 16 + j] ^ w[j];
+            }
+        }
+        // Decryption order of round keys, middle ones with inverse mix columns (as AESIMC does)
+        memcpy(m_decryptionKeys, roundKeys + 160, 16);
+        for (int i = 1; i < 10; ++i) {
+            InvMixColumns(roundKeys + 16 * (10 - i), m_decryptionKeys + 16 * i);
+        }
+        memcpy(m_decryptionKeys + 160, roundKeys, 16);
+        memcpy(m_iv, iv, BLOCK_SIZE);
+    }
+
+    void AesDecryptor::DecryptBlocks(const uint8_t* in, size_t numOfBlocks, uint8_t* out)
+    {
+#ifdef AES_X86_HARDWARE
+        if(m_useHardware) {
+            DecryptCbcHardware(m_decryptionKeys, m_iv, in, numOfBlocks, out);
+            return;
+        }
+#endif
+        for (size_t i = 0; i < numOfBlocks; ++i, in += BLOCK_SIZE, out += BLOCK_SIZE) {
+            DecryptBlockSoftware(m_decryptionKeys, in, out);
+            for (size_t j = 0; j < BLOCK_SIZE; ++j) {
+                out[j] ^= m_iv[j];
+            }
+            memcpy(m_iv, in, BLOCK_SIZE);
+        }
+    }
+
+    size_t AesDecryptor::Update(const uint8_t* in, size_t size, uint8_t* out)
+    {
+        size_t written = 0;
+        while(size > 0) {
+            // Pending block is not the last one
+            if(BLOCK_SIZE == m_pendingSize) {
+                DecryptBlocks(m_pending, 1, out + written);
+                written += BLOCK_SIZE;
+                m_pendingSize = 0;
+            }
+            // Bulk decryption directly from input, at least one byte is kept
+            if(0 == m_pendingSize && size > BLOCK_SIZE) {
+                const size_t numOfBlocks = (size - 1) / BLOCK_SIZE;
+                DecryptBlocks(in, numOfBlocks, out + written);
+                written += numOfBlocks * BLOCK_SIZE;
+                in += numOfBlocks * BLOCK_SIZE;
+                size -= numOfBlocks * BLOCK_SIZE;
+            }
+            const size_t chunk = (BLOCK_SIZE - m_pendingSize < size) ? BLOCK_SIZE - m_pendingSize : size;
+            memcpy(m_pending + m_pendingSize, in, chunk);
+            m_pendingSize += chunk;
+            in += chunk;
+            size -= chunk;
+        }
+        return written;
+    }
+
+    bool AesDecryptor::Finish(uint8_t* out, size_t& size)
+    {
+        size = 0;
+        if(BLOCK_SIZE != m_pendingSize)
+            return false;
+        uint8_t block[BLOCK_SIZE];
+        DecryptBlocks(m_pending, 1, block);
+        m_pendingSize = 0;
+        const uint8_t padding = block[BLOCK_SIZE - 1];
+        if(0 == padding || padding > BLOCK_SIZE)
+            return false;
+        for (size_t i = BLOCK_SIZE - padding; i < BLOCK_SIZE; ++i) {
+            if(block[i] != padding)
+                return false;
+        }
+        size = BLOCK_SIZE - padding;
+        memcpy(out, block, size);
+        return true;
+    }
+}
@@ -0,0 +1,70 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef __aes_decryptor_hpp__
+#define __aes_decryptor_hpp__
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace Buffers {
+
+    // Streaming AES-128-CBC decryption of HLS segment (EXT-X-KEY METHOD=AES-128).
+    // Data may be fed by portions of any size as it arrives from network.
+    // AES-NI is used when CPU supports it.
+    class AesDecryptor
+    {
+    public:
+        static const size_t BLOCK_SIZE = 16;
+        static const size_t KEY_SIZE = 16;
+
+        // allowHardware = false forces software implementation (e.g. for tests)
+        AesDecryptor(const uint8_t* key, const uint8_t* iv, bool allowHardware = true);
+
+        // Decrypts all complete blocks but the last one (it may contain padding).
+        // out should have room for size + BLOCK_SIZE bytes.
+        // Returns number of decrypted bytes.
+        size_t Update(const uint8_t* in, size_t size, uint8_t* out);
+        // Decrypts last block and strips PKCS7 padding.
+        // out should have room for BLOCK_SIZE bytes.
+        // Returns false on truncated data or invalid padding.
+        bool Finish(uint8_t* out, size_t& size);
+
+        static bool IsHardwareAccelerated();
+
+    private:
+        AesDecryptor(const AesDecryptor&) = delete;
+        AesDecryptor& operator=(const AesDecryptor&) = delete;
+
+        void DecryptBlocks(const uint8_t* in, size_t numOfBlocks, uint8_t* out);
+
+        // Decryption round keys, 11 x 16 bytes (aligned for SSE loads)
+        alignas(16) uint8_t m_decryptionKeys[176];
+        bool m_useHardware;
+        uint8_t m_iv[BLOCK_SIZE];
+        // Ciphertext waiting for more data
+        uint8_t m_pending[BLOCK_SIZE];
+        size_t m_pendingSize;
+    };
+}
+#endif /* __aes_decryptor_hpp__ */
@@ -26,6 +26,7 @@
 
 #include "p8-platform/os.h"
 #include <stdint.h>
+#include "segment_data.hpp"
 
 namespace Buffers
 {
@@ -57,6 +58,10 @@ namespace Buffers
         // Write interface
         virtual bool LockUnitForWrite(uint8_t** pBuf) = 0;
         virtual void UnlockAfterWriten(uint8_t* pBuf, ssize_t writtenBytes = -1) = 0;
+        // Segment-aware cache keeps references to loaded segments (no copy)
+        virtual bool IsSegmentAware() const {return false;}
+        // False when cache is full
+        virtual bool AppendSegment(const TSegmentData& data) {return false;}
         
         virtual time_t StartTime() const = 0;
         virtual time_t EndTime() const = 0;
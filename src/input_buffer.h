@@ -31,9 +31,12 @@
 #include <stdint.h>
 #include <exception>
 #include <string>
+#include "segment_data.hpp"
 
 namespace Buffers {
     
+    struct TsStreamHealth;
+
     class InputBufferException : public std::exception
     {
     public:
@@ -56,6 +59,15 @@ namespace Buffers {
         virtual int64_t Seek(int64_t iPosition, int iWhence) = 0;
         virtual bool SwitchStream(const std::string &newUrl) = 0;
         virtual void AbortRead() = 0;
+        // Transport stream health counters (see TsPacketFilter).
+        // False when stream data is not checked.
+        virtual bool GetStreamHealth(TsStreamHealth& health) const { return false; }
+        // Playback speed (1000 - normal, negative - rewind)
+        virtual void SetSpeed(int speed) {}
+        // Segmented stream (HLS) may pass loaded data by reference instead of Read().
+        virtual bool CanReadSegments() const { return false; }
+        // Returns size of data, 0 on timeout, negative on error.
+        virtual ssize_t ReadSegment(TSegmentData& data, uint32_t timeoutMs) { return -1; }
     protected:
         const int c_commonTimeoutMs = 10000; // 10 sec
     };
@@ -206,9 +206,9 @@ public:
         _channelId =  epgTag.UniqueChannelId;
         
     }
-    virtual int SegmentsAmountToCache() const {
-        // 20 segments cache
-        return 20;
+    virtual int SecondsToCache() const {
+        // 2 minutes cache
+        return 120;
     }
     virtual time_t Duration() const
     {
@@ -31,7 +31,9 @@
 #include "p8-platform/threads/mutex.h"
 #include <memory>
 #include <list>
+#include <iterator>
 #include "playlist_cache.hpp"
+#include "segment_block_pool.hpp"
 #include "Playlist.hpp"
 #include "globals.hpp"
 #include "httplib.h"
@@ -39,30 +41,95 @@
 using namespace Globals;
 
 namespace Buffers {
-PlaylistCache::PlaylistCache(const std::string &playlistUrl, PlaylistBufferDelegate delegate, bool seekForVod)
-: m_totalLength(0)
-, m_bitrate(0.0)
-, m_playlist(new Playlist(playlistUrl))
+
+// Adaptive bitrate:
+// variant should fit into measured throughput with some headroom.
+static const float c_abrHeadroom = 0.75;
+// Switch down immediately when current variant exceeds this part of throughput.
+static const float c_abrDownThreshold = 0.9;
+// Switch up only after throughput confirmed by few segments in a row.
+static const unsigned int c_abrUpSwitchSegments = 3;
+// Minimal amount of measured segments for decision.
+static const unsigned int c_abrMinSegments = 2;
+// Speedometer window
+static const uint32_t c_abrMeasurementWindow = 16 * 1024 * 1024;
+// Seconds of media to cache when delegate does not tell
+static const int c_defaultSecondsToCache = 120;
+// Live stream needs few segments ahead only
+static const int c_liveSecondsToCache = 30;
+// Weight of new segment in average media bitrate
+static const float c_mediaBitrateWeight = 0.25;
+// Parallel HEAD requests for VOD segment sizes
+static const size_t c_maxConcurrentSizeProbes = 4;
+// Cache limit in seconds needs bitrate of first segment, until then only few segments are kept
+static const unsigned int c_maxSegmentsWithoutBitrate = 3;
+
+std::atomic<uint64_t> PlaylistCache::s_measuredBandwidth(0);
+std::atomic<int64_t> PlaylistCache::s_memoryLimit(256 * 1024 * 1024);
+std::atomic<int64_t> PlaylistCache::s_totalCacheSize(0);
+
+void PlaylistCache::SetMemoryLimitInMb(int sizeInMb)
+{
+    if(sizeInMb < 16)
+        sizeInMb = 16;
+    s_memoryLimit = (int64_t)sizeInMb * 1024 * 1024;
+}
+
+PlaylistCache::PlaylistCache(const std::string &playlistUrl, PlaylistBufferDelegate delegate, bool seekForVod, unsigned int liveStartSegments)
+: m_bitrate(0.0)
+, m_playlist(new Playlist(playlistUrl, 0, s_measuredBandwidth * c_abrHeadroom))
 , m_playlistTimeOffset(0.0)
 , m_delegate(delegate)
 , m_cacheSizeInBytes(0)
+, m_cacheSizeLimit(0)
+, m_segmentsInCache(0)
 , m_currentSegmentIndex(0)
 , m_currentSegmentPositionFactor(0.0)
 , m_seekForVod(seekForVod)
+, m_downloadSpeed(c_abrMeasurementWindow)
+, m_segmentsToAdapt(0)
+, m_upSwitchVotes(0)
+, m_isTrickPlay(false)
+, m_secondsToCache(0)
+, m_mediaBitrate(0.0)
 {
+    // Live stream does not need expired segments.
+    // Parse only new ones on reload.
+    if(!CanSeek()) {
+        m_playlist->EnableIncrementalReload(true);
+        // Start close to live edge instead of downloading whole playlist window
+        uint64_t startIndex = 0;
+        size_t startPart = 0;
+        if(m_playlist->LiveStartPart(startIndex, startPart)) {
+            // Low-latency stream starts PART-HOLD-BACK from live edge
+            m_playlist->SetNextPart(startIndex, startPart);
+        } else if(liveStartSegments > 0 && m_playlist->LiveStartIndex(liveStartSegments, startIndex)) {
+            m_playlist->SetNextSegmentIndex(startIndex);
+        }
+    } else if(SegmentDiskStore::IsEnabled()) {
+        // Evicted archive segments are kept on disk for back seek
+        m_diskStore.reset(new SegmentDiskStore());
+    }
     QueueAllSegmentsForLoading();
     // For VOD we can fill data offset for segments already.
     if(m_playlist->IsVod()) {
         TimeOffset timeOffaset = 0.0;
         auto it = m_dataToLoad.begin();
         auto last  = m_dataToLoad.end();
+        SegmentSizeProber::TSegments segmentsToProbe;
 
         while(it!=last) {
             auto segment = std::unique_ptr<MutableSegment>(new MutableSegment(*it, timeOffaset));
+            m_segmentIndex.Add(it->index, timeOffaset, segment->Duration());
             timeOffaset += segment->Duration();
             m_segments[it->index] = std::move(segment);
+            segmentsToProbe.push_back(*it);
             ++it;
         }
+        // Exact data offsets instead of bitrate estimation
+        if(CanSeek() && !segmentsToProbe.empty()) {
+            m_sizeProber.reset(new SegmentSizeProber(segmentsToProbe, c_maxConcurrentSizeProbes));
+        }
         // For VOD playlist we would like to load last segment just after first to be ready for seek to end of stream
         // Move last to second.
 //        m_dataToLoad.insert(m_dataToLoad.begin() + 1, m_dataToLoad.back());
@@ -70,12 +137,14 @@ PlaylistCache::PlaylistCache(const std::string &playlistUrl, PlaylistBufferDeleg
     }
 
     m_currentSegmentIndex = m_dataToLoad.size() > 0 ?  m_dataToLoad.front().index : 0;
-    m_cacheSizeLimit = CanSeek()
-    ? ((nullptr != delegate) ? delegate->SegmentsAmountToCache() : 20) * 6 * 1024 * 1024 // ~6 MByte/chunck (usualy 6 sec)
-    : 0;
+    if(CanSeek())
+        m_secondsToCache = (nullptr != delegate) ? delegate->SecondsToCache() : c_defaultSecondsToCache;
+    else
+        m_secondsToCache = c_liveSecondsToCache;
 }
 
 PlaylistCache::~PlaylistCache() {
+    s_totalCacheSize -= m_cacheSizeInBytes;
     if(m_playlist){
         delete m_playlist;
     }
@@ -91,6 +160,77 @@ bool PlaylistCache::ReloadPlaylist() {
     return true;
 }
 
+bool PlaylistCache::ApplyPlaylistUpdate(const std::string& data) {
+    if(!m_playlist->ApplyUpdate(data)) {
+        LogError("PlaylistCache: playlist is empty or missing.");
+        return false;
+    }
+    QueueAllSegmentsForLoading();
+    return true;
+}
+
+uint32_t PlaylistCache::PlaylistRefreshIntervalMs() const {
+    if(m_playlist->IsVod())
+        return 0;
+    // Blocking reload is held by server until next part,
+    // i.e. following one is requested at once.
+    // Interval protects from server which does not hold requests.
+    if(m_playlist->IsLowLatency())
+        return std::max<uint32_t>(m_playlist->PartTarget() * 500, 1);
+    // HLS spec (6.3.4): target duration between reloads,
+    // half of it after reload without new segments.
+    const uint32_t interval = std::max(m_playlist->TargetDuration(), 1) * 1000;
+    return m_playlist->IsUpdated() ? interval : interval / 2;
+}
+
+bool PlaylistCache::VariantToAdapt(size_t& variant) {
+    // Seekable streams calculate data offsets from bitrate,
+    // i.e. variant can't be changed on the fly.
+    if(CanSeek() || m_playlist->Variants().size() < 2)
+        return false;
+    // Decide on segment boundaries only
+    if(m_segmentsToAdapt < c_abrMinSegments)
+        return false;
+    m_segmentsToAdapt = 0;
+
+    const uint64_t throughput = s_measuredBandwidth;
+    const auto& variants = m_playlist->Variants();
+    const size_t current = m_playlist->CurrentVariant();
+    const size_t candidate = m_playlist->VariantForBandwidth(throughput * c_abrHeadroom);
+    if(candidate < current) {
+        m_upSwitchVotes = 0;
+        if(variants[current].bandwidth <= throughput * c_abrDownThreshold)
+            return false;
+    } else if(candidate > current) {
+        if(++m_upSwitchVotes < c_abrUpSwitchSegments)
+            return false;
+        m_upSwitchVotes = 0;
+    } else {
+        m_upSwitchVotes = 0;
+        return false;
+    }
+    LogDebug("PlaylistCache: measured throughput %" PRIu64 " bps.", throughput);
+    variant = candidate;
+    return true;
+}
+
+void PlaylistCache::SwitchToVariant(size_t variant, const std::string& data, const std::string& effectiveUrl) {
+    // Re-queue not started segments from new variant.
+    uint64_t fromIndex = 0;
+    if(m_dataToLoad.empty()) {
+        fromIndex = m_segments.empty() ? 0 : m_segments.rbegin()->first + 1;
+    } else {
+        fromIndex = m_dataToLoad.front().index;
+        for (const auto& info : m_dataToLoad) {
+            fromIndex = std::min(fromIndex, info.index);
+        }
+    }
+    if(m_playlist->SwitchToVariant(variant, fromIndex, data, effectiveUrl)) {
+        m_dataToLoad.clear();
+        QueueAllSegmentsForLoading();
+    }
+}
+
 void PlaylistCache::QueueAllSegmentsForLoading() {
     
     SegmentInfo info;
@@ -114,12 +254,15 @@ MutableSegment* PlaylistCache::SegmentToFill()  {
     SegmentInfo info;
     bool found = false;
     // Skip all valid segment
+    // and segments stored on disk (will be loaded on demand)
+    TSegments::iterator existing;
     do{
         info = m_dataToLoad.front();
         m_dataToLoad.pop_front();
-        if(m_segments.count(info.index) > 0) {
-            const auto& seg = m_segments[info.index];
-            found = !seg->IsValid() && !seg->IsLoading();
+        existing = m_segments.find(info.index);
+        if(existing != m_segments.end()) {
+            const auto& seg = existing->second;
+            found = !seg->IsValid() && !seg->IsLoading() && !(m_diskStore && m_diskStore->Contains(info.index));
         } else {
             found = true;
         }
@@ -132,19 +275,23 @@ MutableSegment* PlaylistCache::SegmentToFill()  {
     MutableSegment* retVal = nullptr;
     // VOD contains static segments.
     // No new segment needed, just return old "empty" segment
-    if(m_playlist->IsVod() && m_segments.count(info.index) > 0) {
-        retVal = m_segments[info.index].get();
+    if(m_playlist->IsVod() && existing != m_segments.end()) {
+        retVal = existing->second.get();
     } else {
         // Calculate time and data offsets
         TimeOffset timeOffaset = m_playlistTimeOffset;
         // Do we have previous segment?
-        if(m_segments.count(info.index - 1) > 0){
+        // Segments are ordered by index, i.e. previous one precedes insertion point
+        auto next = m_segments.lower_bound(info.index);
+        if(next != m_segments.begin() && std::prev(next)->first == info.index - 1){
             // Override playlist initial offsetts with actual values
-            const auto& prevSegment = m_segments[info.index - 1];
+            const auto& prevSegment = std::prev(next)->second;
             timeOffaset = prevSegment->timeOffset + prevSegment->Duration();
         }
         retVal = new MutableSegment(info, timeOffaset);
         m_segments[info.index] = std::move(std::unique_ptr<MutableSegment>(retVal));
+        if(CanSeek())
+            m_segmentIndex.Add(info.index, timeOffaset, retVal->Duration());
     }
     LogDebug("PlaylistCache: set _isLOADING true for segment #%" PRIu64 ".", info.index);
     
@@ -153,9 +300,31 @@ MutableSegment* PlaylistCache::SegmentToFill()  {
 }
 
 void PlaylistCache::SegmentReady(MutableSegment* segment) {
+    if(segment->IsTrickPlay()) {
+        // I-frame does not tell anything about stream size and throughput
+        if(!m_isTrickPlay) {
+            // Trick-play is over while loading
+            segment->Free();
+            return;
+        }
+        segment->DataReady();
+        SegmentDataAdded(segment->Size());
+        LogDebug("PlaylistCache: I-frame of segment #%" PRIu64 " added. Cache size %" PRId64 " bytes", segment->info.index, m_cacheSizeInBytes);
+        return;
+    }
     segment->DataReady();
-    m_cacheSizeInBytes += segment->Size();
-    LogDebug("PlaylistCache: segment #%" PRIu64 " added. Cache size %d bytes", segment->info.index, m_cacheSizeInBytes);
+    if(segment->DownloadTime() > 0.0) {
+        m_downloadSpeed.StepDone(segment->Size(), segment->DownloadTime());
+        s_measuredBandwidth = (uint64_t)m_downloadSpeed.BytesPerSecond() * 8;
+        ++m_segmentsToAdapt;
+    }
+    SegmentDataAdded(segment->Size());
+    UpdateCacheSizeLimit(segment);
+    if(CanSeek()) {
+        ApplyProbedSizes();
+        m_segmentIndex.SetSize(segment->info.index, segment->Size());
+    }
+    LogDebug("PlaylistCache: segment #%" PRIu64 " added. Cache size %" PRId64 " bytes", segment->info.index, m_cacheSizeInBytes);
     // if we still have bitrate not calculate
     // (file stat on initializin may fail e.g. for zabava proxy)
     // do it now when we'll have at least 3 segments loaded
@@ -167,7 +336,7 @@ void PlaylistCache::SegmentReady(MutableSegment* segment) {
         size_t totalSize = 0;
         for (auto& it : m_segments) {
             auto& segment = it.second;
-            if(!segment->IsValid())
+            if(!segment->IsValid() || segment->IsTrickPlay())
                 continue;
             totalDuration += segment->Duration();
             totalSize += segment->Size();
@@ -175,14 +344,47 @@ void PlaylistCache::SegmentReady(MutableSegment* segment) {
         }
         if(validSegments > 2){
             float bitrate = totalSize / totalDuration;
-            m_totalLength = m_delegate->Duration() * bitrate;
             m_bitrate = bitrate;
-            LogError("PlaylistCache: bitrate is ready. Total length %" PRId64 "(%f B/sec).", m_totalLength, Bitrate());
+            m_segmentIndex.SetBitrate(bitrate);
+            LogError("PlaylistCache: bitrate is ready (%f B/sec).", Bitrate());
         }
 
     }
 }
 
+void PlaylistCache::UpdateCacheSizeLimit(const MutableSegment* segment) {
+    const float bitrate = segment->Bitrate();
+    if(bitrate <= 0.0)
+        return;
+    m_mediaBitrate = (0.0 == m_mediaBitrate) ? bitrate : m_mediaBitrate + (bitrate - m_mediaBitrate) * c_mediaBitrateWeight;
+    // Memory limit is checked for all streams (IsFull)
+    const int64_t limit = (int64_t)(m_secondsToCache * m_mediaBitrate);
+    if(limit != m_cacheSizeLimit) {
+        m_cacheSizeLimit = limit;
+        LogDebug("PlaylistCache: cache limit %" PRId64 " bytes (%d sec at %f B/sec).", m_cacheSizeLimit, m_secondsToCache, m_mediaBitrate);
+    }
+}
+
+bool PlaylistCache::IsFull() const {
+    if(s_totalCacheSize > s_memoryLimit)
+        return true;
+    if(0.0 == m_mediaBitrate)
+        return m_segmentsInCache >= c_maxSegmentsWithoutBitrate;
+    return m_cacheSizeInBytes > m_cacheSizeLimit;
+}
+
+void PlaylistCache::SegmentDataAdded(size_t size) {
+    m_cacheSizeInBytes += size;
+    s_totalCacheSize += size;
+    ++m_segmentsInCache;
+}
+
+void PlaylistCache::SegmentDataRemoved(size_t size) {
+    m_cacheSizeInBytes -= size;
+    s_totalCacheSize -= size;
+    --m_segmentsInCache;
+}
+
 void PlaylistCache::SegmentCanceled(MutableSegment* segment) {
     if(CanSeek()) {
         // Preserve stream length info for VOD segment
@@ -190,10 +392,10 @@ void PlaylistCache::SegmentCanceled(MutableSegment* segment) {
     } else {
         m_segments.erase(segment->info.index);
     }
-    LogDebug("PlaylistCache: segment #%" PRIu64 " canceled. Cache size %d bytes", segment->info.index, m_cacheSizeInBytes);
+    LogDebug("PlaylistCache: segment #%" PRIu64 " canceled. Cache size %" PRId64 " bytes", segment->info.index, m_cacheSizeInBytes);
 }
 
-Segment* PlaylistCache::NextSegment(SegmentStatus& status) {
+Segment* PlaylistCache::NextSegment(SegmentStatus& status, uint64_t& segmentIndex) {
     
     if(m_segments.size() == 0) {
         status = k_SegmentStatus_CacheEmpty;
@@ -204,6 +406,13 @@ Segment* PlaylistCache::NextSegment(SegmentStatus& status) {
     
     if(m_segments.count(m_currentSegmentIndex) > 0) {
         auto& seg = m_segments[m_currentSegmentIndex];
+        if(!seg->IsValid() && !seg->IsLoading() && m_diskStore && m_diskStore->Contains(seg->info.index)) {
+            // Disk is read by loader, i.e. cache is not locked for file I/O
+            seg->_isLoading = true;
+            seg->_isRestoring = true;
+            m_segmentsToRestore.push_back(seg->info.index);
+            LogDebug("PlaylistCache: segment #%" PRIu64 " found on disk, restoring...", seg->info.index);
+        }
         // Segment found. Check data availability
         if(seg->IsValid()) {
             size_t posInSegment = m_currentSegmentPositionFactor * seg->Size();
@@ -211,6 +420,13 @@ Segment* PlaylistCache::NextSegment(SegmentStatus& status) {
             retVal = seg.get();
             status = k_SegmentStatus_Ok;
             LogDebug("PlaylistCache: READING from segment #%" PRIu64 ". Position in segment %d.", seg->info.index, posInSegment);
+        } else if(seg->IsLoading() && !seg->_isRestoring && 0.0 == m_currentSegmentPositionFactor) {
+            // Play while downloading. Reader consumes data up to write frontier.
+            // Position inside of segment (after seek) requires complete segment.
+            seg->Seek(0);
+            retVal = seg.get();
+            status = k_SegmentStatus_Streaming;
+            LogDebug("PlaylistCache: STREAMING from loading segment #%" PRIu64 ".", seg->info.index);
         } else {
             // Validate that current segmenet is loading
             if(seg->IsLoading()){
@@ -253,12 +469,32 @@ Segment* PlaylistCache::NextSegment(SegmentStatus& status) {
     
     // Forward to nex segment only if we found current
     if(nullptr != retVal) {
-        ++m_currentSegmentIndex;
+        segmentIndex = m_currentSegmentIndex++;
         m_currentSegmentPositionFactor = 0.0;
     }
     return retVal;
 }
 
+TSegmentData PlaylistCache::TakeNextSegment() {
+    if(CanSeek())
+        return nullptr;
+    auto it = m_segments.find(m_currentSegmentIndex);
+    // Position inside of segment requires NextSegment()
+    if(it == m_segments.end() || !it->second->IsValid() || 0.0 != m_currentSegmentPositionFactor)
+        return nullptr;
+    SegmentDataRemoved(it->second->Size());
+    TSegmentData data = it->second->Detach();
+    LogDebug("PlaylistCache: TAKING segment #%" PRIu64 " (%d bytes). Cache size %" PRId64 " bytes", it->first, data->Size(), m_cacheSizeInBytes);
+    m_segments.erase(it);
+    ++m_currentSegmentIndex;
+    return data;
+}
+
+MutableSegment* PlaylistCache::FindSegment(uint64_t index) const {
+    auto it = m_segments.find(index);
+    return it == m_segments.end() ? nullptr : it->second.get();
+}
+
 bool PlaylistCache::HasSpaceForNewSegment(const uint64_t& waitingSegment) {
     // Free older segments when cache is full
     // or we are on live stream (no caching requered)
@@ -277,7 +513,7 @@ bool PlaylistCache::HasSpaceForNewSegment(const uint64_t& waitingSegment) {
             ++runner;
         }
         // Search for oldest segment
-        while(runner->first < currentSegment) {
+        while(runner != end && runner->first < currentSegment) {
             if(runner->second->IsValid()) {
                 idx = runner->first;
                 break;
@@ -316,20 +552,20 @@ bool PlaylistCache::HasSpaceForNewSegment(const uint64_t& waitingSegment) {
         }
         // Remove or free memory of segment
         if( idx != -1) {
-            m_cacheSizeInBytes -= m_segments.at(idx)->Size();
+            SegmentDataRemoved(m_segments.at(idx)->Size());
             if(CanSeek()) {
                 // Preserve stream length info for VOD segment
-                m_segments.at(idx)->Free();
+                EvictSegment(idx);
             } else {
                 m_segments.erase(idx);
             }
-            LogDebug("PlaylistCache: segment #%" PRIu64 " removed. Cache size %d bytes", idx, m_cacheSizeInBytes);
+            LogDebug("PlaylistCache: segment #%" PRIu64 " removed. Cache size %" PRId64 " bytes", idx, m_cacheSizeInBytes);
             hasSpace = !IsFull();
         } else if(waitingSegment == readingSegment){
             // We must accept current reading segment disregarding to cache size!
             hasSpace = true;
         } else if(CanSeek()) {
-            LogDebug("PlaylistCache: cache is full but no segments to free. Current idx #%" PRIu64 " Size %d bytes", readingSegment, m_cacheSizeInBytes);
+            LogDebug("PlaylistCache: cache is full but no segments to free. Current idx #%" PRIu64 " Size %" PRId64 " bytes", readingSegment, m_cacheSizeInBytes);
             break; // no room
         } else {
             LogDebug("PlaylistCache: cache is full but no segments to free. Current idx #%" PRIu64 " %d segments in cache.", readingSegment, m_segments.size());
@@ -339,6 +575,78 @@ bool PlaylistCache::HasSpaceForNewSegment(const uint64_t& waitingSegment) {
     return hasSpace;
 }
 
+void PlaylistCache::EvictSegment(uint64_t index) {
+    auto& seg = m_segments.at(index);
+    if(m_diskStore && seg->IsValid() && !seg->IsTrickPlay()) {
+        // Disk store takes ownership of data blocks
+        m_diskStore->Store(index, seg->_blocks, seg->Size());
+        seg->_blocks.clear();
+    }
+    seg->Free();
+}
+
+MutableSegment* PlaylistCache::SegmentToRestore() {
+    while(!m_segmentsToRestore.empty()) {
+        MutableSegment* segment = FindSegment(m_segmentsToRestore.front());
+        m_segmentsToRestore.pop_front();
+        if(nullptr != segment && segment->_isRestoring)
+            return segment;
+    }
+    return nullptr;
+}
+
+bool PlaylistCache::RestoreFromDisk(MutableSegment* segment) const {
+    return m_diskStore && m_diskStore->Load(segment->info.index, *segment);
+}
+
+void PlaylistCache::SegmentRestored(MutableSegment* segment, bool isRestored) {
+    if(isRestored) {
+        // Not a network download
+        segment->SetDownloadTime(0.0);
+        SegmentReady(segment);
+        LogDebug("PlaylistCache: segment #%" PRIu64 " restored from disk.", segment->info.index);
+    } else {
+        // Reader will queue it for download
+        segment->Free();
+        LogDebug("PlaylistCache: segment #%" PRIu64 " is not restored from disk.", segment->info.index);
+    }
+}
+
+int64_t PlaylistCache::Length() {
+    if(!CanSeek())
+        return -1;
+    ApplyProbedSizes();
+    // Same offsets as used for seek, i.e. real sizes of loaded segments
+    int64_t length = m_segmentIndex.TotalLength();
+    if(length < 0)
+        return -1;
+    // Archive segments not listed yet
+    if(nullptr != m_delegate && m_bitrate > 0) {
+        const TimeOffset notListed = m_delegate->Duration() - m_segmentIndex.EndTime();
+        if(notListed > 0)
+            length += notListed * m_bitrate;
+    }
+    return length;
+}
+
+TimeOffset PlaylistCache::TimeOffsetFromProsition(int64_t position) const {
+    TimeOffset timeOffset = 0.0;
+    if(m_segmentIndex.TimeOffsetForPosition(position, timeOffset))
+        return timeOffset;
+    float bitrate = Bitrate();
+    return (bitrate == 0.0) ? 0.0 : position/bitrate;
+}
+
+void PlaylistCache::ApplyProbedSizes() {
+    if(!m_sizeProber)
+        return;
+    SegmentSizeProber::TSegmentSizes sizes;
+    m_sizeProber->TakeSizes(sizes);
+    for (const auto& s : sizes) {
+        m_segmentIndex.SetProbedSize(s.first, s.second);
+    }
+}
+
 bool PlaylistCache::WaitForBitrate(unsigned int timeoutInSec) const
 {
     if(!CanSeek())
@@ -360,7 +668,9 @@ bool PlaylistCache::PrepareSegmentForPosition(int64_t position, uint64_t* nextSe
     if(!CanSeek())
         return false;
     
-    if(!(WaitForBitrate()))
+    ApplyProbedSizes();
+    // Exact data offsets don't need bitrate
+    if(!m_segmentIndex.HasAllSizes() && !(WaitForBitrate()))
         return false;
     
     TimeOffset timePosition = TimeOffsetFromProsition(position);
@@ -373,19 +683,21 @@ bool PlaylistCache::PrepareSegmentForPosition(int64_t position, uint64_t* nextSe
     // Plailist may contain required segments already.
     // We'll search for segment in loding queue and in loaded segments list.
     // If found, just move loading iterator to position
-    for (const auto& pSeg : m_segments) {
-        segmentTime = pSeg.second->timeOffset;
-        segmentDuration = pSeg.second->Duration();
-        if( segmentTime <= timePosition && timePosition < segmentTime + segmentDuration) {
-            *nextSegmentIndex = m_currentSegmentIndex = pSeg.first;
-            LogDebug("PlaylistCache: trying to set next index of playlist (m_segments)...");
-            if((found = m_playlist->SetNextSegmentIndex(m_currentSegmentIndex))) {
-                QueueAllSegmentsForLoading();
-                // Calculate position inside segment
-                // as rational part of time offset
-                m_currentSegmentPositionFactor = (timePosition - segmentTime) / segmentDuration;
-                break;
-            }
+    // Data offsets of known segments account real size of loaded ones,
+    // time offset (i.e. bitrate estimation) is used beyond of them.
+    uint64_t segmentIndex = 0;
+    float positionFactor = 0.0;
+    if(m_segmentIndex.FindByPosition(position, segmentIndex, positionFactor)
+       || m_segmentIndex.FindByTime(timePosition, segmentIndex, positionFactor)) {
+        const auto& seg = m_segments.at(segmentIndex);
+        segmentTime = seg->timeOffset;
+        segmentDuration = seg->Duration();
+        *nextSegmentIndex = m_currentSegmentIndex = segmentIndex;
+        LogDebug("PlaylistCache: trying to set next index of playlist (m_segments)...");
+        if((found = m_playlist->SetNextSegmentIndex(m_currentSegmentIndex))) {
+            QueueAllSegmentsForLoading();
+            // Position inside segment
+            m_currentSegmentPositionFactor = positionFactor;
         }
     }
     
@@ -429,9 +741,16 @@ bool PlaylistCache::PrepareSegmentForPosition(int64_t position, uint64_t* nextSe
                 LogDebug("PlaylistCache: re-create playlist. Index offset %" PRIu64 ". Time offset %f", indexOffset, timePosition);
                 // First try to create a new list
                 // If it'll faile the old list should be valid
-                auto newPLaylist = new Playlist(url, indexOffset);
+                // Keep variant of current playlist, since bitrate is known already
+                const auto& variants = m_playlist->Variants();
+                const uint64_t bandwidth = variants.empty() ? 0 : variants[m_playlist->CurrentVariant()].bandwidth;
+                auto newPLaylist = new Playlist(url, indexOffset, bandwidth);
                 delete m_playlist;
                 m_playlist = newPLaylist;
+                // I-frames belong to replaced playlist
+                m_iframePlaylist.reset();
+                if(m_isTrickPlay && !LoadIFramePlaylist())
+                    m_isTrickPlay = false;
                 if(!ReloadPlaylist())
                     throw PlaylistCacheException("ReloadPlaylist() failed.");
             } catch (std::exception& ex) {
@@ -452,6 +771,75 @@ bool PlaylistCache::PrepareSegmentForPosition(int64_t position, uint64_t* nextSe
     return true;
 }
 
+bool PlaylistCache::LoadIFramePlaylist() {
+    const auto& variants = m_playlist->IFrameVariants();
+    if(variants.empty()) {
+        LogDebug("PlaylistCache: stream has no I-frame rendition.");
+        return false;
+    }
+    // Lowest rendition, trick-play shows few frames per second anyway
+    try {
+        std::unique_ptr<Playlist> playlist(new Playlist(variants.front().url));
+        if(!playlist->IsIFramesOnly()) {
+            LogError("PlaylistCache: I-frame rendition is not an I-frames only playlist.");
+            return false;
+        }
+        m_iframePlaylist = std::move(playlist);
+    } catch (std::exception& ex) {
+        LogError("PlaylistCache: failed to load I-frame playlist. Error: %s", ex.what());
+        return false;
+    }
+    LogDebug("PlaylistCache: I-frame playlist loaded (%" PRIu64 " bps).", variants.front().bandwidth);
+    return true;
+}
+
+bool PlaylistCache::SetTrickPlay(bool enable) {
+    if(enable == m_isTrickPlay)
+        return true;
+    if(enable) {
+        // Playback is not driven by seeks on live stream
+        if(!CanSeek())
+            return false;
+        if(!m_iframePlaylist && !LoadIFramePlaylist())
+            return false;
+        m_isTrickPlay = true;
+        LogNotice("PlaylistCache: trick-play started.");
+        return true;
+    }
+    m_isTrickPlay = false;
+    // Drop I-frames, segments should be loaded in full for normal playback.
+    // Segment which is read now is preserved (current segment index points after it).
+    const uint64_t readingSegment = m_currentSegmentIndex > 0 ? m_currentSegmentIndex - 1 : 0;
+    for (auto& it : m_segments) {
+        auto& seg = it.second;
+        if(!seg->IsTrickPlay() || seg->IsLoading() || it.first == readingSegment)
+            continue;
+        if(seg->IsValid())
+            SegmentDataRemoved(seg->Size());
+        seg->Free();
+    }
+    m_dataToLoad.clear();
+    if(m_playlist->SetNextSegmentIndex(m_currentSegmentIndex))
+        QueueAllSegmentsForLoading();
+    LogNotice("PlaylistCache: trick-play finished. Cache size %" PRId64 " bytes", m_cacheSizeInBytes);
+    return true;
+}
+
+bool PlaylistCache::TrickPlaySource(MutableSegment* segment, SegmentInfo& iframe) {
+    if(!m_isTrickPlay || !m_iframePlaylist)
+        return false;
+    // Both playlists start at the same moment
+    const TimeOffset timeInPlaylist = segment->info.startTime - m_playlist->GetTimeOffset();
+    if(!m_iframePlaylist->SegmentAtTime(timeInPlaylist, iframe))
+        return false;
+    // CBC decryption can't start in the middle of resource,
+    // such I-frame is loaded with whole segment.
+    if(!iframe.keyUrl.empty())
+        return false;
+    segment->_isTrickPlay = true;
+    return true;
+}
+
 bool PlaylistCache::HasSegmentsToFill() const {
     return !m_dataToLoad.empty();
 }
@@ -464,58 +852,115 @@ bool PlaylistCache::HasSegmentsToFill() const {
 
 Segment::Segment(float duration)
 : _duration(duration)
-, _data(nullptr)
+, _size(0)
+, _position(0)
 {
-    Init();
 }
 
-//    const uint8_t* Segment::Pop(size_t requesred, size_t*  actual)
-//    {
-//        if(_begin == NULL)
-//            _begin = &_data[0];
-//
-//        size_t available = _size - (_begin - &_data[0]);
-//        *actual = std::min(requesred, available);
-//        const uint8_t* retVal = _begin;
-//        _begin += *actual;
-//        return retVal;
-//    }
-
 void Segment::Init() {
-    if(_data != nullptr)
-        free( _data);
-    _data = nullptr;
+    P8PLATFORM::CLockObject lock(_blocksAccess);
+    for (auto block : _blocks) {
+        SegmentBlockPool::Release(block);
+    }
+    _blocks.clear();
     _size = 0;
-    _begin = nullptr;
+    _position = 0;
 }
 
 size_t Segment::Read(uint8_t* buffer, size_t size)
 {
-    if(nullptr == _data)
-        return 0;
-    
-    if(_begin == nullptr)
-        _begin = &_data[0];
-    size_t actual = std::min(size, BytesReady());
-    if(actual < 0)
-        LogDebug("Segment::Read: error size %d.  Bytes ready: %d", actual, BytesReady());
-    memcpy(buffer, _begin, actual);
-    _begin += actual;
+    const size_t actual = std::min(size, BytesReady());
+    size_t copied = 0;
+    // Copy data across block boundaries
+    while(copied < actual) {
+        const size_t blockIdx = _position / SegmentBlockPool::BLOCK_SIZE;
+        const size_t posInBlock = _position % SegmentBlockPool::BLOCK_SIZE;
+        const size_t chunk = std::min(actual - copied, SegmentBlockPool::BLOCK_SIZE - posInBlock);
+        uint8_t* block = nullptr;
+        {
+            // Writer may append blocks to loading segment
+            P8PLATFORM::CLockObject lock(_blocksAccess);
+            block = _blocks[blockIdx];
+        }
+        memcpy(buffer + copied, block + posInBlock, chunk);
+        copied += chunk;
+        _position += chunk;
+    }
     return actual;
 }
 
 
 Segment::~Segment()
 {
-    if(_data != nullptr)
-        free( _data);
-    _data = nullptr;
+    Init();
+}
+
+TSegmentData MutableSegment::Detach() {
+    P8PLATFORM::CLockObject lock(_blocksAccess);
+    TSegmentData data(new SegmentData(std::move(_blocks), _size));
+    _blocks.clear();
+    _size = 0;
+    _position = 0;
+    return data;
 }
 
 void MutableSegment::Free(){
     Init();
     _isValid = false;
     _isLoading = false;
+    _isTrickPlay = false;
+    _isRestoring = false;
+}
+
+size_t MutableSegment::LockForWrite(uint8_t** pBuf)
+{
+    const size_t blockIdx = _size / SegmentBlockPool::BLOCK_SIZE;
+    const size_t posInBlock = _size % SegmentBlockPool::BLOCK_SIZE;
+    P8PLATFORM::CLockObject lock(_blocksAccess);
+    // Block at the end of published data may be reserved already
+    if(blockIdx == _blocks.size()) {
+        try {
+            _blocks.push_back(SegmentBlockPool::Acquire());
+        } catch (std::exception&) {
+            throw PlaylistCacheException("Failed to allocate segment block.");
+        }
+    }
+    *pBuf = _blocks[blockIdx] + posInBlock;
+    return SegmentBlockPool::BLOCK_SIZE - posInBlock;
+}
+
+void MutableSegment::UnlockAfterWriten(size_t writtenBytes)
+{
+    size_t capacity;
+    {
+        P8PLATFORM::CLockObject lock(_blocksAccess);
+        capacity = _blocks.size() * SegmentBlockPool::BLOCK_SIZE;
+    }
+    // Publishes written data for concurrent reader
+    _size += std::min(writtenBytes, capacity - _size);
+}
+
+void MutableSegment::Reserve(size_t size)
+{
+    P8PLATFORM::CLockObject lock(_blocksAccess);
+    try {
+        while(_blocks.size() * SegmentBlockPool::BLOCK_SIZE < size) {
+            _blocks.push_back(SegmentBlockPool::Acquire());
+        }
+    } catch (std::exception&) {
+        throw PlaylistCacheException("Failed to allocate segment block.");
+    }
+}
+
+size_t MutableSegment::LockForWrite(size_t offset, uint8_t** pBuf)
+{
+    P8PLATFORM::CLockObject lock(_blocksAccess);
+    const size_t blockIdx = offset / SegmentBlockPool::BLOCK_SIZE;
+    if(blockIdx >= _blocks.size())
+        throw PlaylistCacheException("Segment write offset exceeds reserved storage.");
+    const size_t posInBlock = offset % SegmentBlockPool::BLOCK_SIZE;
+    *pBuf = _blocks[blockIdx] + posInBlock;
+    return SegmentBlockPool::BLOCK_SIZE - posInBlock;
 }
 
 void MutableSegment::Push(const uint8_t* buffer, size_t size)
@@ -523,27 +968,22 @@ void MutableSegment::Push(const uint8_t* buffer, size_t size)
     if(nullptr == buffer || 0 == size)
         return;
     
-    void * ptr = realloc(_data, _size + size);
-    if(NULL == ptr)
-        throw PlaylistCacheException("Failed to re-allocate segment.");
-    _data = (uint8_t*) ptr;
-    memcpy(&_data[_size], buffer, size);
-    _size += size;
-    //    LogDebug(">>> Size: %d", _size);
-    //        if(_size > _length) {
-    //            _length = _size;
-    //        }
+    while(size > 0) {
+        uint8_t* dest = nullptr;
+        const size_t chunk = std::min(size, LockForWrite(&dest));
+        memcpy(dest, buffer, chunk);
+        UnlockAfterWriten(chunk);
+        buffer += chunk;
+        size -= chunk;
+    }
 }
 
 size_t MutableSegment::Seek(size_t position)
 {
-    if(nullptr != _data) {
-        _begin = &_data[0] + std::min(position, _size);
-    }
+    _position = std::min(position, Size());
     return Position();
 }
 
 
 
 }
-
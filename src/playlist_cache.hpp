@@ -26,11 +26,20 @@
 #include <map>
 #include <list>
 #include <deque>
+#include <vector>
 #include <string>
 #include <memory>
+#include <atomic>
 #include <exception>
 #include "Playlist.hpp"
 #include "plist_buffer_delegate.h"
+#include "p8-platform/threads/mutex.h"
+#include "Speedometer.h"
+#include "segment_disk_store.hpp"
+#include "segment_index.hpp"
+#include "segment_size_prober.hpp"
+#include "ts_packet_filter.hpp"
+#include "segment_data.hpp"
 
 namespace Buffers {
 
@@ -39,8 +48,8 @@ namespace Buffers {
     public:
         //            const uint8_t* Pop(size_t requesred, size_t*  actual);
         size_t Read(uint8_t* buffer, size_t size);
-        size_t Position() const  {return  (nullptr == _data) ? 0 : _begin - &_data[0];}
-        size_t BytesReady() const {return (nullptr == _data) ? 0 : Size() - Position();}
+        size_t Position() const  {return  _position;}
+        size_t BytesReady() const {const size_t size = Size(); return size > _position ? size - _position : 0;}
         float Bitrate() const { return  Duration() == 0.0 ? 0.0 : Size()/Duration();}
         float Duration() const {return _duration;}
         size_t Size() const {return _size;}
@@ -49,9 +58,13 @@ namespace Buffers {
         Segment(float duration);
         void Init();
         virtual ~Segment();
-        uint8_t* _data;
-        size_t _size;
-        const uint8_t* _begin;
+        // Data is stored in fixed size blocks of SegmentBlockPool
+        std::vector<uint8_t*> _blocks;
+        // Loading segment may be read concurrently with writing:
+        // _size is the write frontier, blocks list is guarded.
+        std::atomic<size_t> _size;
+        mutable P8PLATFORM::CMutex _blocksAccess;
+        size_t _position;
         const float _duration;
     };
     
@@ -62,12 +75,35 @@ namespace Buffers {
         const TimeOffset timeOffset;
         const SegmentInfo info;
         void Push(const uint8_t* buffer, size_t size);
+        // Direct write to segment's storage.
+        // Returns size of available buffer (never 0)
+        size_t LockForWrite(uint8_t** pBuf);
+        void UnlockAfterWriten(size_t writtenBytes);
+        // Ranged (concurrent) write.
+        // Storage for whole segment should be reserved in advance,
+        // then data may be written at any offset from several threads.
+        // UnlockAfterWriten(size) publishes contiguous data at the beginning,
+        // sequential write (LockForWrite(pBuf)) continues in reserved storage.
+        void Reserve(size_t size);
+        size_t LockForWrite(size_t offset, uint8_t** pBuf);
+        // Drops all data, e.g. on failed ranged download
+        void Discard() {Init();}
         bool IsValid() const {return _isValid;}
         bool IsLoading() const {return _isLoading;}
+        // Network time spent on segment's data (seconds)
+        float DownloadTime() const {return _downloadTime;}
+        void SetDownloadTime(float seconds) {_downloadTime = seconds;}
+        // Transport stream counters of loaded data
+        const TsStreamHealth& StreamHealth() const {return _streamHealth;}
+        void SetStreamHealth(const TsStreamHealth& health) {_streamHealth = health;}
+        // Segment holds single I-frame of its time range (trick-play),
+        // it is not valid for playback at normal speed.
+        bool IsTrickPlay() const {return _isTrickPlay;}
+        // NOTE: read position is preserved, segment may be read while loading
         void DataReady() {
-            Seek(0);
             _isValid = true;
             _isLoading = false;
+            _isRestoring = false;
         }
         // Virtual segment size in bytes
         // may be not equal to actual _size
@@ -84,14 +120,24 @@ namespace Buffers {
         , _length(0)
         , _isValid (false)
         , _isLoading(false)
+        , _downloadTime(0.0)
+        , _isTrickPlay(false)
+        , _isRestoring(false)
         {}
 
         size_t Seek(size_t position);
         void Free();
+        // Moves loaded data out of segment (without copy)
+        TSegmentData Detach();
 
         size_t _length;
         bool _isValid;
         bool _isLoading;
+        float _downloadTime;
+        bool _isTrickPlay;
+        // Loading from disk store (can't be streamed)
+        bool _isRestoring;
+        TsStreamHealth _streamHealth;
     };
     
 
@@ -102,23 +148,67 @@ namespace Buffers {
             k_SegmentStatus_Ok = 0,
             k_SegmentStatus_CacheEmpty,
             k_SegmentStatus_Loading,
-            k_SegmentStatus_EOF
+            k_SegmentStatus_EOF,
+            // Segment is returned while loading, data available up to write frontier
+            k_SegmentStatus_Streaming
         };
-        PlaylistCache(const std::string &playlistUrl, PlaylistBufferDelegate delegate, bool seekForVod);
+        // liveStartSegments - live stream starts this amount of segments from the end (0 - from the beginning)
+        PlaylistCache(const std::string &playlistUrl, PlaylistBufferDelegate delegate, bool seekForVod, unsigned int liveStartSegments = 0);
         ~PlaylistCache();
         MutableSegment* SegmentToFill();
         void SegmentReady(MutableSegment* segment);
         void SegmentCanceled(MutableSegment* segment);
-        Segment* NextSegment(SegmentStatus& status);
+        // segmentIndex is index of returned segment
+        Segment* NextSegment(SegmentStatus& status, uint64_t& segmentIndex);
+        // Live stream only. Removes ready segment expected by NextSegment() from cache
+        // and returns its data (nullptr when segment is not ready).
+        TSegmentData TakeNextSegment();
+        // Index of segment expected by NextSegment()
+        uint64_t CurrentSegmentIndex() const {return m_currentSegmentIndex;}
+        // nullptr when segment is not in cache
+        MutableSegment* FindSegment(uint64_t index) const;
         bool PrepareSegmentForPosition(int64_t position, uint64_t* nextSegmentIndex);
         bool HasSegmentsToFill() const;
 //        bool IsEof() const;
-        bool IsFull() const {return CanSeek() ? m_cacheSizeInBytes > m_cacheSizeLimit : m_segments.size() > 5; }
-        int64_t Length() const { return CanSeek() ? (WaitForBitrate() ? m_totalLength : -1) : -1; }
+        // Cache holds SecondsToCache() of media (bytes at measured bitrate)
+        // but not more than global memory limit.
+        // Memory limit of all streams, seconds to cache (or few segments until bitrate is known)
+        bool IsFull() const;
+        // Data length of seekable stream (-1 when unknown yet).
+        // Derived from segment index, i.e. consistent with seek positions.
+        int64_t Length();
         bool ReloadPlaylist();
+        // ReloadPlaylist() in two steps. Loading does not change cache
+        // and may run without lock when playlist is not replaced concurrently (live stream).
+        bool LoadPlaylistUpdate(std::string& data, std::function<bool()> isCanceled) const {return m_playlist->LoadUpdate(data, isCanceled);}
+        bool ApplyPlaylistUpdate(const std::string& data);
+        // Parts of partial segment (low-latency HLS)
+        PartStatus SegmentPart(uint64_t index, size_t part, PartInfo& info) const {return m_playlist->Part(index, part, info);}
+        // Delay before next reload of live playlist, 0 for VOD
+        uint32_t PlaylistRefreshIntervalMs() const;
+        // Switching of live stream variant according to measured throughput.
+        // Like playlist update, variant is loaded without lock:
+        // VariantToAdapt() and SwitchToVariant() change cache, LoadVariant() does not.
+        bool VariantToAdapt(size_t& variant);
+        bool LoadVariant(size_t variant, std::string& data, std::string& effectiveUrl, std::function<bool()> isCanceled) const {return m_playlist->LoadVariant(variant, data, effectiveUrl, isCanceled);}
+        void SwitchToVariant(size_t variant, const std::string& data, const std::string& effectiveUrl);
+        // Trick-play (fast forward/rewind) loads I-frames of segments only (EXT-X-I-FRAME-STREAM-INF).
+        // False when stream can't be played this way.
+        bool SetTrickPlay(bool enable);
+        bool IsTrickPlay() const {return m_isTrickPlay;}
+        // Source of segment in trick-play mode, i.e. I-frame displayed at the beginning of segment.
+        // Segment is marked as trick-play one.
+        bool TrickPlaySource(MutableSegment* segment, SegmentInfo& iframe);
+        // Segment evicted to disk store and requested by reader (nullptr when none).
+        // Loader reads it by RestoreFromDisk() without lock, then reports by SegmentRestored().
+        MutableSegment* SegmentToRestore();
+        bool RestoreFromDisk(MutableSegment* segment) const;
+        void SegmentRestored(MutableSegment* segment, bool isRestored);
         bool CanSeek() const {return nullptr != m_delegate || (m_seekForVod && m_playlist->IsVod()); }
         bool HasSpaceForNewSegment(const uint64_t& waitingSegment);
         bool WaitForBitrate(unsigned int timeoutInSec = 10)  const;
+        // Memory limit of all streams' caches
+        static void SetMemoryLimitInMb(int sizeInMb);
 
     private:
        
@@ -126,25 +216,54 @@ namespace Buffers {
         typedef std::map<uint64_t, std::unique_ptr<MutableSegment>>  TSegments;
         typedef std::deque<SegmentInfo> TSegmentInfos;
         
-        TimeOffset TimeOffsetFromProsition(int64_t position) const {
-            float bitrate = Bitrate();
-            return (bitrate == 0.0) ? 0.0 : position/bitrate;
-        }
+        TimeOffset TimeOffsetFromProsition(int64_t position) const;
         float Bitrate() const { return  (WaitForBitrate() ? m_bitrate : 0.0);}
         void QueueAllSegmentsForLoading();
+        // Frees memory of segment, keeping its data in disk store (when enabled)
+        void EvictSegment(uint64_t index);
+        // Moves sizes from prober to segment index
+        void ApplyProbedSizes();
+        bool LoadIFramePlaylist();
+        // Converts seconds to cache into bytes at measured bitrate of segments
+        void UpdateCacheSizeLimit(const MutableSegment* segment);
+        // Accounts memory of valid segment for this cache and all streams
+        void SegmentDataAdded(size_t size);
+        void SegmentDataRemoved(size_t size);
         
         Playlist* m_playlist;
+        // I-frame rendition of current playlist, loaded on first trick-play
+        std::unique_ptr<Playlist> m_iframePlaylist;
+        bool m_isTrickPlay;
         PlaylistBufferDelegate m_delegate;
         TimeOffset m_playlistTimeOffset;
         TSegmentInfos m_dataToLoad;
         TSegments m_segments;
-        int64_t m_totalLength;
+        // Time/data offsets of seekable stream segments
+        SegmentIndex m_segmentIndex;
+        // Exact VOD segment sizes (HEAD requests)
+        std::unique_ptr<SegmentSizeProber> m_sizeProber;
         uint64_t m_currentSegmentIndex;
         float m_currentSegmentPositionFactor;
         float m_bitrate;
-        int m_cacheSizeLimit;
-        int m_cacheSizeInBytes;
+        int64_t m_cacheSizeLimit;
+        int m_secondsToCache;
+        // Average bitrate of loaded segments (bytes per second)
+        float m_mediaBitrate;
+        int64_t m_cacheSizeInBytes;
+        // Valid segments (and I-frames) in memory
+        unsigned int m_segmentsInCache;
         const bool m_seekForVod;
+        std::unique_ptr<SegmentDiskStore> m_diskStore;
+        // Indices of segments requested from disk store
+        std::deque<uint64_t> m_segmentsToRestore;
+        Helpers::Speedometer m_downloadSpeed;
+        unsigned int m_segmentsToAdapt;
+        unsigned int m_upSwitchVotes;
+        // Last measured throughput (bits per second), shared between streams
+        static std::atomic<uint64_t> s_measuredBandwidth;
+        static std::atomic<int64_t> s_memoryLimit;
+        // Memory of all caches (bytes)
+        static std::atomic<int64_t> s_totalCacheSize;
 
     };
     
@@ -0,0 +1,111 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <algorithm>
+#include "playlist_refresh_scheduler.hpp"
+#include "globals.hpp"
+
+namespace Buffers {
+    using namespace P8PLATFORM;
+    using namespace Globals;
+
+    PlaylistRefreshScheduler& PlaylistRefreshScheduler::Instance()
+    {
+        static PlaylistRefreshScheduler scheduler;
+        return scheduler;
+    }
+
+    PlaylistRefreshScheduler::~PlaylistRefreshScheduler()
+    {
+        m_tasksChanged.Signal();
+        StopThread();
+    }
+
+    void PlaylistRefreshScheduler::Schedule(const void* client, uint32_t delayMs, TRefreshAction action)
+    {
+        auto& scheduler = Instance();
+        CLockObject threadLock(scheduler.m_threadAccess);
+        {
+            CLockObject lock(scheduler.m_syncAccess);
+            const auto dueTime = std::chrono::steady_clock::now() + std::chrono::milliseconds(delayMs);
+            auto it = scheduler.m_tasks.find(client);
+            if(it != scheduler.m_tasks.end())
+                it->second = Task(dueTime, action);
+            else
+                scheduler.m_tasks.emplace(client, Task(dueTime, action));
+        }
+        if(!scheduler.IsRunning()) {
+            LogDebug("PlaylistRefreshScheduler: starting timer thread.");
+            scheduler.CreateThread();
+        }
+        scheduler.m_tasksChanged.Signal();
+    }
+
+    void PlaylistRefreshScheduler::Cancel(const void* client)
+    {
+        auto& scheduler = Instance();
+        CLockObject threadLock(scheduler.m_threadAccess);
+        bool isIdle = false;
+        {
+            // Waits for action in progress
+            CLockObject lock(scheduler.m_syncAccess);
+            scheduler.m_tasks.erase(client);
+            isIdle = scheduler.m_tasks.empty();
+        }
+        // No reason to keep thread without streams
+        if(isIdle && scheduler.IsRunning()) {
+            LogDebug("PlaylistRefreshScheduler: stopping timer thread.");
+            scheduler.CThread::StopThread(-1);
+            scheduler.m_tasksChanged.Signal();
+            scheduler.StopThread();
+        }
+    }
+
+    void* PlaylistRefreshScheduler::Process()
+    {
+        while(!IsStopped()) {
+            // Time to nearest task, 0 - no tasks (wait for new one)
+            uint32_t waitMs = 0;
+            {
+                CLockObject lock(m_syncAccess);
+                const auto now = std::chrono::steady_clock::now();
+                auto it = m_tasks.begin();
+                while(it != m_tasks.end()) {
+                    if(it->second.dueTime <= now) {
+                        it->second.action();
+                        it = m_tasks.erase(it);
+                        continue;
+                    }
+                    const uint32_t left = (uint32_t)std::max<int64_t>(1, std::chrono::duration_cast<std::chrono::milliseconds>(it->second.dueTime - now).count());
+                    waitMs = (0 == waitMs) ? left : std::min(waitMs, left);
+                    ++it;
+                }
+            }
+            if(0 == waitMs)
+                m_tasksChanged.Wait();
+            else
+                m_tasksChanged.Wait(waitMs);
+        }
+        return nullptr;
+    }
+}
@@ -0,0 +1,73 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef __playlist_refresh_scheduler_hpp__
+#define __playlist_refresh_scheduler_hpp__
+
+#include <stdint.h>
+#include <map>
+#include <chrono>
+#include <functional>
+#include "p8-platform/threads/threads.h"
+#include "p8-platform/threads/mutex.h"
+
+namespace Buffers {
+
+    // Single timer thread for live playlist refreshes of all running PlaylistBuffers.
+    // Refresh action is expected to be short (e.g. wake up of client's loader thread),
+    // playlist itself is reloaded by the client.
+    class PlaylistRefreshScheduler : public P8PLATFORM::CThread
+    {
+    public:
+        typedef std::function<void()> TRefreshAction;
+
+        // (Re)schedules one-shot refresh action of client in delayMs.
+        static void Schedule(const void* client, uint32_t delayMs, TRefreshAction action);
+        // Drops scheduled action. Action in progress is finished before return.
+        static void Cancel(const void* client);
+
+        ~PlaylistRefreshScheduler();
+
+    private:
+        struct Task {
+            Task(std::chrono::steady_clock::time_point t, TRefreshAction a) : dueTime(t), action(a) {}
+            std::chrono::steady_clock::time_point dueTime;
+            TRefreshAction action;
+        };
+        typedef std::map<const void*, Task> TTasks;
+
+        PlaylistRefreshScheduler() {}
+        PlaylistRefreshScheduler(const PlaylistRefreshScheduler&) = delete;
+        PlaylistRefreshScheduler& operator=(const PlaylistRefreshScheduler&) = delete;
+
+        static PlaylistRefreshScheduler& Instance();
+        void* Process();
+
+        // Serializes start and stop of timer thread
+        P8PLATFORM::CMutex m_threadAccess;
+        P8PLATFORM::CMutex m_syncAccess;
+        P8PLATFORM::CEvent m_tasksChanged;
+        TTasks m_tasks;
+    };
+}
+#endif /* __playlist_refresh_scheduler_hpp__ */
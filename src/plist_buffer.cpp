@@ -32,11 +32,23 @@
 
 #include <inttypes.h>
 #include <chrono>
+#include <atomic>
+#include <future>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
 #include "ThreadPool.h"
 #include "helpers.h"
 #include "plist_buffer.h"
 #include "globals.hpp"
 #include "playlist_cache.hpp"
+#include "aes_decryptor.hpp"
+#include "ts_packet_filter.hpp"
+#include "playlist_refresh_scheduler.hpp"
+#include "segment_mirrors.hpp"
+#include "segment_block_pool.hpp"
 #include "p8-platform/util/util.h"
 #include "httplib.h"
 #include "kodi/General.h"
@@ -47,6 +59,23 @@ using namespace Helpers;
 
 namespace Buffers {
     int PlaylistBuffer::s_numberOfHlsThreads = 1;
+    bool PlaylistBuffer::s_adaptiveHlsThreads = false;
+    int PlaylistBuffer::s_numberOfSegmentRanges = 1;
+    int PlaylistBuffer::s_liveStartSegments = 0;
+    // Reader is not waiting for segment
+    static const uint64_t c_noSegmentIndex = (uint64_t)-1;
+    // Loader's sleep when there is nothing to do
+    static const uint32_t c_loaderIdleMs = 1000;
+    // Loader of partial segment waits for playlist update
+    static const uint32_t c_partWaitMs = 500;
+    // Portion of segment data processed at once
+    static const size_t c_readChunkSize = 8192;
+    // Kodi's playback speed units (DVD_PLAYSPEED_NORMAL)
+    static const int c_normalSpeed = 1000;
+    // Faster playback (either direction) loads I-frames only
+    static const int c_trickPlaySpeed = 4 * c_normalSpeed;
+    // Loader checks cancellation while waiting for network
+    static const uint32_t c_cancelCheckMs = 50;
     
     int PlaylistBuffer::SetNumberOfHlsTreads(int numOfTreads) {
         const auto numOfCpu = std::thread::hardware_concurrency();
@@ -56,13 +85,187 @@ namespace Buffers {
             numOfTreads = numOfCpu;
         return s_numberOfHlsThreads = numOfTreads;
     }
+    
+    void PlaylistBuffer::SetAdaptiveHlsThreads(bool enable) {
+        s_adaptiveHlsThreads = enable;
+    }
+    
+    int PlaylistBuffer::SetNumberOfSegmentRanges(int numOfRanges) {
+        const int c_maxNumOfRanges = 8;
+        if(numOfRanges < 1)
+            numOfRanges = 1;
+        else if(numOfRanges > c_maxNumOfRanges)
+            numOfRanges = c_maxNumOfRanges;
+        return s_numberOfSegmentRanges = numOfRanges;
+    }
 
-    PlaylistBuffer::PlaylistBuffer(const std::string &playListUrl,  PlaylistBufferDelegate delegate, bool seekForVod)
+    int PlaylistBuffer::SetLiveStartSegments(int numOfSegments) {
+        if(numOfSegments < 0)
+            numOfSegments = 0;
+        return s_liveStartSegments = numOfSegments;
+    }
+
+    // Helper threads stalled in Kodi's network calls outlive their owners.
+    // Finished ones are reaped when next thread is abandoned, the rest are joined on buffer destruction.
+    class AbandonedThreads
+    {
+    public:
+        static void Add(std::thread&& thread, std::function<bool()> isFinished)
+        {
+            std::lock_guard<std::mutex> lock(s_access);
+            for (auto it = s_threads.begin(); it != s_threads.end();) {
+                if(!it->first()) {
+                    ++it;
+                    continue;
+                }
+                it->second.join();
+                it = s_threads.erase(it);
+            }
+            s_threads.emplace_back(std::move(isFinished), std::move(thread));
+        }
+        
+        static void JoinAll()
+        {
+            std::lock_guard<std::mutex> lock(s_access);
+            for (auto& abandoned : s_threads) {
+                abandoned.second.join();
+            }
+            s_threads.clear();
+        }
+        
+    private:
+        typedef std::pair<std::function<bool()>, std::thread> TAbandoned;
+        static std::mutex s_access;
+        static std::deque<TAbandoned> s_threads;
+    };
+    std::mutex AbandonedThreads::s_access;
+    std::deque<AbandonedThreads::TAbandoned> AbandonedThreads::s_threads;
+    
+    // Kodi's VFS read can't be interrupted from other thread, i.e. stalled connection
+    // would hold loader of canceled segment until the read returns.
+    // File is read ahead by helper thread, loader waits for data checking cancellation.
+    // Canceled reader is abandoned: helper closes the file when pending read returns.
+    class CancelableFileReader
+    {
+    public:
+        // Takes ownership of opened file
+        CancelableFileReader(kodi::vfs::CFile* f)
+        : m_state(std::make_shared<State>())
+        {
+            std::shared_ptr<State> state = m_state;
+            m_thread = std::thread([state, f] {ReadAhead(state, f);});
+        }
+        ~CancelableFileReader()
+        {
+            bool isFinished;
+            {
+                std::lock_guard<std::mutex> lock(m_state->access);
+                m_state->isAbandoned = true;
+                isFinished = m_state->isFinished;
+            }
+            m_state->event.notify_all();
+            if(isFinished) {
+                m_thread.join();
+                return;
+            }
+            LogDebug("PlaylistBuffer: pending read is abandoned.");
+            std::shared_ptr<State> state = m_state;
+            AbandonedThreads::Add(std::move(m_thread), [state] {return state->IsFinished();});
+        }
+        
+        // Up to size bytes of file, 0 on EOF, negative on error or when isCanceled() returns true.
+        ssize_t Read(void* buffer, size_t size, std::function<bool()> isCanceled)
+        {
+            std::unique_lock<std::mutex> lock(m_state->access);
+            while(0 == m_state->size && !m_state->isEnded) {
+                if(isCanceled())
+                    return -1;
+                m_state->event.wait_for(lock, std::chrono::milliseconds(c_cancelCheckMs));
+            }
+            if(0 == m_state->size)
+                return m_state->endResult;
+            const size_t chunk = std::min(size, std::min(m_state->size, c_readAheadSize - m_state->head));
+            memcpy(buffer, m_state->data + m_state->head, chunk);
+            m_state->head = (m_state->head + chunk) % c_readAheadSize;
+            m_state->size -= chunk;
+            lock.unlock();
+            m_state->event.notify_all();
+            return chunk;
+        }
+        
+    private:
+        static const size_t c_readAheadSize = 8 * c_readChunkSize;
+        
+        // Ring of read ahead data, shared with helper thread
+        struct State {
+            State() : head(0), size(0), endResult(0), isEnded(false), isAbandoned(false), isFinished(false) {}
+            bool IsFinished() {
+                std::lock_guard<std::mutex> lock(access);
+                return isFinished;
+            }
+            std::mutex access;
+            std::condition_variable event;
+            uint8_t data[c_readAheadSize];
+            size_t head;
+            size_t size;
+            // Result of last read: 0 on EOF, negative on error
+            ssize_t endResult;
+            bool isEnded;
+            bool isAbandoned;
+            bool isFinished;
+        };
+        static void ReadAhead(std::shared_ptr<State> state, kodi::vfs::CFile* f)
+        {
+            std::unique_lock<std::mutex> lock(state->access);
+            while(!state->isAbandoned) {
+                if(c_readAheadSize == state->size) {
+                    state->event.wait(lock);
+                    continue;
+                }
+                // Free part of ring is not touched by loader
+                const size_t tail = (state->head + state->size) % c_readAheadSize;
+                const size_t room = std::min(c_readAheadSize - state->size, c_readAheadSize - tail);
+                lock.unlock();
+                const ssize_t bytesRead = f->Read(state->data + tail, std::min(room, c_readChunkSize));
+                lock.lock();
+                if(bytesRead > 0) {
+                    state->size += bytesRead;
+                } else {
+                    state->endResult = bytesRead;
+                    state->isEnded = true;
+                }
+                state->event.notify_all();
+                if(state->isEnded)
+                    break;
+            }
+            state->isFinished = true;
+            lock.unlock();
+            f->Close();
+            delete f;
+        }
+        
+        std::shared_ptr<State> m_state;
+        std::thread m_thread;
+    };
+    const size_t CancelableFileReader::c_readAheadSize;
+    
+    PlaylistBuffer::PlaylistBuffer(const std::string &playListUrl,  PlaylistBufferDelegate delegate, bool seekForVod, const std::vector<std::string>& mirrors)
     : m_delegate(delegate)
     , m_cache(nullptr)
     , m_url(playListUrl)
     , m_seekForVod(seekForVod)
     , m_isWaitingForRead(false)
+    , m_waitingSegmentIndex(c_noSegmentIndex)
+    , m_isStreamingSegment(false)
+    , m_streamingSegmentIndex(0)
+    , m_isFirstByteRequested(false)
+    , m_isRefreshDue(false)
+    , m_segmentIndexAfterSeek(0)
+    , m_seekedAtMs(0)
+    , m_loadingWindow(1)
+    , m_speed(c_normalSpeed)
+    , m_isSpeedChanged(false)
+    , m_mirrors(mirrors.empty() ? nullptr : new SegmentMirrors(mirrors))
     {
         Init(playListUrl);
     }
@@ -70,6 +273,8 @@ namespace Buffers {
     PlaylistBuffer::~PlaylistBuffer()
     {
         StopThread();
+        // Connections of canceled segments and losers of hedged requests
+        AbandonedThreads::JoinAll();
         if(m_cache)
             SAFE_DELETE(m_cache);
     }
@@ -84,51 +289,173 @@ namespace Buffers {
             if(m_cache)
                 SAFE_DELETE(m_cache);
             try {
-                m_cache = new PlaylistCache(playlistUrl, m_delegate, m_seekForVod);
+                m_cache = new PlaylistCache(playlistUrl, m_delegate, m_seekForVod, s_liveStartSegments);
             } catch (PlaylistException ex) {
                 kodi::QueueFormattedNotification(QUEUE_ERROR, kodi::GetLocalizedString(32024).c_str());
                 throw PlistBufferException((std::string("Playlist exception: ") + ex.what()).c_str());
             }
             m_position = 0;
             m_currentSegment = nullptr;
+            m_isStreamingSegment = false;
             m_segmentIndexAfterSeek = 0;
+            m_waitingSegmentIndex = c_noSegmentIndex;
+            m_streamHealth = TsStreamHealth();
         }
+        m_firstByteRequestedAt = std::chrono::steady_clock::now();
+        m_isFirstByteRequested = true;
         CreateThread();
         m_cache->WaitForBitrate();
     }
         
-    static bool FillSegmentFromPlaylist(MutableSegment* segment, const std::string& content, std::function<bool(const MutableSegment&)> IsCanceled)
+    // Streams media segment of nested playlist directly into segment's storage.
+    // False when segment can't be loaded completely (or loading is canceled).
+    static bool StreamNestedSegment(MutableSegment* segment, const std::string& url, std::function<bool()> isCanceled, std::function<void(const MutableSegment&)> DataArrived)
+    {
+        auto f = XBMC_OpenFile(url, ADDON_READ_NO_CACHE | ADDON_READ_CHUNKED); //ADDON_READ_AUDIO_VIDEO);
+        if(!f)
+            return false;
+        CancelableFileReader reader(f);
+        ssize_t bytesRead = -1;
+        while(!isCanceled()) {
+            uint8_t* buffer = nullptr;
+            const size_t bufferSize = segment->LockForWrite(&buffer);
+            bytesRead = reader.Read(buffer, bufferSize, isCanceled);
+            segment->UnlockAfterWriten(bytesRead > 0 ? bytesRead : 0);
+            if(bytesRead <= 0)
+                break;
+            DataArrived(*segment);
+        }
+        return 0 == bytesRead;
+    }
+    
+    // Downloads media segment of nested playlist ahead of its turn.
+    // Data is read directly into pool blocks, i.e. it is copied once when appended to segment.
+    // nullptr when segment can't be loaded completely (or loading is canceled).
+    static TSegmentData PrefetchNestedSegment(const std::string& url, std::function<bool()> isCanceled)
+    {
+        if(isCanceled())
+            return nullptr;
+        auto f = XBMC_OpenFile(url, ADDON_READ_NO_CACHE | ADDON_READ_CHUNKED); //ADDON_READ_AUDIO_VIDEO);
+        if(!f)
+            return nullptr;
+        CancelableFileReader reader(f);
+        std::vector<uint8_t*> blocks;
+        size_t size = 0;
+        bool isLoaded = false;
+        try {
+            while(!isCanceled()) {
+                const size_t posInBlock = size % SegmentBlockPool::BLOCK_SIZE;
+                if(0 == posInBlock)
+                    blocks.push_back(SegmentBlockPool::Acquire());
+                const ssize_t bytesRead = reader.Read(blocks.back() + posInBlock, SegmentBlockPool::BLOCK_SIZE - posInBlock, isCanceled);
+                if(bytesRead <= 0) {
+                    isLoaded = 0 == bytesRead;
+                    break;
+                }
+                size += bytesRead;
+            }
+        } catch (std::exception&) {
+            LogError("PlaylistBuffer: failed to allocate memory for media segment of sub-playlist.");
+        }
+        // Returns blocks to the pool
+        TSegmentData data(new SegmentData(std::move(blocks), size));
+        return isLoaded ? data : nullptr;
+    }
+    
+    static void AppendSegmentData(MutableSegment* segment, const SegmentData& data)
+    {
+        size_t offset = 0;
+        while(offset < data.Size()) {
+            uint8_t* buffer = nullptr;
+            const size_t bufferSize = segment->LockForWrite(&buffer);
+            const size_t copied = data.Read(offset, buffer, bufferSize);
+            segment->UnlockAfterWriten(copied);
+            offset += copied;
+        }
+    }
+    
+    // Following media segments of nested playlists are prefetched by all loaders
+    // with up to (number of loaders - 1) downloads, i.e. nested playlists
+    // do not multiply connections of the loader pool.
+    static std::atomic<size_t> s_nestedPrefetches(0);
+    
+    static bool TryStartNestedPrefetch(size_t maxConnections)
+    {
+        size_t prefetches = s_nestedPrefetches;
+        while(prefetches + 1 < maxConnections) {
+            if(s_nestedPrefetches.compare_exchange_weak(prefetches, prefetches + 1))
+                return true;
+        }
+        return false;
+    }
+    
+    // Media segments of nested playlist are appended to the segment in playlist order.
+    // Current one is streamed by loader's thread, following ones are prefetched concurrently.
+    static bool FillSegmentFromPlaylist(MutableSegment* segment, const std::string& content, size_t maxConnections, std::function<bool(const MutableSegment&)> IsCanceled, std::function<void(const MutableSegment&)> DataArrived)
     {
         Playlist plist(content);
-
+        std::vector<std::string> urls;
         bool hasMoreSegments = false;
-        bool isCanceled = false;
         SegmentInfo info;
         while(plist.NextSegment(info, hasMoreSegments)) {
-            auto f = XBMC_OpenFile(info.url, ADDON_READ_NO_CACHE | ADDON_READ_CHUNKED); //ADDON_READ_AUDIO_VIDEO);
-            if(!f)
-                throw PlistBufferException("Failed to open media segment of sub-playlist.");
-
-            unsigned char buffer[8196];
-            ssize_t  bytesRead;
-            do {
-                bytesRead = f->Read(buffer, sizeof(buffer));
-                segment->Push(buffer, bytesRead);
-                isCanceled = IsCanceled(*segment);
-            }while (bytesRead > 0 && !isCanceled);
-            
-            f->Close();
-            delete f;
-            f = nullptr;
-            
-            if(!hasMoreSegments || isCanceled)
+            urls.push_back(info.url);
+            if(!hasMoreSegments)
                 break;
         }
         
-        if(isCanceled){
+        // Raised when loading is over, i.e. pending downloads are useless
+        std::atomic<bool> isStopped(false);
+        std::function<bool()> isCanceled = [&isStopped, &IsCanceled, segment] {
+            return isStopped || IsCanceled(*segment);
+        };
+        bool isCanceledSegment = false;
+        bool isFailed = false;
+        {
+            // Prefetched segments from (i + 1)
+            std::deque<std::future<TSegmentData>> prefetches;
+            size_t nextToStart = 1;
+            for (size_t i = 0; i < urls.size(); ++i) {
+                nextToStart = std::max(nextToStart, i + 1);
+                while(nextToStart < urls.size() && TryStartNestedPrefetch(maxConnections)) {
+                    const std::string& url = urls[nextToStart++];
+                    prefetches.push_back(std::async(std::launch::async, [&url, &isCanceled] {
+                        TSegmentData data = PrefetchNestedSegment(url, isCanceled);
+                        --s_nestedPrefetches;
+                        return data;
+                    }));
+                }
+                bool isLoaded = false;
+                // Prefetches are [nextToStart - size, nextToStart) segments
+                if(!prefetches.empty() && nextToStart - prefetches.size() == i) {
+                    auto data = prefetches.front().get();
+                    prefetches.pop_front();
+                    if((isCanceledSegment = IsCanceled(*segment)))
+                        break;
+                    if((isLoaded = nullptr != data) && data->Size() > 0) {
+                        AppendSegmentData(segment, *data);
+                        DataArrived(*segment);
+                    }
+                } else {
+                    isLoaded = StreamNestedSegment(segment, urls[i], isCanceled, DataArrived);
+                    if((isCanceledSegment = IsCanceled(*segment)))
+                        break;
+                }
+                if(!isLoaded) {
+                    LogError("PlaylistBuffer: failed to load media segment of sub-playlist. URL %s", urls[i].c_str());
+                    isFailed = true;
+                    break;
+                }
+            }
+            // NOTE: destructors of futures wait for downloads.
+            isStopped = true;
+        }
+        if(isFailed)
+            throw PlistBufferException("Failed to open media segment of sub-playlist.");
+        
+        if(isCanceledSegment){
              LogDebug("PlaylistBuffer: segment #%" PRIu64 " CANCELED.", segment->info.index);
              return false;
-         } else if(segment->BytesReady() == 0) {
+         } else if(segment->Size() == 0) {
              LogDebug("PlaylistBuffer: segment #%" PRIu64 " FAILED.", segment->info.index);
              return false;
          }
@@ -138,57 +465,689 @@ namespace Buffers {
 
     }
 
-    static bool FillSegment(MutableSegment* segment, std::function<bool(const MutableSegment&)> IsCanceled, std::function<void(bool,MutableSegment*)> segmentDone)
+    // Ranged download of a single segment.
+    // Each range should be at least 512K, otherwise connection setup overhead dominates.
+    static const int64_t c_minSegmentRangeSize = 512 * 1024;
+    
+    // Returns number of ranges to download segment with (1 means single stream).
+    static int NumberOfSegmentRanges(const kodi::vfs::CFile& f, int64_t length, int maxNumOfRanges)
+    {
+        if(maxNumOfRanges < 2 || length < 2 * c_minSegmentRangeSize)
+            return 1;
+        if(f.GetPropertyValue(ADDON_FILE_PROPERTY_RESPONSE_HEADER, "Accept-Ranges") != "bytes")
+            return 1;
+        return (int) std::min<int64_t>(maxNumOfRanges, length / c_minSegmentRangeSize);
+    }
+
+    // Byte range of segment loaded concurrently into reserved segment storage
+    struct SegmentRange {
+        SegmentRange(int64_t f, int64_t t) : from(f), to(t), loaded(f) {}
+        const int64_t from;
+        const int64_t to;
+        // End of loaded data
+        std::atomic<int64_t> loaded;
+    };
+
+    // Reads byte range of file into reserved segment storage.
+    // Progress is reported after each portion of data.
+    static bool ReadSegmentRange(CancelableFileReader& reader, MutableSegment* segment, SegmentRange& range, std::function<bool()> isCanceled, std::function<void()> progress)
+    {
+        while(range.loaded < range.to && !isCanceled()) {
+            uint8_t* buffer = nullptr;
+            const size_t bufferSize = std::min<int64_t>(segment->LockForWrite(range.loaded, &buffer), range.to - range.loaded);
+            const ssize_t bytesRead = reader.Read(buffer, bufferSize, isCanceled);
+            if(bytesRead <= 0)
+                break;
+            range.loaded += bytesRead;
+            progress();
+        }
+        return range.loaded == range.to;
+    }
+    
+    static bool OpenSegmentRange(kodi::vfs::CFile& f, const std::string& url, int64_t from, int64_t to)
+    {
+        if(!f.CURLCreate(httplib::detail::encode_get_url(url)))
+            return false;
+        const std::string range = "bytes=" + std::to_string(from) + "-" + std::to_string(to - 1);
+        f.CURLAddOption(ADDON_CURL_OPTION_HEADER, "Range", range);
+        if(!f.CURLOpen(ADDON_READ_NO_CACHE | ADDON_READ_CHUNKED | ADDON_READ_TRUNCATED))
+            return false;
+        // Server may ignore Range header and send whole content
+        const std::string contentRange = f.GetPropertyValue(ADDON_FILE_PROPERTY_RESPONSE_HEADER, "Content-Range");
+        return contentRange.find("bytes " + std::to_string(from) + "-") == 0;
+    }
+    
+    // Publishes contiguous prefix of reserved segment storage while ranges are loading.
+    // TS filter runs in place: filter never outputs more than it consumed,
+    // i.e. output overwrites processed data only, ranges are written beyond the prefix.
+    class ReservedSegmentPublisher
+    {
+    public:
+        ReservedSegmentPublisher(MutableSegment* segment, TsPacketFilter* tsFilter)
+        : m_segment(segment)
+        , m_tsFilter(tsFilter)
+        , m_readOffset(0)
+        , m_writeOffset(0)
+        {}
+        // Publishes data up to loaded offset, last call flushes pending filter data.
+        // Returns true when segment size is changed.
+        bool Publish(size_t loaded, bool isLast)
+        {
+            const size_t published = m_writeOffset;
+            if(nullptr == m_tsFilter) {
+                m_readOffset = m_writeOffset = loaded;
+            } else {
+                uint8_t input[c_readChunkSize];
+                uint8_t filtered[sizeof(input) + TsPacketFilter::DETECTION_SIZE];
+                while(m_readOffset < loaded) {
+                    uint8_t* buffer = nullptr;
+                    const size_t chunk = std::min(std::min(m_segment->LockForWrite(m_readOffset, &buffer), loaded - m_readOffset), sizeof(input));
+                    memcpy(input, buffer, chunk);
+                    m_readOffset += chunk;
+                    Write(filtered, m_tsFilter->Filter(input, chunk, filtered));
+                }
+                if(isLast)
+                    Write(filtered, m_tsFilter->Finish(filtered));
+            }
+            m_segment->UnlockAfterWriten(m_writeOffset - published);
+            return m_writeOffset > published;
+        }
+        // Bytes of resource passed to the segment (or pending in filter)
+        size_t Consumed() const {return m_readOffset;}
+    private:
+        void Write(const uint8_t* data, size_t size)
+        {
+            while(size > 0) {
+                uint8_t* buffer = nullptr;
+                const size_t chunk = std::min(size, m_segment->LockForWrite(m_writeOffset, &buffer));
+                memcpy(buffer, data, chunk);
+                m_writeOffset += chunk;
+                data += chunk;
+                size -= chunk;
+            }
+        }
+        MutableSegment* const m_segment;
+        TsPacketFilter* const m_tsFilter;
+        size_t m_readOffset;
+        size_t m_writeOffset;
+    };
+
+    // First range is read from already opened file (reader), others are downloaded concurrently.
+    // Contiguous prefix of loaded ranges is filtered (when TS filter is provided) and published
+    // as data arrives, i.e. segment may be read while loading.
+    // On failure consumed is the offset of resource to resume download from.
+    static bool FillSegmentByRanges(MutableSegment* segment, CancelableFileReader& reader, int64_t length, int numOfRanges, TsPacketFilter* tsFilter, std::function<bool(const MutableSegment&)> IsCanceled, std::function<void(const MutableSegment&)> DataArrived, int64_t& consumed)
+    {
+        LogDebug("PlaylistBuffer: segment #%" PRIu64 " loading by %d ranges (%" PRId64 " bytes).", segment->info.index, numOfRanges, length);
+        
+        segment->Reserve(length);
+        const int64_t rangeSize = (length + numOfRanges - 1) / numOfRanges;
+        std::vector<std::unique_ptr<SegmentRange>> ranges;
+        for(int64_t from = 0; from < length; from += rangeSize) {
+            ranges.emplace_back(new SegmentRange(from, std::min(from + rangeSize, length)));
+        }
+        std::atomic<bool> hasFailed(false);
+        std::function<bool()> isCanceled = [&hasFailed, &IsCanceled, segment] {
+            return hasFailed || IsCanceled(*segment);
+        };
+        // Concurrent ranges wake up publisher on progress
+        std::mutex progressAccess;
+        std::condition_variable progressEvent;
+        uint64_t progress = 0;
+        std::function<void()> notifyProgress = [&progressAccess, &progressEvent, &progress] {
+            std::lock_guard<std::mutex> lock(progressAccess);
+            ++progress;
+            progressEvent.notify_one();
+        };
+        ReservedSegmentPublisher publisher(segment, tsFilter);
+        std::function<void()> publishPrefix = [&ranges, &publisher, &DataArrived, segment] {
+            int64_t loaded = 0;
+            for (auto& range : ranges) {
+                loaded = range->loaded;
+                if(loaded < range->to)
+                    break;
+            }
+            if(publisher.Publish(loaded, false))
+                DataArrived(*segment);
+        };
+        
+        std::vector<std::future<bool>> downloads;
+        for(size_t i = 1; i < ranges.size(); ++i) {
+            SegmentRange* range = ranges[i].get();
+            downloads.push_back(std::async(std::launch::async, [segment, range, &isCanceled, &hasFailed, &notifyProgress] {
+                auto rangeFile = new kodi::vfs::CFile();
+                bool succeeded = false;
+                if(OpenSegmentRange(*rangeFile, segment->info.url, range->from, range->to)) {
+                    CancelableFileReader rangeReader(rangeFile);
+                    succeeded = ReadSegmentRange(rangeReader, segment, *range, isCanceled, notifyProgress);
+                } else {
+                    rangeFile->Close();
+                    delete rangeFile;
+                }
+                if(!succeeded)
+                    hasFailed = true;
+                notifyProgress();
+                return succeeded;
+            }));
+        }
+        bool succeeded = ReadSegmentRange(reader, segment, *ranges[0], isCanceled, publishPrefix);
+        if(!succeeded)
+            hasFailed = true;
+        uint64_t publishedProgress = 0;
+        for (auto& download : downloads) {
+            while(std::future_status::ready != download.wait_for(std::chrono::milliseconds(0))) {
+                {
+                    std::unique_lock<std::mutex> lock(progressAccess);
+                    progressEvent.wait_for(lock, std::chrono::milliseconds(100), [&progress, publishedProgress] {return progress != publishedProgress;});
+                    publishedProgress = progress;
+                }
+                publishPrefix();
+            }
+            succeeded = download.get() && succeeded;
+        }
+        if(succeeded) {
+            if(publisher.Publish(length, true))
+                DataArrived(*segment);
+        } else {
+            publishPrefix();
+        }
+        consumed = publisher.Consumed();
+        return succeeded;
+    }
+
+    // Opens whole resource or its byte range (EXT-X-BYTERANGE)
+    static kodi::vfs::CFile* OpenSegment(const std::string& url, const ByteRange& range)
+    {
+        if(range.IsEmpty())
+            return XBMC_OpenFile(url, ADDON_READ_NO_CACHE | ADDON_READ_CHUNKED | ADDON_READ_TRUNCATED);
+        auto f = new kodi::vfs::CFile();
+        if(OpenSegmentRange(*f, url, range.offset, range.offset + range.length))
+            return f;
+        delete f;
+        return nullptr;
+    }
+
+    // Small resources shared by segments of rendition:
+    // media initialization sections (EXT-X-MAP) and decryption keys (EXT-X-KEY).
+    // Each resource is downloaded once per URI (and byte range).
+    class SharedResourceCache
+    {
+    public:
+        typedef std::shared_ptr<const std::vector<uint8_t>> TSection;
+        
+        static TSection Get(const std::string& url, const ByteRange& range)
+        {
+            const std::string key = url + "@" + std::to_string(range.offset) + ":" + std::to_string(range.length);
+            std::shared_ptr<PendingResource> pending;
+            {
+                std::unique_lock<std::mutex> lock(s_syncAccess);
+                for (const auto& s : s_sections) {
+                    if(s.first == key)
+                        return s.second;
+                }
+                // Concurrent loaders of same rendition wait for the resource
+                // instead of requesting it again (failure is shared too).
+                auto it = s_pending.find(key);
+                if(it != s_pending.end()) {
+                    pending = it->second;
+                    s_resourceLoaded.wait(lock, [&pending] {return pending->isDone;});
+                    return pending->section;
+                }
+                pending = std::make_shared<PendingResource>();
+                s_pending[key] = pending;
+            }
+            // Other resources are not blocked by download
+            auto section = Download(url, range);
+            {
+                std::lock_guard<std::mutex> lock(s_syncAccess);
+                pending->section = section;
+                pending->isDone = true;
+                s_pending.erase(key);
+                if(section) {
+                    if(s_sections.size() >= c_maxSections)
+                        s_sections.pop_front();
+                    s_sections.emplace_back(key, section);
+                }
+            }
+            s_resourceLoaded.notify_all();
+            if(section)
+                LogDebug("PlaylistBuffer: shared resource loaded (%d bytes). URL %s", section->size(), url.c_str());
+            return section;
+        }
+        
+    private:
+        // Few renditions per stream
+        static const size_t c_maxSections = 16;
+        // Init section is a small header (moov box, PAT/PMT etc.), key is 16 bytes
+        static const size_t c_maxSectionSize = 1024 * 1024;
+
+        struct PendingResource {
+            PendingResource() : isDone(false) {}
+            bool isDone;
+            TSection section;
+        };
+
+        // Truncated resource is useless, i.e. oversized one is failed
+        static TSection Download(const std::string& url, const ByteRange& range)
+        {
+            auto f = OpenSegment(url, range);
+            if(!f)
+                return nullptr;
+            const size_t maxSize = range.IsEmpty() ? c_maxSectionSize : range.length;
+            auto data = std::make_shared<std::vector<uint8_t>>();
+            uint8_t buffer[8192];
+            ssize_t bytesRead = 0;
+            while(data->size() <= maxSize && (bytesRead = f->Read(buffer, sizeof(buffer))) > 0) {
+                data->insert(data->end(), buffer, buffer + bytesRead);
+            }
+            f->Close();
+            delete f;
+            if(data->size() > maxSize) {
+                LogError("PlaylistBuffer: shared resource exceeds %d bytes. URL %s", (int)maxSize, url.c_str());
+                return nullptr;
+            }
+            if(bytesRead < 0 || data->empty() || (!range.IsEmpty() && data->size() != range.length))
+                return nullptr;
+            return data;
+        }
+        
+        static std::mutex s_syncAccess;
+        static std::condition_variable s_resourceLoaded;
+        static std::deque<std::pair<std::string, TSection>> s_sections;
+        // Resources being downloaded
+        static std::map<std::string, std::shared_ptr<PendingResource>> s_pending;
+    };
+    std::mutex SharedResourceCache::s_syncAccess;
+    std::condition_variable SharedResourceCache::s_resourceLoaded;
+    std::deque<std::pair<std::string, SharedResourceCache::TSection>> SharedResourceCache::s_sections;
+    std::map<std::string, std::shared_ptr<SharedResourceCache::PendingResource>> SharedResourceCache::s_pending;
+
+    // Opened media resource of segment with its shared resources.
+    // Source is either primary playlist or a mirror.
+    struct SegmentSource
+    {
+        SegmentSource(const SegmentInfo& i, bool mirror)
+        : info(i)
+        , isMirror(mirror)
+        , file(nullptr)
+        {}
+        ~SegmentSource() {
+            if(file) {
+                file->Close();
+                delete file;
+            }
+        }
+        const SegmentInfo info;
+        const bool isMirror;
+        SharedResourceCache::TSection initSection;
+        SharedResourceCache::TSection key;
+        kodi::vfs::CFile* file;
+    };
+    typedef std::unique_ptr<SegmentSource> TSegmentSource;
+
+    // Rounds over all sources (primary and mirrors) before segment is failed
+    static const int c_maxSourceRounds = 3;
+    // Delay before second round, doubled on each following one
+    static const uint32_t c_initialBackoffMs = 250;
+
+    static bool LoadSharedResources(SegmentSource& source)
+    {
+        const SegmentInfo& info = source.info;
+        // fMP4/CMAF segment can't be demuxed without initialization section
+        if(!info.initUrl.empty()) {
+            source.initSection = SharedResourceCache::Get(info.initUrl, info.initRange);
+            if(!source.initSection) {
+                LogError("PlaylistBuffer: failed to download media initialization section of segment #%" PRIu64 ".", info.index);
+                return false;
+            }
+        }
+        // Segments usually share the key, i.e. it's requested once
+        if(!info.keyUrl.empty()) {
+            source.key = SharedResourceCache::Get(info.keyUrl, ByteRange());
+            if(!source.key || source.key->size() != AesDecryptor::KEY_SIZE || info.keyIv.size() != AesDecryptor::BLOCK_SIZE) {
+                LogError("PlaylistBuffer: failed to obtain decryption key of segment #%" PRIu64 ".", info.index);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static TSegmentSource OpenSource(const SegmentInfo& info, bool isMirror)
+    {
+        TSegmentSource source(new SegmentSource(info, isMirror));
+        if(!LoadSharedResources(*source))
+            return nullptr;
+        source->file = OpenSegment(info.url, info.range); //ADDON_READ_AUDIO_VIDEO);
+        if(!source->file)
+            return nullptr;
+        return source;
+    }
+
+    // Loser of hedged request is finished in background, i.e. segment is done without waiting for it.
+    // Request threads don't touch the segment, mirrors live until abandoned threads are joined.
+    class HedgedRequest
+    {
+    public:
+        ~HedgedRequest() {
+            for (auto& t : m_threads) {
+                if(*t.first) {
+                    t.second.join();
+                    continue;
+                }
+                std::shared_ptr<std::atomic<bool>> isFinished = t.first;
+                AbandonedThreads::Add(std::move(t.second), [isFinished] {return isFinished->load();});
+            }
+        }
+        
+        // Requests primary source and, when it responds slower than delayMs,
+        // same segment from the mirror. First response wins, other one is dropped.
+        // nullptr when both requests failed or isCanceled() returns true.
+        TSegmentSource Open(const MutableSegment* segment, SegmentMirrors& mirrors, uint32_t delayMs, std::function<bool()> isCanceled)
+        {
+            typedef std::chrono::steady_clock Clock;
+            const SegmentInfo primary = segment->info;
+            auto race = std::make_shared<Race>();
+            Start(race, [primary] {
+                return OpenSource(primary, false);
+            });
+            {
+                std::unique_lock<std::mutex> lock(race->access);
+                const auto mirrorAt = Clock::now() + std::chrono::milliseconds(delayMs);
+                while(race->pending > 0 && Clock::now() < mirrorAt) {
+                    if(isCanceled()) {
+                        race->isTaken = true;
+                        return nullptr;
+                    }
+                    race->isDone.wait_until(lock, std::min(mirrorAt, Clock::now() + std::chrono::milliseconds(c_cancelCheckMs)));
+                }
+                if(0 == race->pending) {
+                    race->isTaken = true;
+                    return std::move(race->winner);
+                }
+            }
+            LogDebug("PlaylistBuffer: segment #%" PRIu64 " is slow (> %d ms). Requesting mirror.", primary.index, delayMs);
+            Start(race, [primary, &mirrors] {
+                SegmentInfo info;
+                if(!mirrors.FindSegment(0, primary, info))
+                    return TSegmentSource();
+                return OpenSource(info, true);
+            });
+            std::unique_lock<std::mutex> lock(race->access);
+            while(!race->winner && race->pending > 0) {
+                if(isCanceled()) {
+                    race->isTaken = true;
+                    return nullptr;
+                }
+                race->isDone.wait_for(lock, std::chrono::milliseconds(c_cancelCheckMs));
+            }
+            race->isTaken = true;
+            if(race->winner && race->winner->isMirror)
+                LogDebug("PlaylistBuffer: segment #%" PRIu64 " is taken from mirror.", primary.index);
+            return std::move(race->winner);
+        }
+        
+    private:
+        struct Race {
+            Race() : pending(0), isTaken(false) {}
+            std::mutex access;
+            std::condition_variable isDone;
+            TSegmentSource winner;
+            int pending;
+            bool isTaken;
+        };
+        typedef std::pair<std::shared_ptr<std::atomic<bool>>, std::thread> TRequestThread;
+        
+        void Start(std::shared_ptr<Race> race, std::function<TSegmentSource()> open)
+        {
+            {
+                std::lock_guard<std::mutex> lock(race->access);
+                ++race->pending;
+            }
+            auto isFinished = std::make_shared<std::atomic<bool>>(false);
+            m_threads.emplace_back(isFinished, std::thread([race, open, isFinished] {
+                {
+                    TSegmentSource source = open();
+                    {
+                        std::lock_guard<std::mutex> lock(race->access);
+                        if(source && !race->winner && !race->isTaken)
+                            race->winner = std::move(source);
+                        --race->pending;
+                    }
+                    race->isDone.notify_all();
+                    // Loser's file is closed here (outside of lock)
+                }
+                *isFinished = true;
+            }));
+        }
+        
+        std::vector<TRequestThread> m_threads;
+    };
+
+    // Opens segment on primary source. Failed request is repeated
+    // with exponential backoff, alternating primary source and mirrors.
+    static TSegmentSource OpenSegmentSource(const MutableSegment* segment, SegmentMirrors* mirrors, HedgedRequest& hedge, std::function<bool(const MutableSegment&)> IsCanceled)
+    {
+        const size_t numOfSources = 1 + (mirrors ? mirrors->Count() : 0);
+        for (int attempt = 0; attempt < c_maxSourceRounds * numOfSources; ++attempt) {
+            if(attempt > 0) {
+                if(IsCanceled(*segment))
+                    return nullptr;
+                // Backoff grows per round over all sources
+                const uint32_t backoffMs = c_initialBackoffMs << ((attempt - 1) / numOfSources);
+                LogNotice("PlaylistBuffer: segment #%" PRIu64 " failed. Retrying in %d ms (attempt %d).", segment->info.index, backoffMs, attempt + 1);
+                const auto retryAt = std::chrono::steady_clock::now() + std::chrono::milliseconds(backoffMs);
+                while(std::chrono::steady_clock::now() < retryAt) {
+                    if(IsCanceled(*segment))
+                        return nullptr;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(c_cancelCheckMs));
+                }
+            }
+            const size_t sourceIdx = attempt % numOfSources;
+            const auto startedAt = std::chrono::steady_clock::now();
+            TSegmentSource source;
+            uint32_t hedgeDelayMs = 0;
+            if(0 == attempt && mirrors && SegmentMirrors::IsHedgingEnabled() && mirrors->LatencyP95(hedgeDelayMs)) {
+                source = hedge.Open(segment, *mirrors, hedgeDelayMs, [segment, &IsCanceled] {return IsCanceled(*segment);});
+            } else if(0 == sourceIdx) {
+                source = OpenSource(segment->info, false);
+            } else {
+                SegmentInfo info;
+                if(mirrors->FindSegment(sourceIdx - 1, segment->info, info)) {
+                    LogDebug("PlaylistBuffer: requesting segment #%" PRIu64 " from mirror #%d.", segment->info.index, (int)sourceIdx);
+                    source = OpenSource(info, true);
+                }
+            }
+            if(source) {
+                if(mirrors) {
+                    const auto latency = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startedAt);
+                    mirrors->AddLatency((uint32_t)latency.count());
+                }
+                return source;
+            }
+        }
+        return nullptr;
+    }
+
+    // DataArrived is called on each portion of sequentially loaded data,
+    // i.e. when segment may be read while loading.
+    // Decrypts and filters portion of data (up to c_readChunkSize) before it's added to segment.
+    // Last portion (may be empty) flushes pending data. Returns amount of added bytes.
+    static size_t PushSegmentData(MutableSegment* segment, const uint8_t* buffer, size_t size, bool isLast, AesDecryptor* decryptor, TsPacketFilter* tsFilter, bool& isDecryptionFailed)
+    {
+        uint8_t decrypted[c_readChunkSize + AesDecryptor::BLOCK_SIZE];
+        uint8_t filtered[sizeof(decrypted) + TsPacketFilter::DETECTION_SIZE];
+        const uint8_t* data = buffer;
+        size_t dataSize = size;
+        if(decryptor) {
+            if(size > 0) {
+                dataSize = decryptor->Update(buffer, size, decrypted);
+            } else if(isLast && !decryptor->Finish(decrypted, dataSize)) {
+                LogError("PlaylistBuffer: segment #%" PRIu64 " has invalid encryption padding.", segment->info.index);
+                isDecryptionFailed = true;
+            }
+            data = decrypted;
+        }
+        if(tsFilter) {
+            size_t filteredSize = tsFilter->Filter(data, dataSize, filtered);
+            // Partial packet at the end of segment is dropped
+            if(isLast)
+                filteredSize += tsFilter->Finish(filtered + filteredSize);
+            data = filtered;
+            dataSize = filteredSize;
+        }
+        if(dataSize > 0)
+            segment->Push(data, dataSize);
+        return dataSize;
+    }
+
+    // Failed request is repeated on mirrors (when available).
+    // Nested playlist (TTV/ACE) is loaded by up to numOfLoaders connections.
+    static bool FillSegment(MutableSegment* segment, SegmentMirrors* mirrors, int numOfRanges, size_t numOfLoaders, std::function<bool(const MutableSegment&)> IsCanceled, std::function<void(const MutableSegment&)> DataArrived, std::function<void(bool,MutableSegment*)> segmentDone)
     {
         std::hash<std::thread::id> hasher;
         LogDebug("PlaylistBuffer: segment #%" PRIu64 " STARTED. (thread 0x%X).", segment->info.index, hasher(std::this_thread::get_id()));
 
         bool isCanceled = IsCanceled(*segment);
         bool result = !isCanceled;
+        // Prepended initialization section
+        size_t initSize = 0;
+        // Decryption runs on data as it arrives
+        std::unique_ptr<AesDecryptor> decryptor;
+        bool isDecryptionFailed = false;
+        // Drops corrupted TS packets (broken CDN edges)
+        std::unique_ptr<TsPacketFilter> tsFilter;
 
         do {
             // Do not bother the server with canceled segments
             if(isCanceled)
                 break;
             
-            auto f = XBMC_OpenFile(segment->info.url, ADDON_READ_NO_CACHE | ADDON_READ_CHUNKED | ADDON_READ_TRUNCATED); //ADDON_READ_AUDIO_VIDEO);
-            if(!f)
+            const auto startedAt = std::chrono::system_clock::now();
+            // NOTE: should be destroyed before segmentDone()
+            HedgedRequest hedge;
+            auto source = OpenSegmentSource(segment, mirrors, hedge, IsCanceled);
+            if(!source) {
+                isCanceled = IsCanceled(*segment);
+                if(isCanceled)
+                    break;
                 throw PlistBufferException("Failed to download playlist media segment.");
+            }
+            const SegmentInfo& info = source->info;
+            if(source->initSection) {
+                segment->Push(source->initSection->data(), source->initSection->size());
+                initSize = source->initSection->size();
+                DataArrived(*segment);
+            }
+            if(source->key) {
+                decryptor.reset(new AesDecryptor(source->key->data(), (const uint8_t*)info.keyIv.data()));
+            }
+            auto f = source->file;
+            // Closed below
+            source->file = nullptr;
             
             // Some content type should be treated as playlist
             // https://tools.ietf.org/html/draft-pantos-http-live-streaming-08#section-3.1
             auto contentType = f->GetPropertyValue(ADDON_FILE_PROPERTY_CONTENT_TYPE, "");
             const bool contentIsPlaylist =  "application/vnd.apple.mpegurl" == contentType  || "audio/mpegurl" == contentType;
             
-            unsigned char buffer[8196];
             std::string contentForPlaylist;
-            ssize_t  bytesRead;
-            do {
-                bytesRead = f->Read(buffer, sizeof(buffer));
-                if(contentIsPlaylist) {
-                    contentForPlaylist.append((char *) buffer, bytesRead);
-                } else{
-                    segment->Push(buffer, bytesRead);
-                }
+            ssize_t  bytesRead = -1;
+            bool isLoaded = false;
+            // Byte range of resource and segment with init section are loaded sequentially
+            // fMP4 segment is not a transport stream
+            if(!contentIsPlaylist && 0 == initSize)
+                tsFilter.reset(new TsPacketFilter());
+            // Ranges are requested from primary source only
+            int64_t length = 0;
+            int ranges = 1;
+            if(!contentIsPlaylist && !source->isMirror && info.range.IsEmpty() && 0 == initSize && !decryptor) {
+                length = f->GetLength();
+                ranges = NumberOfSegmentRanges(*f, length, numOfRanges);
+            }
+            // File is read by helper thread from now on
+            std::function<bool()> isReadCanceled = [&IsCanceled, segment] {
+                return IsCanceled(*segment);
+            };
+            std::unique_ptr<CancelableFileReader> reader(new CancelableFileReader(f));
+            f = nullptr;
+            if(ranges > 1) {
+                // Ranges are filtered and published as contiguous data arrives
+                int64_t consumed = 0;
+                isLoaded = FillSegmentByRanges(segment, *reader, length, ranges, tsFilter.get(), IsCanceled, DataArrived, consumed);
                 isCanceled = IsCanceled(*segment);
-                //        LogDebug(">>> Write: %d", bytesRead);
-            }while (bytesRead > 0 && !isCanceled);
+                if(!isLoaded && !isCanceled) {
+                    LogDebug("PlaylistBuffer: ranged download of segment #%" PRIu64 " failed at %" PRId64 " bytes. Loading the rest by single stream.", segment->info.index, consumed);
+                    reader.reset();
+                    // Published data may be read already, i.e. the rest is appended
+                    // through the same TS filter.
+                    if(0 == consumed) {
+                        f = XBMC_OpenFile(info.url, ADDON_READ_NO_CACHE | ADDON_READ_CHUNKED | ADDON_READ_TRUNCATED);
+                    } else {
+                        f = new kodi::vfs::CFile();
+                        if(!OpenSegmentRange(*f, info.url, consumed, length)) {
+                            f->Close();
+                            delete f;
+                            f = nullptr;
+                        }
+                    }
+                    if(!f)
+                        throw PlistBufferException("Failed to download playlist media segment.");
+                    reader.reset(new CancelableFileReader(f));
+                    f = nullptr;
+                }
+            }
+            if(!isLoaded && !isCanceled) {
+                do {
+                    if(contentIsPlaylist) {
+                        char buffer[8196];
+                        bytesRead = reader->Read(buffer, sizeof(buffer), isReadCanceled);
+                        if(bytesRead > 0)
+                            contentForPlaylist.append(buffer, bytesRead);
+                    } else if(decryptor || tsFilter) {
+                        uint8_t buffer[c_readChunkSize];
+                        bytesRead = reader->Read(buffer, sizeof(buffer), isReadCanceled);
+                        if(PushSegmentData(segment, buffer, bytesRead > 0 ? bytesRead : 0, 0 == bytesRead, decryptor.get(), tsFilter.get(), isDecryptionFailed) > 0)
+                            DataArrived(*segment);
+                    } else{
+                        // Read ahead data goes directly to segment's storage
+                        uint8_t* buffer = nullptr;
+                        const size_t bufferSize = segment->LockForWrite(&buffer);
+                        bytesRead = reader->Read(buffer, bufferSize, isReadCanceled);
+                        segment->UnlockAfterWriten(bytesRead > 0 ? bytesRead : 0);
+                        if(bytesRead > 0)
+                            DataArrived(*segment);
+                    }
+                    isCanceled = IsCanceled(*segment);
+                    //        LogDebug(">>> Write: %d", bytesRead);
+                }while (bytesRead > 0 && !isCanceled);
+            }
             
-            f->Close();
-            delete f;
-            f = nullptr;
+            // Connection of canceled segment is closed in background
+            reader.reset();
+            if(!contentIsPlaylist) {
+                std::chrono::duration<float> downloadTime = std::chrono::system_clock::now() - startedAt;
+                segment->SetDownloadTime(downloadTime.count());
+            }
+            if(tsFilter) {
+                const auto& health = tsFilter->Health();
+                if(health.droppedBytes > 0 || health.continuityErrors > 0) {
+                    LogNotice("PlaylistBuffer: segment #%" PRIu64 " is corrupted. Dropped %" PRIu64 " bytes (%" PRIu64 " resyncs), %" PRIu64 " continuity errors.",
+                              segment->info.index, health.droppedBytes, health.resyncs, health.continuityErrors);
+                }
+                segment->SetStreamHealth(health);
+            }
             
             if(contentIsPlaylist && !isCanceled) {
-                result = FillSegmentFromPlaylist(segment, contentForPlaylist, [&isCanceled, &IsCanceled](const MutableSegment& seg){
-                    return isCanceled = IsCanceled(seg);
-                });
+                // Predicate is called by concurrent downloads, i.e. cancellation is checked on return
+                result = FillSegmentFromPlaylist(segment, contentForPlaylist, numOfLoaders, IsCanceled, DataArrived);
+                isCanceled = !result && IsCanceled(*segment);
             }
             
         } while(false);
         if(isCanceled){
             LogDebug("PlaylistBuffer: segment #%" PRIu64 " CANCELED.", segment->info.index);
             result = false;
-        } else if(segment->BytesReady() == 0) {
+        } else if(segment->Size() == initSize || isDecryptionFailed) {
             LogDebug("PlaylistBuffer: segment #%" PRIu64 " FAILED.", segment->info.index);
             result = false;
         } else {
@@ -199,6 +1158,343 @@ namespace Buffers {
         return result;
     }
     
+    // Trick-play loads single I-frame (byte range of I-frame rendition) instead of whole segment.
+    // Returns false when I-frame failed, i.e. segment should be loaded in full (segmentDone is not called).
+    static bool FillTrickPlaySegment(MutableSegment* segment, const SegmentInfo& iframe, std::function<bool(const MutableSegment&)> IsCanceled, std::function<void(const MutableSegment&)> DataArrived, std::function<void(bool,MutableSegment*)> segmentDone)
+    {
+        LogDebug("PlaylistBuffer: I-frame of segment #%" PRIu64 " STARTED.", segment->info.index);
+        
+        bool isCanceled = IsCanceled(*segment);
+        bool isFailed = false;
+        size_t initSize = 0;
+        std::unique_ptr<TsPacketFilter> tsFilter;
+        do {
+            if(isCanceled)
+                break;
+            auto source = OpenSource(iframe, false);
+            if(!source) {
+                isFailed = true;
+                break;
+            }
+            if(source->initSection) {
+                segment->Push(source->initSection->data(), source->initSection->size());
+                initSize = source->initSection->size();
+                DataArrived(*segment);
+            } else {
+                tsFilter.reset(new TsPacketFilter());
+            }
+            // Encrypted I-frames are not used (see PlaylistCache::TrickPlaySource())
+            bool isDecryptionFailed = false;
+            std::function<bool()> isReadCanceled = [&IsCanceled, segment] {
+                return IsCanceled(*segment);
+            };
+            CancelableFileReader reader(source->file);
+            source->file = nullptr;
+            uint8_t buffer[c_readChunkSize];
+            ssize_t bytesRead;
+            while((bytesRead = reader.Read(buffer, sizeof(buffer), isReadCanceled)) > 0) {
+                if(PushSegmentData(segment, buffer, bytesRead, false, nullptr, tsFilter.get(), isDecryptionFailed) > 0)
+                    DataArrived(*segment);
+                if((isCanceled = IsCanceled(*segment)))
+                    break;
+            }
+            if(bytesRead < 0 && !isCanceled)
+                isCanceled = IsCanceled(*segment);
+            isFailed = bytesRead < 0 && !isCanceled;
+            if(!isCanceled && !isFailed && PushSegmentData(segment, nullptr, 0, true, nullptr, tsFilter.get(), isDecryptionFailed) > 0)
+                DataArrived(*segment);
+            isFailed = isFailed || segment->Size() == initSize;
+        } while(false);
+        
+        // Nothing is pushed yet (but init section), i.e. segment may be loaded in full
+        if(isFailed && !isCanceled && segment->Size() == initSize) {
+            LogDebug("PlaylistBuffer: I-frame of segment #%" PRIu64 " FAILED. Loading whole segment.", segment->info.index);
+            segment->Discard();
+            return false;
+        }
+        // NOTE: download time is not set, I-frame size says nothing about segment's bitrate
+        LogDebug("PlaylistBuffer: I-frame of segment #%" PRIu64 " %s.", segment->info.index, isCanceled ? "CANCELED" : (isFailed ? "FAILED" : "FINISHED"));
+        segmentDone(!isCanceled && !isFailed, segment);
+        return true;
+    }
+
+    // Parts of partial segment (low-latency HLS).
+    // Provider waits a bit for playlist update when part is not announced yet.
+    typedef std::function<PartStatus(const MutableSegment&, size_t, PartInfo&)> TPartProvider;
+    // Part request is repeated (e.g. stale preload hint) after a short delay
+    static const int c_maxPartAttempts = 3;
+    static const uint32_t c_partRetryMs = 100;
+
+    // Segment of low-latency stream is loaded by parts while they are announced,
+    // i.e. it may be read before the segment is completed on server.
+    static bool FillPartialSegment(MutableSegment* segment, TPartProvider NextPart, std::function<bool(const MutableSegment&)> IsCanceled, std::function<void(const MutableSegment&)> DataArrived, std::function<void(bool,MutableSegment*)> segmentDone)
+    {
+        LogDebug("PlaylistBuffer: partial segment #%" PRIu64 " STARTED from part %d.", segment->info.index, (int)segment->info.firstPart);
+        
+        bool isCanceled = IsCanceled(*segment);
+        bool isFailed = false;
+        bool isDecryptionFailed = false;
+        size_t initSize = 0;
+        std::unique_ptr<AesDecryptor> decryptor;
+        std::unique_ptr<TsPacketFilter> tsFilter;
+        do {
+            if(isCanceled)
+                break;
+            SegmentSource source(segment->info, false);
+            if(!LoadSharedResources(source)) {
+                isFailed = true;
+                break;
+            }
+            if(source.initSection) {
+                segment->Push(source.initSection->data(), source.initSection->size());
+                initSize = source.initSection->size();
+                DataArrived(*segment);
+            } else {
+                tsFilter.reset(new TsPacketFilter());
+            }
+            // Parts are sequential ranges of segment, i.e. CBC state passes from part to part
+            if(source.key)
+                decryptor.reset(new AesDecryptor(source.key->data(), (const uint8_t*)segment->info.keyIv.data()));
+            
+            std::function<bool()> isReadCanceled = [&IsCanceled, segment] {
+                return IsCanceled(*segment);
+            };
+            size_t part = segment->info.firstPart;
+            int attempt = 0;
+            while(!isFailed && !(isCanceled = IsCanceled(*segment))) {
+                PartInfo info;
+                const PartStatus status = NextPart(*segment, part, info);
+                if(k_PartNone == status)
+                    break;
+                if(k_PartPending == status)
+                    continue;
+                if(info.isGap) {
+                    ++part;
+                    continue;
+                }
+                auto f = OpenSegment(info.url, info.range);
+                if(!f) {
+                    // Stale hint is replaced by announced part on playlist reload
+                    if(k_PartHint != status && ++attempt >= c_maxPartAttempts) {
+                        LogError("PlaylistBuffer: failed to download part %d of segment #%" PRIu64 ".", (int)part, segment->info.index);
+                        isFailed = true;
+                    } else {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(c_partRetryMs));
+                    }
+                    continue;
+                }
+                attempt = 0;
+                CancelableFileReader reader(f);
+                uint8_t buffer[c_readChunkSize];
+                ssize_t bytesRead;
+                while((bytesRead = reader.Read(buffer, sizeof(buffer), isReadCanceled)) > 0) {
+                    if(PushSegmentData(segment, buffer, bytesRead, false, decryptor.get(), tsFilter.get(), isDecryptionFailed) > 0)
+                        DataArrived(*segment);
+                    if((isCanceled = IsCanceled(*segment)))
+                        break;
+                }
+                if(bytesRead < 0 && (isCanceled = IsCanceled(*segment)))
+                    break;
+                // Data of part is pushed already, i.e. it can't be repeated
+                if(bytesRead < 0) {
+                    LogError("PlaylistBuffer: part %d of segment #%" PRIu64 " is broken.", (int)part, segment->info.index);
+                    isFailed = true;
+                }
+                ++part;
+            }
+            if(!isCanceled && !isFailed && PushSegmentData(segment, nullptr, 0, true, decryptor.get(), tsFilter.get(), isDecryptionFailed) > 0)
+                DataArrived(*segment);
+        } while(false);
+        
+        // NOTE: download time is not set, parts arrive at production pace,
+        // i.e. they do not show network throughput.
+        if(tsFilter)
+            segment->SetStreamHealth(tsFilter->Health());
+        
+        bool result = false;
+        if(isCanceled){
+            LogDebug("PlaylistBuffer: partial segment #%" PRIu64 " CANCELED.", segment->info.index);
+        } else if(isFailed || isDecryptionFailed || segment->Size() == initSize) {
+            LogDebug("PlaylistBuffer: partial segment #%" PRIu64 " FAILED.", segment->info.index);
+        } else {
+            LogDebug("PlaylistBuffer: partial segment #%" PRIu64 " FINISHED.", segment->info.index);
+            result = true;
+        }
+        segmentDone(result, segment);
+        return result;
+    }
+    
+    // Pending segment loads.
+    // Free loader takes the job closest to reader's focus (not the oldest one),
+    // i.e. segment awaited after seek preempts jobs queued before.
+    // Jobs are passed to thread pool only when a worker is free,
+    // i.e. whole backlog is here and pool's FIFO queue stays empty.
+    class SegmentJobQueue
+    {
+    public:
+        typedef std::function<void()> TJob;
+        
+        SegmentJobQueue() : m_started(0), m_running(0) {}
+        
+        void Push(uint64_t index, TJob job)
+        {
+            std::lock_guard<std::mutex> lock(m_access);
+            m_jobs.emplace(index, job);
+        }
+        // Reserves a worker for one of pending jobs (if any).
+        // The job itself is chosen by Pop() when worker starts.
+        bool StartJob(size_t workers)
+        {
+            std::lock_guard<std::mutex> lock(m_access);
+            if(m_jobs.size() <= m_started || m_running >= workers)
+                return false;
+            ++m_started;
+            ++m_running;
+            return true;
+        }
+        // Segments ahead of focus go first, the ones behind it - last
+        bool Pop(uint64_t focus, TJob& job)
+        {
+            std::lock_guard<std::mutex> lock(m_access);
+            if(m_started > 0)
+                --m_started;
+            if(m_jobs.empty())
+                return false;
+            auto it = m_jobs.lower_bound(focus);
+            if(it == m_jobs.end())
+                it = m_jobs.begin();
+            job = it->second;
+            m_jobs.erase(it);
+            return true;
+        }
+        void JobDone()
+        {
+            std::lock_guard<std::mutex> lock(m_access);
+            if(m_running > 0)
+                --m_running;
+        }
+        // Jobs waiting for a worker
+        size_t Backlog()
+        {
+            std::lock_guard<std::mutex> lock(m_access);
+            return m_jobs.size() - m_started;
+        }
+        
+    private:
+        std::mutex m_access;
+        std::multimap<uint64_t, TJob> m_jobs;
+        // Workers reserved by StartJob() and not popped a job yet
+        size_t m_started;
+        size_t m_running;
+    };
+    
+    // Controls amount of concurrent segment downloads.
+    // Adds a download while segments are loaded slower than required
+    // and aggregated throughput grows with each new connection.
+    // Removes a download when cache is full, nothing to load
+    // or throughput stopped growing (link is saturated).
+    class DownloadConcurrency
+    {
+    public:
+        DownloadConcurrency(size_t initialWorkers, size_t maxWorkers)
+        : m_maxWorkers(std::max<size_t>(maxWorkers, 1))
+        , m_workers(std::min(std::max<size_t>(initialWorkers, 1), m_maxWorkers))
+        , m_ceiling(m_maxWorkers)
+        , m_ceilingTtl(0)
+        , m_loadRatio(0.0)
+        , m_lastWorkers(0)
+        , m_lastThroughput(0.0)
+        {
+            StartEpoch();
+        }
+        
+        size_t Workers() const {return m_workers;}
+        
+        void SegmentLoaded(size_t bytes, float downloadTime, float duration)
+        {
+            if(downloadTime <= 0.0 || duration <= 0.0)
+                return;
+            const float ratio = downloadTime / duration;
+            m_loadRatio = (m_loadRatio == 0.0) ? ratio : m_loadRatio * (1.0 - c_ratioWeight) + ratio * c_ratioWeight;
+            m_bytes += bytes;
+            ++m_samples;
+        }
+        // Loader had no reason to start new download (cache is full or nothing to load)
+        void LoaderIdle() { m_wasIdle = true; }
+        
+        // Returns new amount of workers
+        size_t Adjust()
+        {
+            if(m_samples < std::max(m_workers, c_minSamples))
+                return m_workers;
+            
+            std::chrono::duration<float> epochTime = std::chrono::system_clock::now() - m_epochStart;
+            const float throughput = epochTime.count() > 0.0 ? m_bytes / epochTime.count() : 0.0;
+            // Segments loaded per duration of segment
+            const float speedup = m_workers / m_loadRatio;
+            
+            size_t workers = m_workers;
+            if(m_wasIdle) {
+                if(workers > 1 && (workers - 1) / m_loadRatio >= c_targetSpeedup)
+                    --workers;
+            } else if(m_lastThroughput > 0.0 && m_workers > m_lastWorkers && throughput < m_lastThroughput * c_minThroughputGain) {
+                // Previous increase did not help. Link is saturated.
+                workers = m_lastWorkers;
+                m_ceiling = workers;
+                m_ceilingTtl = c_ceilingTtl;
+            } else if(speedup < c_targetSpeedup && workers < m_ceiling) {
+                ++workers;
+            } else if(workers > 1 && (workers - 1) / m_loadRatio >= 2 * c_targetSpeedup) {
+                --workers;
+            }
+            
+            if(m_ceilingTtl > 0 && --m_ceilingTtl == 0)
+                m_ceiling = m_maxWorkers;
+            
+            if(workers != m_workers) {
+                LogDebug("PlaylistBuffer: HLS threads %d -> %d. Load/duration ratio %0.2f, throughput %0.1f KB/s.", (int)m_workers, (int)workers, m_loadRatio, throughput / 1024);
+            }
+            // Idle epoch says nothing about link capacity.
+            m_lastThroughput = m_wasIdle ? 0.0 : throughput;
+            m_lastWorkers = m_workers;
+            m_workers = workers;
+            StartEpoch();
+            return m_workers;
+        }
+        
+    private:
+        // Load segments 1.5 times faster than playback
+        static constexpr float c_targetSpeedup = 1.5;
+        // New connection should add at least 10% of throughput
+        static constexpr float c_minThroughputGain = 1.1;
+        static constexpr float c_ratioWeight = 0.3;
+        static constexpr size_t c_minSamples = 2;
+        // Epochs to keep saturation limit
+        static constexpr int c_ceilingTtl = 20;
+        
+        void StartEpoch()
+        {
+            m_epochStart = std::chrono::system_clock::now();
+            m_bytes = 0;
+            m_samples = 0;
+            m_wasIdle = false;
+        }
+        
+        const size_t m_maxWorkers;
+        size_t m_workers;
+        size_t m_ceiling;
+        int m_ceilingTtl;
+        float m_loadRatio;
+        size_t m_lastWorkers;
+        float m_lastThroughput;
+        std::chrono::time_point<std::chrono::system_clock> m_epochStart;
+        size_t m_bytes;
+        size_t m_samples;
+        bool m_wasIdle;
+    };
+    // Bound to reference by std::max
+    constexpr size_t DownloadConcurrency::c_minSamples;
+    
     bool PlaylistBuffer::IsStopped(uint32_t timeoutInSec) {
         P8PLATFORM::CTimeout timeout(timeoutInSec * 1000);
         do{
@@ -210,39 +1506,183 @@ namespace Buffers {
         return false;
     }
     
+    uint64_t PlaylistBuffer::LoadingFocus() const
+    {
+        // Segment awaited by reader, otherwise seek target
+        const uint64_t waitingIndex = m_waitingSegmentIndex;
+        return waitingIndex != c_noSegmentIndex ? waitingIndex : m_segmentIndexAfterSeek.load();
+    }
+    
+    bool PlaylistBuffer::WaitForLoaderEvent()
+    {
+        m_loaderEvent.Wait(c_loaderIdleMs);
+        return IsStopped();
+    }
+    
+    void PlaylistBuffer::ScheduleRefresh(std::chrono::steady_clock::time_point reloadStartedAt)
+    {
+        uint32_t interval = 0;
+        {
+            CLockObject lock(m_syncAccess);
+            interval = m_cache->PlaylistRefreshIntervalMs();
+        }
+        // VOD
+        if(0 == interval)
+            return;
+        // Interval is measured from the start of last reload
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - reloadStartedAt).count();
+        const uint32_t delay = elapsed < interval ? interval - (uint32_t)elapsed : 0;
+        PlaylistRefreshScheduler::Schedule(this, delay, [this] {
+            m_isRefreshDue = true;
+            m_loaderEvent.Signal();
+        });
+    }
+    
+    bool PlaylistBuffer::RefreshPlaylistIfDue()
+    {
+        if(!m_isRefreshDue.exchange(false))
+            return true;
+        const auto startedAt = std::chrono::steady_clock::now();
+        bool isReloaded = false;
+        {
+            CLockObject lock(m_syncAccess);
+            // Playlist of seekable stream may be replaced on seek, i.e. it's reloaded under lock
+            if(m_cache->CanSeek()) {
+                if(!m_cache->ReloadPlaylist())
+                    return false;
+                isReloaded = true;
+            }
+        }
+        if(!isReloaded) {
+            // Live playlist is changed by loader thread only.
+            // Blocking reload may be held by server for a while, reader should not wait for it.
+            std::string update;
+            if(!m_cache->LoadPlaylistUpdate(update, [this] {return IsStopped();}))
+                return false;
+            CLockObject lock(m_syncAccess);
+            if(!m_cache->ApplyPlaylistUpdate(update))
+                return false;
+        }
+        // Loaders of partial segments wait for new parts
+        m_playlistUpdated.Broadcast();
+        ScheduleRefresh(startedAt);
+        return true;
+    }
+    
     void *PlaylistBuffer::Process()
     {
         using namespace progschj;
 
         bool isEof = false;
-        ThreadPool pool(s_numberOfHlsThreads);
-        pool.set_queue_size_limit(s_numberOfHlsThreads);
+        // Fixed number of threads is the fallback policy
+        const bool isAdaptive = s_adaptiveHlsThreads;
+        DownloadConcurrency concurrency(s_numberOfHlsThreads, isAdaptive ? std::max(std::thread::hardware_concurrency(), 2U) : s_numberOfHlsThreads);
+        // Pool runs the best job at the moment of execution
+        SegmentJobQueue jobs;
+        // NOTE: pool should be destroyed before concurrency controller and job queue
+        size_t poolSize = concurrency.Workers();
+        ThreadPool pool(poolSize);
+        m_loadingWindow = poolSize;
+
+        // Loader thread never blocks on pool: jobs wait in the queue for a free worker,
+        // finished worker wakes loader up to start next one.
+        auto startJobs = [this, &jobs, &pool, &poolSize] {
+            while(jobs.StartJob(poolSize)) {
+                pool.enqueue([this, &jobs] {
+                    SegmentJobQueue::TJob job;
+                    if(jobs.Pop(LoadingFocus(), job))
+                        job();
+                    jobs.JobDone();
+                    m_loaderEvent.Signal();
+                });
+            }
+        };
+
+        // Segment requested by reader from disk store is read by loader thread,
+        // disregarding to space in cache.
+        auto queueSegmentToRestore = [this, &jobs, &startJobs] {
+            MutableSegment* segmentToRestore = nullptr;
+            {
+                CLockObject lock(m_syncAccess);
+                segmentToRestore = m_cache->SegmentToRestore();
+            }
+            if(nullptr == segmentToRestore)
+                return;
+            PlaylistCache* cache = m_cache;
+            jobs.Push(segmentToRestore->info.index, [this, cache, segmentToRestore] {
+                const bool isRestored = cache->RestoreFromDisk(segmentToRestore);
+                if(IsStopped())
+                    return;
+                CLockObject lock(m_syncAccess);
+                cache->SegmentRestored(segmentToRestore, isRestored);
+                if(segmentToRestore->info.index == m_waitingSegmentIndex)
+                    m_writeEvent.Signal();
+            });
+            startJobs();
+        };
 
+        TPartProvider nextPart = [this](const MutableSegment& seg, size_t part, PartInfo& info) {
+            PartStatus status;
+            {
+                CLockObject lock(m_syncAccess);
+                status = m_cache->SegmentPart(seg.info.index, part, info);
+            }
+            // Part will be announced by following (blocking) reload
+            if(k_PartPending == status)
+                m_playlistUpdated.Wait(c_partWaitMs);
+            return status;
+        };
+
+        m_isRefreshDue = false;
+        ScheduleRefresh(std::chrono::steady_clock::now());
         try {
             int current_loader = 0;
             while (/*!isEof && */ !IsStopped()) {
                 
+                // Kodi changed playback speed (e.g. fast forward)
+                if(m_isSpeedChanged.exchange(false))
+                    ApplyPlaybackSpeed();
+                
+                queueSegmentToRestore();
+                startJobs();
+                
                 bool cacheIsFull = false;
                 MutableSegment* segment =  nullptr;
                 uint64_t segmentIdx (-1);
+                // I-frame of segment in trick-play mode
+                SegmentInfo iframe;
+                bool isTrickPlay = false;
+                // Segments are taken from cache while workers have nothing to choose from,
+                // the rest stays in cache's loading order (rebuilt on seek).
+                const bool isBacklogFull = jobs.Backlog() >= poolSize;
                 {
                     CLockObject lock(m_syncAccess);
-                    segment = m_cache->SegmentToFill();
+                    if(!isBacklogFull)
+                        segment = m_cache->SegmentToFill();
                     
                     if(nullptr != segment) {
                         segmentIdx = segment->info.index;
                         std::hash<std::thread::id> hasher;
                         LogDebug("PlaylistBuffer: segment #%" PRIu64 " INITIALIZED.", segmentIdx);
+                        isTrickPlay = m_cache->TrickPlaySource(segment, iframe);
                     }
                     // to avoid double lock in following while() loop
                     cacheIsFull = !m_cache->HasSpaceForNewSegment(segmentIdx);
+                    if((nullptr == segment && !isBacklogFull) || cacheIsFull)
+                        concurrency.LoaderIdle();
                 }
                 bool isStopped = IsStopped();
 
                 const uint64_t segmentIndexAfterSeek = m_segmentIndexAfterSeek;
                 std::function<bool(const MutableSegment&)> isSegmentCanceled = [this, segmentIndexAfterSeek](const MutableSegment& seg) {
-                    return IsStopped() || (m_segmentIndexAfterSeek != segmentIndexAfterSeek && seg.info.index != m_segmentIndexAfterSeek);
+                    if(IsStopped())
+                        return true;
+                    // After seek keep segments which would be loaded next anyway.
+                    // Others are dropped (with connection) on next read to free bandwidth for seek target.
+                    const uint64_t target = m_segmentIndexAfterSeek;
+                    return target != segmentIndexAfterSeek && (seg.info.index < target || seg.info.index >= target + m_loadingWindow);
                 };
+                bool isPlaylistFailed = false;
                 // No reason to download next segment when cache is full
                 while(cacheIsFull && !isStopped){
                     {
@@ -251,37 +1691,52 @@ namespace Buffers {
                         // Must be called in any case
                         cacheIsFull = !m_cache->HasSpaceForNewSegment(segmentIdx);
                     }
-                    // When we waiting for room in cache (e.g stream is on pause)
-                    // try to ping server to avoid connection lost
                     if(cacheIsFull) {
                         if(nullptr != segment) {
                             if(isSegmentCanceled(*segment))
                                 break;
                         }
-                        isStopped = IsStopped(1);
+                        // Live playlist is refreshed on schedule while we are waiting (e.g stream is on pause)
+                        // it also keeps connection to server alive.
+                        if(!RefreshPlaylistIfDue()) {
+                            isPlaylistFailed = true;
+                            break;
+                        }
+                        isStopped = WaitForLoaderEvent();
                         if(!isStopped) {
+                            queueSegmentToRestore();
                             LogDebug("PlaylistBuffer: waiting for space in cache...");
-                            if(nullptr != segment) {
-                                kodi::vfs::FileStatus stat;
-                                kodi::vfs::StatFile(httplib::detail::encode_get_url(segment->info.url), stat);
-                                LogDebug("Stat segment #%" PRIu64 ".", segment->info.index);
-                            }
                         }
                     }
                 };
+                if(isPlaylistFailed) {
+                    LogError("PlaylistBuffer: playlist update failed.");
+                    break;
+                }
                 
                 if(nullptr != segment){
                     if(!IsStopped() /*&& !isSegmentCanceled(*segment)*/) {
                         // Load segment data
                         
                         auto startLoadingAt = std::chrono::system_clock::now();
-                        std::function<void(bool,MutableSegment*)> segmentDone = [this, startLoadingAt](bool segmentReady, MutableSegment* seg) {
+                        std::function<void(bool,MutableSegment*)> segmentDone = [this, startLoadingAt, &concurrency, isSegmentCanceled](bool segmentReady, MutableSegment* seg) {
                             // Populate loaded segment
                             if(!IsStopped()){
+                                if(!segmentReady && isSegmentCanceled(*seg)) {
+                                    // Loader is released without waiting for stalled read
+                                    const int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+                                    LogDebug("PlaylistBuffer: segment #%" PRIu64 " is canceled in %" PRId64 " ms after seek.", seg->info.index, nowMs - m_seekedAtMs);
+                                }
+                                // Reader may copy data of this segment
+                                CLockObject streamingLock(m_streamingReadAccess);
                                 CLockObject lock(m_syncAccess);
+                                // Wake up reader only when it waits for this segment
+                                if(seg->info.index == m_waitingSegmentIndex)
+                                    m_writeEvent.Signal();
                                 if(segmentReady) {
+                                    concurrency.SegmentLoaded(seg->Size(), seg->DownloadTime(), seg->Duration());
+                                    m_streamHealth.Add(seg->StreamHealth());
                                     m_cache->SegmentReady(seg);
-                                    m_writeEvent.Signal();
                                     auto endLoadingAt = std::chrono::system_clock::now();
                                     std::chrono::duration<float> loatTime = endLoadingAt-startLoadingAt;
                                     LogDebug("PlaylistBuffer: segment #%" PRIu64 " loaded in %0.2f sec. Duration %0.2f", seg->info.index, loatTime.count(), seg->Duration());
@@ -291,23 +1746,59 @@ namespace Buffers {
                             }
                         };
 
-                        pool.enqueue(FillSegment, segment, isSegmentCanceled, segmentDone);
-                        
+                        std::function<void(const MutableSegment&)> segmentDataArrived = [this](const MutableSegment& seg) {
+                            // Reader is waiting on write frontier of this segment
+                            if(seg.info.index == m_waitingSegmentIndex)
+                                m_writeEvent.Signal();
+                        };
+                        const int numOfRanges = s_numberOfSegmentRanges;
+                        // Same amount of connections as segment loader has
+                        const size_t numOfLoaders = poolSize;
+                        SegmentMirrors* mirrors = m_mirrors.get();
+                        jobs.Push(segment->info.index, [segment, mirrors, numOfRanges, numOfLoaders, isSegmentCanceled, segmentDataArrived, segmentDone, nextPart, isTrickPlay, iframe] {
+                            if(isTrickPlay && FillTrickPlaySegment(segment, iframe, isSegmentCanceled, segmentDataArrived, segmentDone))
+                                return;
+                            if(segment->info.isPartial)
+                                FillPartialSegment(segment, nextPart, isSegmentCanceled, segmentDataArrived, segmentDone);
+                            else
+                                FillSegment(segment, mirrors, numOfRanges, numOfLoaders, isSegmentCanceled, segmentDataArrived, segmentDone);
+                        });
+                        startJobs();
                     }
                 } else {
-                    IsStopped(1);
+                    WaitForLoaderEvent();
+                }
+                // Playlist is updated on its own schedule,
+                // disregarding to amount of data to load.
+                if(!IsStopped() && !RefreshPlaylistIfDue()) {
+                    LogError("PlaylistBuffer: playlist update failed.");
+                    break;
                 }
-                // We should update playlist often, disregarding to amount of data to load
-                // Even if we have several segment to load
-                // it can take a time, and playlist will be out of sync.
+                size_t workers = concurrency.Workers();
+                size_t variant = 0;
+                bool shouldSwitchVariant = false;
                 if(!IsStopped())
                 {
                     CLockObject lock(m_syncAccess);
-                    if(!m_cache->ReloadPlaylist()) {
-                        LogError("PlaylistBuffer: playlist update failed.");
-                        break;
+                    shouldSwitchVariant = m_cache->VariantToAdapt(variant);
+                    if(isAdaptive)
+                        workers = concurrency.Adjust();
+                }
+                if(shouldSwitchVariant) {
+                    // Live playlist is changed by loader thread only,
+                    // reader should not wait for variant download.
+                    std::string data, effectiveUrl;
+                    if(m_cache->LoadVariant(variant, data, effectiveUrl, [this] {return IsStopped();})) {
+                        CLockObject lock(m_syncAccess);
+                        m_cache->SwitchToVariant(variant, data, effectiveUrl);
                     }
                 }
+                if(workers != poolSize) {
+                    poolSize = workers;
+                    pool.set_pool_size(poolSize);
+                    m_loadingWindow = poolSize;
+                    startJobs();
+                }
                 
                 //                if(!m_cache->HasSegmentsToFill()){
                 //                    IsStopped(sleepTime);
@@ -320,6 +1811,7 @@ namespace Buffers {
             LogError("PlaylistBuffer: download thread failed with error: %s", ex.what());
         }
 
+        PlaylistRefreshScheduler::Cancel(this);
         LogDebug("PlaylistBuffer: finilizing loaders pool...");
         pool.wait_until_empty();
         pool.wait_until_nothing_in_flight ();
@@ -329,6 +1821,44 @@ namespace Buffers {
         return NULL;
     }
     
+    void PlaylistBuffer::SetSpeed(int speed)
+    {
+        if(m_speed.exchange(speed) == speed)
+            return;
+        LogDebug("PlaylistBuffer: playback speed %d.", speed);
+        m_isSpeedChanged = true;
+        m_loaderEvent.Signal();
+    }
+    
+    void PlaylistBuffer::ApplyPlaybackSpeed()
+    {
+        const int speed = m_speed;
+        const bool isTrickPlay = speed >= c_trickPlaySpeed || speed <= -c_trickPlaySpeed;
+        CLockObject lock(m_syncAccess);
+        if(!m_cache->SetTrickPlay(isTrickPlay))
+            LogDebug("PlaylistBuffer: trick-play is not available. Loading whole segments at speed %d.", speed);
+    }
+    
+    bool PlaylistBuffer::WaitForSegmentData(uint32_t& timeoutMs)
+    {
+        // NOTE: timeout is set by Timeshift buffer
+        // Do not change it! May cause long waiting on stopping/exit.
+        bool hasNewData = false;
+        do {
+            auto startAt = std::chrono::system_clock::now();
+            hasNewData = m_writeEvent.Wait(1000);
+            auto waitingMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - startAt);
+            timeoutMs -= waitingMs.count();
+            
+        } while (IsRunning() && !IsStopped() && !hasNewData && timeoutMs > 1000);
+        if(timeoutMs < 1000)
+        {
+            LogError("PlaylistBuffer: segment loading  timeout!");
+            return false;
+        }
+        return true;
+    }
+    
     ssize_t PlaylistBuffer::Read(unsigned char *buffer, size_t bufferSize, uint32_t timeoutMs)
     {
      
@@ -348,7 +1878,13 @@ namespace Buffers {
             {
                 {
                     CLockObject lock(m_syncAccess);
-                    m_currentSegment = m_cache->NextSegment(segmentStatus);
+                    uint64_t segmentIndex = 0;
+                    m_currentSegment = m_cache->NextSegment(segmentStatus, segmentIndex);
+                    // Loader will signal when this segment is done
+                    m_waitingSegmentIndex = (nullptr == m_currentSegment) ? m_cache->CurrentSegmentIndex() : c_noSegmentIndex;
+                    if((m_isStreamingSegment = PlaylistCache::k_SegmentStatus_Streaming == segmentStatus)) {
+                        m_streamingSegmentIndex = segmentIndex;
+                    }
                 }
                 if( nullptr == m_currentSegment) {
                     if((isEof = PlaylistCache::k_SegmentStatus_EOF == segmentStatus)) {
@@ -358,26 +1894,15 @@ namespace Buffers {
                     if(PlaylistCache::k_SegmentStatus_Loading == segmentStatus ||
                        PlaylistCache::k_SegmentStatus_CacheEmpty == segmentStatus)
                     {
-                        if(!IsRunning()){
+                        if(!IsRunning() || IsStopped()){
                             LogDebug("PlaylistBuffer: not running (aka stopping) ...");
                             break;
                         }
-                        LogDebug("PlaylistBuffer: waiting for segment loading (max %d ms)...", timeoutMs);
-                        // NOTE: timeout is set by Timeshift buffer
-                        // Do not change it! May cause long waiting on stopping/exit.
-                        bool hasNewSegment = false;
-                        do {
-                            auto startAt = std::chrono::system_clock::now();
-                            hasNewSegment = m_writeEvent.Wait(1000);
-                            auto waitingMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - startAt);
-                            timeoutMs -= waitingMs.count();
-                            
-                        } while (IsRunning() && !hasNewSegment && timeoutMs > 1000);
-                        if(timeoutMs < 1000)
-                        {
-                            LogError("PlaylistBuffer: segment loading  timeout!");
+                        LogDebug("PlaylistBuffer: waiting for segment #%" PRIu64 " loading (max %d ms)...", (uint64_t)m_waitingSegmentIndex, timeoutMs);
+                        // Segment may be queued for loading (or restoring from disk) just now
+                        m_loaderEvent.Signal();
+                        if(!WaitForSegmentData(timeoutMs))
                             break;
-                        }
                     } else {
                         LogError("PlaylistBuffer: segment not found. Reason %d.", segmentStatus);
                         break;
@@ -392,6 +1917,54 @@ namespace Buffers {
                 LogDebug("PlaylistBuffer: no segment for read.");
                 break;
             }
+            if(m_isStreamingSegment) {
+                // Segment is loading. Failed segment is freed by loader,
+                // i.e. data is copied under streaming lock (cache is not locked).
+                bool isFailed = false;
+                bool isAtWriteFrontier = false;
+                {
+                    CLockObject streamingLock(m_streamingReadAccess);
+                    bool isLoaded = false;
+                    {
+                        CLockObject lock(m_syncAccess);
+                        const MutableSegment* segment = m_cache->FindSegment(m_streamingSegmentIndex);
+                        isFailed = segment != m_currentSegment || (!segment->IsLoading() && !segment->IsValid());
+                        // Whole data is published before segment is valid
+                        isLoaded = !isFailed && segment->IsValid();
+                        // Publish awaited segment before reading to not miss loader's signal
+                        if(!isFailed)
+                            m_waitingSegmentIndex = m_streamingSegmentIndex;
+                    }
+                    if(!isFailed) {
+                        const size_t bytesRead = m_currentSegment->Read(buffer + totalBytesRead, bufferSize - totalBytesRead);
+                        totalBytesRead += bytesRead;
+                        m_position += bytesRead;
+                        isAtWriteFrontier = m_currentSegment->BytesReady() == 0;
+                        if(isLoaded) {
+                            // Loading is done. Continue as with loaded segment.
+                            m_isStreamingSegment = false;
+                        }
+                        if(!isAtWriteFrontier || !m_isStreamingSegment)
+                            m_waitingSegmentIndex = c_noSegmentIndex;
+                    }
+                }
+                if(isFailed) {
+                    LogError("PlaylistBuffer: streaming segment #%" PRIu64 " failed. Moving next...", m_streamingSegmentIndex);
+                    m_waitingSegmentIndex = c_noSegmentIndex;
+                    m_isStreamingSegment = false;
+                    m_currentSegment = nullptr;
+                    continue;
+                }
+                if(m_isStreamingSegment) {
+                    if(!isAtWriteFrontier)
+                        continue;
+                    // NOTE: short read is treated as stream failure by caller,
+                    // i.e. block on write frontier until buffer is full
+                    if(!IsRunning() || IsStopped() || !WaitForSegmentData(timeoutMs))
+                        break;
+                    continue;
+                }
+            }
             size_t bytesToRead = bufferSize - totalBytesRead;
             size_t bytesRead;
             do {
@@ -407,12 +1980,77 @@ namespace Buffers {
             }
             
 
+        }
+        if(totalBytesRead > 0 && m_isFirstByteRequested) {
+            m_isFirstByteRequested = false;
+            auto ttfb = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_firstByteRequestedAt);
+            LogNotice("PlaylistBuffer: time to first byte %d ms.", (int)ttfb.count());
         }
         m_isWaitingForRead = false;
         return !isEof && !IsStopped() ?  totalBytesRead : -1;
     }
     
+    bool PlaylistBuffer::CanReadSegments() const
+    {
+        CLockObject lock(m_syncAccess);
+        return !m_cache->CanSeek();
+    }
+    
+    ssize_t PlaylistBuffer::ReadSegment(TSegmentData& data, uint32_t timeoutMs)
+    {
+        data.reset();
+        if(IsStopped()) {
+            LogError("PlaylistBuffer: write thread is not running.");
+            return -1;
+        }
+        m_isWaitingForRead = true;
+        // Whole ready segment is taken from cache when nothing is read from it yet.
+        // Otherwise (partially read or first segment of stream) data is copied,
+        // up to the end of current segment.
+        while(nullptr == m_currentSegment && !m_isFirstByteRequested) {
+            {
+                CLockObject lock(m_syncAccess);
+                data = m_cache->TakeNextSegment();
+                m_waitingSegmentIndex = (nullptr == data) ? m_cache->CurrentSegmentIndex() : c_noSegmentIndex;
+            }
+            if(nullptr != data) {
+                // Skip empty (failed) segment
+                if(0 == data->Size())
+                    continue;
+                m_position += data->Size();
+                m_isWaitingForRead = false;
+                return data->Size();
+            }
+            if(!IsRunning() || IsStopped()) {
+                m_isWaitingForRead = false;
+                return -1;
+            }
+            if(!WaitForSegmentData(timeoutMs)) {
+                m_waitingSegmentIndex = c_noSegmentIndex;
+                m_isWaitingForRead = false;
+                return 0;
+            }
+        }
+        m_isWaitingForRead = false;
+        
+        size_t bytesToRead = SegmentBlockPool::BLOCK_SIZE;
+        if(nullptr != m_currentSegment && m_currentSegment->BytesReady() > 0)
+            bytesToRead = std::min(bytesToRead, m_currentSegment->BytesReady());
+        uint8_t* block = SegmentBlockPool::Acquire();
+        const ssize_t bytesRead = Read(block, bytesToRead, timeoutMs);
+        if(bytesRead <= 0) {
+            SegmentBlockPool::Release(block);
+            return bytesRead;
+        }
+        std::vector<uint8_t*> blocks(1, block);
+        data.reset(new SegmentData(std::move(blocks), bytesRead));
+        return bytesRead;
+    }
+    
     void PlaylistBuffer::AbortRead(){
+        // Raise stop flag and wake up reader without waiting for loaders
+        P8PLATFORM::CThread::StopThread(-1);
+        m_writeEvent.Signal();
         StopThread();
         while(m_isWaitingForRead) {
             LogDebug("PlaylistBuffer: waiting for readidng abort 100 ms...");
@@ -421,6 +2059,13 @@ namespace Buffers {
         }
     }
 
+    bool PlaylistBuffer::GetStreamHealth(TsStreamHealth& health) const
+    {
+        CLockObject lock(m_syncAccess);
+        health = m_streamHealth;
+        return true;
+    }
+
     bool PlaylistBuffer::SwitchStream(const std::string &newUrl)
     {
         bool succeeded = false;
@@ -437,6 +2082,18 @@ namespace Buffers {
     
     int64_t PlaylistBuffer::GetLength() const
     {
+        if(!m_cache->CanSeek())
+            return -1;
+        {
+            CLockObject lock(m_syncAccess);
+            const int64_t length = m_cache->Length();
+            if(length >= 0)
+                return length;
+        }
+        // Bitrate is calculated by loader, don't wait under lock
+        if(!m_cache->WaitForBitrate())
+            return -1;
+        CLockObject lock(m_syncAccess);
         return m_cache->Length();
     }
     
@@ -489,11 +2146,17 @@ namespace Buffers {
                 LogDebug("PlaylistBuffer: cache failed to prepare for seek to pos %" PRId64 "", iPosition);
                 return -1;
             }
+            m_seekedAtMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
             m_segmentIndexAfterSeek = nextSegmentIndex;
         }
+        // Don't let loader sleep, seek target should be queued ASAP
+        m_loaderEvent.Signal();
         
         m_currentSegment = nullptr;
+        m_isStreamingSegment = false;
         m_position = iPosition;
+        m_firstByteRequestedAt = std::chrono::steady_clock::now();
+        m_isFirstByteRequested = true;
         return m_position;
     }
     
@@ -502,6 +2165,10 @@ namespace Buffers {
         LogDebug("PlaylistBuffer: terminating loading thread...");
         int stopCounter = 0;
         bool retVal = false;
+        // Loader may sleep till next playlist refresh
+        this->CThread::StopThread(-1);
+        m_loaderEvent.Signal();
+        m_playlistUpdated.Broadcast();
         while(!(retVal = this->CThread::StopThread(iWaitMs))){
             if(++stopCounter > 3)
                 break;
@@ -27,21 +27,27 @@
 #include <string>
 #include <vector>
 #include <list>
+#include <chrono>
+#include <atomic>
+#include <memory>
 #include "p8-platform/threads/threads.h"
 #include "p8-platform/util/buffer.h"
 #include "input_buffer.h"
 #include "plist_buffer_delegate.h"
+#include "ts_packet_filter.hpp"
 
 namespace Buffers
 {
     class Segment;
     class MutableSegment;
     class PlaylistCache;
+    class SegmentMirrors;
     
     class PlaylistBuffer :  public InputBuffer, public P8PLATFORM::CThread
     {
     public:
-        PlaylistBuffer(const std::string &streamUrl,  PlaylistBufferDelegate delegate, bool seekForVod);
+        // Segments failed on stream are requested from mirrors (alternative playlist URLs)
+        PlaylistBuffer(const std::string &streamUrl,  PlaylistBufferDelegate delegate, bool seekForVod, const std::vector<std::string>& mirrors = std::vector<std::string>());
         ~PlaylistBuffer();
         
         const std::string& GetUrl() const { return m_url; };
@@ -49,9 +55,21 @@ namespace Buffers
         int64_t GetPosition() const;
         int64_t Seek(int64_t iPosition, int iWhence);
         ssize_t Read(unsigned char *buffer, size_t bufferSize, uint32_t timeoutMs);
+        // Live stream only. Ready segments are passed without copy.
+        bool CanReadSegments() const;
+        ssize_t ReadSegment(TSegmentData& data, uint32_t timeoutMs);
         bool SwitchStream(const std::string &newUrl);
         void AbortRead();
+        bool GetStreamHealth(TsStreamHealth& health) const;
+        // Fast forward/rewind of seekable stream loads I-frames only (when stream has I-frame rendition)
+        void SetSpeed(int speed);
         static int SetNumberOfHlsTreads(int numOfTreads);
+        // When enabled, number of HLS threads is the initial value only.
+        static void SetAdaptiveHlsThreads(bool enable);
+        // Large segments are downloaded by concurrent HTTP byte ranges (1 - disabled)
+        static int SetNumberOfSegmentRanges(int numOfRanges);
+        // Live HLS starts this amount of segments from the end of playlist (0 - from the beginning)
+        static int SetLiveStartSegments(int numOfSegments);
         /*!
          * @brief Stop the thread
          * @param iWaitMs negative = don't wait, 0 = infinite, or the amount of ms to wait
@@ -60,15 +78,48 @@ namespace Buffers
         
     private:
         mutable P8PLATFORM::CMutex m_syncAccess;
+        // Held by reader while it copies data of loading segment (without cache lock),
+        // loader takes it before m_syncAccess to free failed segment.
+        P8PLATFORM::CMutex m_streamingReadAccess;
+        // Signaled when segment awaited by reader is ready (or failed)
         mutable P8PLATFORM::CEvent m_writeEvent;
+        // Index of segment awaited by reader, c_noSegmentIndex when reader is not waiting
+        // (checked by loaders on each portion of data)
+        std::atomic<uint64_t> m_waitingSegmentIndex;
+        // Current segment is read while loading
+        bool m_isStreamingSegment;
+        uint64_t m_streamingSegmentIndex;
+        // Time to first byte after stream start or seek
+        std::chrono::steady_clock::time_point m_firstByteRequestedAt;
+        bool m_isFirstByteRequested;
+        // Sum of loaded segments counters
+        TsStreamHealth m_streamHealth;
+        // Set by refresh scheduler, loader reloads live playlist
+        std::atomic<bool> m_isRefreshDue;
+        // Wakes up loader thread (refresh is due or stop)
+        P8PLATFORM::CEvent m_loaderEvent;
+        // Broadcasted after each playlist reload (new parts of low-latency stream)
+        P8PLATFORM::CEvent m_playlistUpdated;
         PlaylistBufferDelegate m_delegate;
         int64_t m_position;
         PlaylistCache* m_cache;
         Segment* m_currentSegment;
-        uint64_t m_segmentIndexAfterSeek;
+        // Checked by loaders to cancel segments far from seek target
+        std::atomic<uint64_t> m_segmentIndexAfterSeek;
+        // Steady clock (ms) of last seek, cancellation latency is logged
+        std::atomic<int64_t> m_seekedAtMs;
+        // Amount of segments loaded concurrently
+        std::atomic<size_t> m_loadingWindow;
+        std::unique_ptr<SegmentMirrors> m_mirrors;
+        // Playback speed set by Kodi, applied by loader thread
+        std::atomic<int> m_speed;
+        std::atomic<bool> m_isSpeedChanged;
         std::string m_url;
         const bool m_seekForVod;
         static int s_numberOfHlsThreads;
+        static bool s_adaptiveHlsThreads;
+        static int s_numberOfSegmentRanges;
+        static int s_liveStartSegments;
         bool m_isWaitingForRead;
 
         void *Process();
@@ -76,6 +127,17 @@ namespace Buffers
 //        bool FillSegment(MutableSegment* segment);
 //        bool FillSegmentFromPlaylist(MutableSegment* segment, const std::string& content);
         bool IsStopped(uint32_t timeoutInSec = 0);
+        // Index of segment to load first
+        uint64_t LoadingFocus() const;
+        // Sleeps until refresh is due (or idle timeout). True when stopped.
+        bool WaitForLoaderEvent();
+        void ScheduleRefresh(std::chrono::steady_clock::time_point reloadStartedAt);
+        // Reloads live playlist when it's time. False on failure.
+        bool RefreshPlaylistIfDue();
+        // Switches trick-play mode of cache according to playback speed
+        void ApplyPlaybackSpeed();
+        // Waits for signal of awaited segment. False on timeout.
+        bool WaitForSegmentData(uint32_t& timeoutMs);
     };
     
     class PlistBufferException : public InputBufferException
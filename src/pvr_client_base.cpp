@@ -50,7 +50,12 @@
 #include "timeshift_buffer.h"
 #include "file_cache_buffer.hpp"
 #include "memory_cache_buffer.hpp"
+#include "segment_cache_buffer.hpp"
+#include "ring_cache_buffer.hpp"
 #include "plist_buffer.h"
+#include "segment_disk_store.hpp"
+#include "playlist_cache.hpp"
+#include "segment_mirrors.hpp"
 #include "direct_buffer.h"
 #include "simple_cyclic_buffer.hpp"
 #include "helpers.h"
@@ -138,6 +143,8 @@ static void CleanupTimeshiftDirectory(const std::string& path){
             LogError( "Failed obtain content of timeshift folder %s", path.c_str());
         }
     }
+    // Archive segments evicted from memory are spilled to the same folder
+    Buffers::SegmentDiskStore::SetFolder(path);
 }
 
 static void CheckRecordingsPath(const std::string& path){
@@ -366,6 +373,13 @@ bool PVRClientBase::CanSeekStream()
     return IsTimeshiftEnabled();
 }
 
+void PVRClientBase::SetSpeed(int speed)
+{
+    // Fast forward/rewind of archive may load I-frames only
+    if(m_recordBuffer.buffer)
+        m_recordBuffer.buffer->SetSpeed(speed);
+}
+
 bool PVRClientBase::IsRealTimeStream(void)
 {
     // Archive is not RTS
@@ -442,6 +456,14 @@ PVR_ERROR PVRClientBase::SignalStatus(int /*channelUid*/, kodi::addon::PVRSignal
     if(nullptr != m_inputBuffer) {
         signalStatus.SetSignal(m_inputBuffer->FillingRatio() * 	0xFFFF);
 //        signalStatus.iSNR = m_inputBuffer->GetSpeedRatio() * 0xFFFF;
+        // Stream health: share of clean TS packets and amount of corrupted ones
+        Buffers::TsStreamHealth health;
+        if(m_inputBuffer->GetStreamHealth(health)) {
+            const uint64_t corrupted = health.droppedBytes / Buffers::TsPacketFilter::PACKET_SIZE + health.continuityErrors;
+            const uint64_t total = health.packets + corrupted;
+            signalStatus.SetSNR(total > 0 ? (int)(0xFFFF * health.packets / total) : 0xFFFF);
+            signalStatus.SetUNC((long)corrupted);
+        }
     }
     return PVR_ERROR_NO_ERROR;
 }
@@ -588,11 +610,11 @@ std::string PVRClientBase::GetLiveUrl() const {
     
 }
 
-InputBuffer*  PVRClientBase::BufferForUrl(const std::string& url )
+InputBuffer*  PVRClientBase::BufferForUrl(const std::string& url, const Channel::UrlList& mirrors)
 {
     InputBuffer* buffer = NULL;
     if(IsHlsUrl(url))
-        buffer = new Buffers::PlaylistBuffer(url, nullptr, false); // No segments cache for live playlist
+        buffer = new Buffers::PlaylistBuffer(url, nullptr, false, mirrors); // No segments cache for live playlist
     else
         buffer = new DirectBuffer(url);
     return buffer;
@@ -605,6 +627,21 @@ std::string PVRClientBase::GetStreamUrl(ChannelId channel)
     return  m_clientCore->GetUrl(channel);
 }
 
+Channel::UrlList PVRClientBase::GetStreamMirrors(ChannelId channelId, const std::string& url)
+{
+    Channel::UrlList mirrors;
+    if(!IsHlsUrl(url))
+        return mirrors;
+    const auto& channels = GetChannelListWhenLutsReady();
+    if(channels.count(channelId) == 0)
+        return mirrors;
+    for (const auto& mirror : channels.at(channelId).Urls) {
+        if(mirror != url && IsHlsUrl(mirror))
+            mirrors.push_back(mirror);
+    }
+    return mirrors;
+}
+
 bool PVRClientBase::OpenLiveStream(const kodi::addon::PVRChannel& channel)
 {
     auto phase =  m_clientCore->GetPhase(IClientCore::k_ChannelsLoadingPhase);
@@ -638,11 +675,20 @@ bool PVRClientBase::OpenLiveStream(const kodi::addon::PVRChannel& channel)
 
 }
 
-Buffers::ICacheBuffer* PVRClientBase::CreateLiveCache() const {
+Buffers::ICacheBuffer* PVRClientBase::CreateLiveCache(const std::string& url) const {
     if (IsTimeshiftEnabled()){
         if(k_TimeshiftBufferFile == TypeOfTimeshiftBuffer()) {
             return new Buffers::FileCacheBuffer(m_cacheDir, TimeshiftBufferSize() /  Buffers::FileCacheBuffer::CHUNK_FILE_SIZE_LIMIT);
+        } else if(IsHlsUrl(url)) {
+            // Keeps loaded segments by reference
+            return new Buffers::SegmentCacheBuffer(TimeshiftBufferSize());
         } else {
+            // Whole ring is allocated at once
+            try {
+                return new Buffers::RingCacheBuffer(TimeshiftBufferSize());
+            } catch (std::exception& ex) {
+                LogError("PVRClientBase: failed to allocate timeshift ring (%s). Using chunked memory cache.", ex.what());
+            }
             return new Buffers::MemoryCacheBuffer(TimeshiftBufferSize() /  Buffers::MemoryCacheBuffer::CHUNK_SIZE_LIMIT);
         }
     }
@@ -669,9 +715,9 @@ bool PVRClientBase::OpenLiveStream(ChannelId channelId, const std::string& url )
         return false;
     try
     {
-        InputBuffer* buffer = BufferForUrl(url);
+        InputBuffer* buffer = BufferForUrl(url, GetStreamMirrors(channelId, url));
        
-        Buffers::TimeshiftBuffer* inputBuffer = new Buffers::TimeshiftBuffer(buffer, CreateLiveCache());
+        Buffers::TimeshiftBuffer* inputBuffer = new Buffers::TimeshiftBuffer(buffer, CreateLiveCache(url));
         
         // Wait for first data from live stream
         auto startAt = std::chrono::system_clock::now();
@@ -1472,7 +1518,7 @@ bool PVRClientBase::StopRecordingFor(kodi::addon::PVRTimer &timer)
     // merge live buffer with local recording
     if(m_liveChannelId == channelId){
         //CLockObject lock(m_mutex);
-        m_inputBuffer->SwapCache(CreateLiveCache());
+        m_inputBuffer->SwapCache(CreateLiveCache(GetLiveUrl()));
         m_localRecordBuffer = nullptr;
     } else {
         if(m_localRecordBuffer) {
@@ -1594,11 +1640,17 @@ static void NotifyClearPvrData(std::function<const T&()>) {
 static const std::string c_curlTimeout = "curl_timeout";
 static const std::string c_channelReloadTimeout = "channel_reload_timeout";
 static const std::string c_numOfHlsThreads = "num_of_hls_threads";
+static const std::string c_adaptiveHlsThreads = "adaptive_hls_threads";
+static const std::string c_numOfSegmentRanges = "num_of_hls_segment_ranges";
+static const std::string c_liveStartSegments = "live_hls_start_segments";
+static const std::string c_hedgedHlsRequests = "hedged_hls_requests";
 static const std::string c_enableTimeshift = "enable_timeshift";
 static const std::string c_timeshiftPath = "timeshift_path";
 static const std::string c_recordingPath = "recordings_path";
 static const std::string c_timeshiftSize = "timeshift_size";
 static const std::string c_cacheSizeLimit = "timeshift_off_cache_limit";
+static const std::string c_archiveDiskCacheSize = "archive_disk_cache_size";
+static const std::string c_hlsCacheMemoryLimit = "hls_cache_memory_limit";
 static const std::string c_timeshiftType = "timeshift_type";
 static const std::string c_rpcLocalPort = "rpc_local_port";
 static const std::string c_rpcUser = "rpc_user";
@@ -1634,11 +1686,17 @@ void PVRClientBase::InitSettings()
     .Add(c_curlTimeout, 15, CurlUtils::SetCurlTimeout)
     .Add(c_channelReloadTimeout, 5)
     .Add(c_numOfHlsThreads, 1, Buffers::PlaylistBuffer::SetNumberOfHlsTreads)
+    .Add(c_adaptiveHlsThreads, false, Buffers::PlaylistBuffer::SetAdaptiveHlsThreads)
+    .Add(c_numOfSegmentRanges, 1, Buffers::PlaylistBuffer::SetNumberOfSegmentRanges)
+    .Add(c_liveStartSegments, 0, Buffers::PlaylistBuffer::SetLiveStartSegments)
+    .Add(c_hedgedHlsRequests, false, Buffers::SegmentMirrors::SetHedgedRequests)
     .Add(c_enableTimeshift, false)
     .Add(c_timeshiftPath, s_DefaultCacheDir, CleanupTimeshiftDirectory)
     .Add(c_recordingPath, s_DefaultRecordingsDir, CheckRecordingsPath)
     .Add(c_timeshiftSize, 0)
     .Add(c_cacheSizeLimit, 0)
+    .Add(c_archiveDiskCacheSize, 0, Buffers::SegmentDiskStore::SetSizeLimitInMb)
+    .Add(c_hlsCacheMemoryLimit, 256, Buffers::PlaylistCache::SetMemoryLimitInMb)
     .Add(c_timeshiftType, (int)k_TimeshiftBufferMemory)
     .Add(c_rpcLocalPort, 8080, ADDON_STATUS_NEED_RESTART)
     .Add(c_channelIndexOffset, 0, ADDON_STATUS_NEED_RESTART)
@@ -63,6 +63,7 @@ namespace PvrClient
         bool CanPauseStream() override;
         bool CanSeekStream() override;
         bool IsRealTimeStream(void) override;
+        void SetSpeed(int speed) override;
         PVR_ERROR GetStreamTimes(kodi::addon::PVRStreamTimes& times) override;
 
         int GetChannelsAmount() override;
@@ -129,6 +130,8 @@ namespace PvrClient
 
         virtual std::string GetStreamUrl(ChannelId channelId);
         virtual std::string GetNextStreamUrl(ChannelId channelId) {return std::string();}
+        // Alternative HLS URLs of channel's stream, used for segment level failover
+        virtual Channel::UrlList GetStreamMirrors(ChannelId channelId, const std::string& url);
         virtual void OnOpenStremFailed(PvrClient::ChannelId channelId, const std::string& streamUrl) {}
         ChannelId GetLiveChannelId() const { return  m_liveChannelId;}
         std::string GetLiveUrl() const;
@@ -204,9 +207,10 @@ namespace PvrClient
         void FillRecording(const EpgEntryList::value_type& epgEntry, kodi::addon::PVRRecording& tag, const char* dirPrefix);
         std::string DirectoryForRecording(unsigned int epgId) const;
         std::string PathForRecordingInfo(unsigned int epgId) const;
-        static Buffers::InputBuffer*  BufferForUrl(const std::string& url );
+        static Buffers::InputBuffer*  BufferForUrl(const std::string& url, const Channel::UrlList& mirrors = Channel::UrlList());
         bool OpenLiveStream(ChannelId channelId, const std::string& url );
-        Buffers::ICacheBuffer* CreateLiveCache() const;
+        // Cache of live stream (url defines type of memory cache)
+        Buffers::ICacheBuffer* CreateLiveCache(const std::string& url) const;
 
         void ScheduleRecordingsUpdate();
         void SeekKodiPlayerAsyncToOffset(int offsetInSeconds, std::function<void(bool done)> result);
@@ -0,0 +1,192 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#define NOMINMAX
+#include <algorithm>
+#include <string.h>
+#include <time.h>
+#include "ring_cache_buffer.hpp"
+#include "globals.hpp"
+
+namespace Buffers
+{
+    using namespace Globals;
+    
+    static const uint64_t c_minCapacity = 2 * 1024 * 1024;
+    static const uint64_t c_maxCapacity = sizeof(size_t) > 4 ? (uint64_t(1) << 40) : (uint64_t(1) << 30);
+    // Oldest data is freed one MByte before max size (at most)
+    static const size_t c_maxFreeThreshold = 1024 * 1024;
+    
+    static size_t RingCapacityFor(uint64_t maxSize) {
+        maxSize = std::min(std::max(maxSize, c_minCapacity), c_maxCapacity);
+        uint64_t capacity = c_minCapacity;
+        while(capacity * 2 <= maxSize)
+            capacity *= 2;
+        return capacity;
+    }
+    
+    RingCacheBuffer::RingCacheBuffer(uint64_t maxSize)
+    : m_capacity(RingCapacityFor(maxSize))
+    , m_mask(m_capacity - 1)
+    , m_freeThreshold(std::min(c_maxFreeThreshold, m_capacity / 8))
+    , m_ring(new uint8_t[m_capacity + UNIT_SIZE])
+    , m_length(0)
+    , m_position(0)
+    , m_begin(0)
+    , m_lockedUnit(nullptr)
+    , m_firstWriteTime(0)
+    , m_endTime(0)
+    {
+        LogDebug("RingCacheBuffer: %zu bytes ring allocated.", m_capacity);
+    }
+    
+    void RingCacheBuffer::Init() {
+        m_length = 0;
+        m_position = 0;
+        m_begin = 0;
+        m_lockedUnit = nullptr;
+        m_firstWriteTime = 0;
+        m_endTime = 0;
+    }
+    
+    uint32_t RingCacheBuffer::UnitSize() {
+        return UNIT_SIZE;
+    }
+    
+    // Seak read position within cache window
+    int64_t RingCacheBuffer::Seek(int64_t iPosition, int iWhence) {
+        const int64_t length = m_length.load(std::memory_order_acquire);
+        const int64_t begin = m_begin.load(std::memory_order_relaxed);
+        
+        // Translate position to offset from start of buffer.
+        if(iWhence == SEEK_CUR) {
+            iPosition = m_position + iPosition;
+        } else if(iWhence == SEEK_END) {
+            iPosition = length + iPosition;
+        }
+        if(iPosition > length) {
+            iPosition = length;
+        }
+        if(iPosition < begin) {
+            iPosition = begin;
+        }
+        m_position.store(iPosition, std::memory_order_release);
+        LogDebug("RingCacheBuffer::Seek. Begin %lld Length %lld Result pos %lld", begin, length, iPosition);
+        return iPosition;
+    }
+    
+    // Virtual steream lenght.
+    int64_t RingCacheBuffer::Length() {
+        return m_length.load(std::memory_order_acquire);
+    }
+    
+    // Current read position
+    int64_t RingCacheBuffer::Position() {
+        return m_position.load(std::memory_order_acquire);
+    }
+    
+    // Reads data from Position(),
+    ssize_t RingCacheBuffer::Read(void* buffer, size_t bufferSize) {
+        const int64_t length = m_length.load(std::memory_order_acquire);
+        int64_t position = m_position.load(std::memory_order_relaxed);
+        
+        const size_t bytesToRead = (size_t) std::max<int64_t>(0, std::min<int64_t>(bufferSize, length - position));
+        if(bytesToRead > 0) {
+            // Copy data across the end of ring
+            const size_t offset = position & m_mask;
+            const size_t firstPart = std::min(bytesToRead, m_capacity - offset);
+            memcpy(buffer, m_ring + offset, firstPart);
+            if(firstPart < bytesToRead)
+                memcpy(((uint8_t*)buffer) + firstPart, m_ring, bytesToRead - firstPart);
+            position += bytesToRead;
+            m_position.store(position, std::memory_order_release);
+        }
+        // Free oldest data before read position, when ring is almost full.
+        const int64_t maxUsed = m_capacity - m_freeThreshold;
+        const int64_t begin = m_begin.load(std::memory_order_relaxed);
+        if(length - begin > maxUsed) {
+            const int64_t newBegin = std::min(position, length - maxUsed);
+            if(newBegin > begin)
+                m_begin.store(newBegin, std::memory_order_release);
+        }
+        return bytesToRead;
+    }
+    
+    // Write interface
+    bool RingCacheBuffer::LockUnitForWrite(uint8_t** pBuf) {
+        if(pBuf == nullptr) {
+            LogError("Error: RingCacheBuffer::LockUnitForWrite() null pointer for buffer. ");
+            return false;
+        }
+        *pBuf = nullptr;
+        if(m_lockedUnit != nullptr) {
+            LogError("Error: RingCacheBuffer::LockUnitForWrite() uinit already locked.");
+            return false;
+        }
+        const int64_t length = m_length.load(std::memory_order_relaxed);
+        const int64_t begin = m_begin.load(std::memory_order_acquire);
+        // No room for new data
+        if(length - begin + UNIT_SIZE > (int64_t)m_capacity)
+            return false;
+        if(0 == length)
+            m_firstWriteTime = time(NULL);
+        m_lockedUnit = m_ring + (length & m_mask);
+        *pBuf = m_lockedUnit;
+        return true;
+    }
+    
+    void RingCacheBuffer::UnlockAfterWriten(uint8_t* pBuf, ssize_t writtenBytes) {
+        if(m_lockedUnit == nullptr){
+            LogError("Error: RingCacheBuffer::UnlockAfterWriten() no locked unit.");
+            return;
+        }
+        if(m_lockedUnit != pBuf) {
+            LogError("Error: RingCacheBuffer::UnlockAfterWriten() wrong buffer to unlock.");
+            m_lockedUnit = nullptr;
+            return;
+        }
+        const size_t byteToUnlock = writtenBytes < 0  ? UNIT_SIZE : std::min<size_t>(writtenBytes, UNIT_SIZE);
+        // Move overflow to the ring start
+        const size_t offset = m_lockedUnit - m_ring;
+        if(offset + byteToUnlock > m_capacity)
+            memcpy(m_ring, m_ring + m_capacity, offset + byteToUnlock - m_capacity);
+        m_lockedUnit = nullptr;
+        m_endTime = time(NULL);
+        m_length.store(m_length.load(std::memory_order_relaxed) + byteToUnlock, std::memory_order_release);
+    }
+    
+    time_t RingCacheBuffer::StartTime() const {
+        // Start of cache window at average bitrate
+        const int64_t length = m_length.load(std::memory_order_acquire);
+        const int64_t begin = m_begin.load(std::memory_order_acquire);
+        const time_t firstWriteTime = m_firstWriteTime;
+        if(0 == length)
+            return firstWriteTime;
+        return firstWriteTime + (time_t)((double)begin * (m_endTime - firstWriteTime) / length);
+    }
+    
+    RingCacheBuffer::~RingCacheBuffer(){
+        delete[] m_ring;
+    }
+    
+} // namespace
@@ -0,0 +1,86 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef __ring_cache_buffer_hpp__
+#define __ring_cache_buffer_hpp__
+
+#include <atomic>
+#include "cache_buffer.h"
+
+namespace Buffers
+{
+    // Memory timeshift on single preallocated ring.
+    // Lock-free for exactly one writer and one reader thread:
+    // writer publishes stream length, reader publishes read position and start of cache window.
+    // Oldest data is dropped by reader (behind read position) when ring is almost full,
+    // writer does not wait, LockUnitForWrite() just fails when there is no room.
+    class RingCacheBuffer : public ICacheBuffer
+    {
+    public:
+        static const uint32_t UNIT_SIZE = 1024 * 32; // 32K input read buffer
+        
+        // Ring capacity is maxSize rounded down to power of two
+        RingCacheBuffer(uint64_t maxSize);
+        
+        virtual  void Init();
+        virtual  uint32_t UnitSize();
+        
+        // Read interface
+        // Seak read position within cache window
+        virtual int64_t Seek(int64_t iFilePosition, int iWhence) ;
+        // Virtual steream lenght.
+        virtual int64_t Length();
+        // Current read position
+        virtual int64_t Position();
+        // Reads data from Position(),
+        virtual ssize_t Read(void* lpBuf, size_t uiBufSize);
+        
+        // Write interface
+        virtual bool LockUnitForWrite(uint8_t** pBuf);
+        virtual void UnlockAfterWriten(uint8_t* pBuf, ssize_t writtenBytes = -1);
+        
+        virtual time_t StartTime() const;
+        virtual time_t EndTime() const {return m_endTime;}
+        virtual float FillingRatio() const {return (float)(m_length - m_position)/ m_capacity; }
+        
+        ~RingCacheBuffer();
+        
+    private:
+        const size_t m_capacity;
+        const size_t m_mask;
+        // Reader keeps this amount of free space for writer
+        const size_t m_freeThreshold;
+        // Unit locked at the end of ring overflows to extra UNIT_SIZE bytes,
+        // overflow is moved to the ring start on unlock.
+        uint8_t* m_ring;
+        // Written by writer only
+        std::atomic<int64_t> m_length;
+        // Written by reader only
+        std::atomic<int64_t> m_position;
+        std::atomic<int64_t> m_begin;// virtual start of cache
+        uint8_t* m_lockedUnit;
+        std::atomic<time_t> m_firstWriteTime;
+        std::atomic<time_t> m_endTime;
+    };
+}
+#endif // __ring_cache_buffer_hpp__
@@ -0,0 +1,60 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include "segment_block_pool.hpp"
+
+namespace Buffers {
+    using namespace P8PLATFORM;
+
+    const size_t SegmentBlockPool::BLOCK_SIZE;
+    CMutex SegmentBlockPool::s_syncAccess;
+    std::vector<uint8_t*> SegmentBlockPool::s_freeBlocks;
+
+    uint8_t* SegmentBlockPool::Acquire()
+    {
+        {
+            CLockObject lock(s_syncAccess);
+            if(!s_freeBlocks.empty()) {
+                uint8_t* block = s_freeBlocks.back();
+                s_freeBlocks.pop_back();
+                return block;
+            }
+        }
+        // May throw std::bad_alloc
+        return new uint8_t[BLOCK_SIZE];
+    }
+    
+    void SegmentBlockPool::Release(uint8_t* block)
+    {
+        if(nullptr == block)
+            return;
+        {
+            CLockObject lock(s_syncAccess);
+            if(s_freeBlocks.size() < MAX_FREE_BLOCKS) {
+                s_freeBlocks.push_back(block);
+                return;
+            }
+        }
+        delete[] block;
+    }
+}
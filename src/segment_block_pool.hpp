@@ -0,0 +1,53 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef __segment_block_pool_hpp__
+#define __segment_block_pool_hpp__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "p8-platform/threads/mutex.h"
+
+namespace Buffers {
+
+    // Process-wide pool of fixed size memory blocks for HLS segment data.
+    // Blocks are recycled between segments (and streams)
+    // instead of heap re-allocation on each chunk of downloaded data.
+    class SegmentBlockPool
+    {
+    public:
+        static const size_t BLOCK_SIZE = 64 * 1024; // 64K block
+        static const size_t MAX_FREE_BLOCKS = 256; // Keep up to 16M of unused memory
+
+        static uint8_t* Acquire();
+        static void Release(uint8_t* block);
+        
+    private:
+        SegmentBlockPool() = delete;
+        
+        static P8PLATFORM::CMutex s_syncAccess;
+        static std::vector<uint8_t*> s_freeBlocks;
+    };
+}
+#endif /* __segment_block_pool_hpp__ */
@@ -0,0 +1,205 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#define NOMINMAX
+#include <algorithm>
+#include <time.h>
+#include "segment_cache_buffer.hpp"
+#include "segment_block_pool.hpp"
+#include "globals.hpp"
+
+namespace Buffers
+{
+    using namespace P8PLATFORM;
+    using namespace Globals;
+    
+    // At least few segments of usual size
+    static const int64_t c_minCacheSize = 32 * 1024 * 1024;
+    // Oldest segments are freed one MByte before max size
+    static const int64_t c_freeThreshold = 1024 * 1024;
+    
+    SegmentCacheBuffer::SegmentCacheBuffer(uint64_t maxSize)
+    : m_length(0)
+    , m_position(0)
+    , m_begin(0)
+    , m_maxSize(std::max<int64_t>(c_minCacheSize, maxSize))
+    , m_lockedUnit(nullptr)
+    , m_startTime(0)
+    , m_endTime(0)
+    {
+    }
+    
+    void SegmentCacheBuffer::Init() {
+        CLockObject lock(m_syncAccess);
+        m_length = 0;
+        m_position = 0;
+        m_begin = 0;
+        m_segments.clear();
+        if(m_lockedUnit) {
+            SegmentBlockPool::Release(m_lockedUnit);
+            m_lockedUnit = nullptr;
+        }
+    }
+    
+    uint32_t SegmentCacheBuffer::UnitSize() {
+        return SegmentBlockPool::BLOCK_SIZE;
+    }
+    
+    size_t SegmentCacheBuffer::SegmentIndexFor(int64_t position) const {
+        // First segment starting after position is next to required one
+        auto it = std::upper_bound(m_segments.begin(), m_segments.end(), position, [](int64_t pos, const CachedSegment& s) {
+            return pos < s.begin;
+        });
+        if(it == m_segments.begin())
+            return m_segments.size();
+        return std::distance(m_segments.begin(), it) - 1;
+    }
+    
+    int64_t SegmentCacheBuffer::Seek(int64_t iPosition, int iWhence) {
+        CLockObject lock(m_syncAccess);
+        
+        // Translate position to offset from start of buffer.
+        if(iWhence == SEEK_CUR) {
+            iPosition = m_position + iPosition;
+        } else if(iWhence == SEEK_END) {
+            iPosition = m_length + iPosition;
+        }
+        if(iPosition > m_length) {
+            iPosition = m_length;
+        }
+        if(iPosition < m_begin) {
+            iPosition = m_begin;
+        }
+        m_position = iPosition;
+        LogDebug("SegmentCacheBuffer::Seek. Begin %lld Length %lld Result pos %lld", m_begin, m_length, m_position);
+        return m_position;
+    }
+    
+    int64_t SegmentCacheBuffer::Length() {
+        return m_length;
+    }
+    
+    int64_t SegmentCacheBuffer::Position() {
+        return m_position;
+    }
+    
+    ssize_t SegmentCacheBuffer::Read(void* buffer, size_t bufferSize) {
+        CLockObject lock(m_syncAccess);
+        
+        size_t totalBytesRead = 0;
+        size_t idx = SegmentIndexFor(m_position);
+        while (totalBytesRead < bufferSize && idx < m_segments.size()) {
+            const auto& segment = m_segments[idx];
+            const size_t bytesRead = segment.data->Read(m_position - segment.begin, ((uint8_t*)buffer) + totalBytesRead, bufferSize - totalBytesRead);
+            totalBytesRead += bytesRead;
+            m_position += bytesRead;
+            // Done with segment
+            if(m_position >= segment.begin + (int64_t)segment.data->Size())
+                ++idx;
+        }
+        // Free oldest segments before read position.
+        // Data is released when loader does not reference it anymore.
+        while((m_length - m_begin) >= (m_maxSize - c_freeThreshold) && m_segments.size() > 1
+              && m_segments.front().begin + (int64_t)m_segments.front().data->Size() <= m_position)
+        {
+            const int64_t bytesToRemove = m_segments.front().data->Size();
+            // Forvard start time for (bitrate * removed bytes) seconds.
+            m_startTime += bytesToRemove * (m_endTime - m_startTime)/(m_length - m_begin);
+            m_begin += bytesToRemove;
+            m_segments.pop_front();
+        }
+        return totalBytesRead;
+    }
+    
+    bool SegmentCacheBuffer::AppendSegment(const TSegmentData& data) {
+        if(!data || 0 == data->Size())
+            return true;
+        CLockObject lock(m_syncAccess);
+        // No room for new data
+        if(m_length - m_begin >= m_maxSize)
+            return false;
+        if(m_segments.empty())
+            m_startTime = time(NULL);
+        m_segments.emplace_back(m_length, data);
+        m_length += data->Size();
+        m_endTime = time(NULL);
+        return true;
+    }
+    
+    bool SegmentCacheBuffer::LockUnitForWrite(uint8_t** pBuf) {
+        if(pBuf == nullptr) {
+            LogError("Error: SegmentCacheBuffer::LockUnitForWrite() null pointer for buffer. ");
+            return false;
+        }
+        *pBuf = nullptr;
+        if(m_lockedUnit != nullptr) {
+            LogError("Error: SegmentCacheBuffer::LockUnitForWrite() uinit already locked.");
+            return false;
+        }
+        {
+            CLockObject lock(m_syncAccess);
+            if(m_length - m_begin >= m_maxSize)
+                return false;
+        }
+        try {
+            m_lockedUnit = SegmentBlockPool::Acquire();
+        } catch (std::exception& ex) {
+            LogDebug("SegmentCacheBuffer: allocation of new unit failed. Exception: %s", ex.what());
+            return false;
+        }
+        *pBuf = m_lockedUnit;
+        return true;
+    }
+    
+    void SegmentCacheBuffer::UnlockAfterWriten(uint8_t* pBuf, ssize_t writtenBytes) {
+        if(m_lockedUnit == nullptr){
+            LogError("Error: SegmentCacheBuffer::UnlockAfterWriten() no locked unit.");
+            return;
+        }
+        if(m_lockedUnit != pBuf) {
+            LogError("Error: SegmentCacheBuffer::UnlockAfterWriten() wrong buffer to unlock.");
+            return;
+        }
+        m_lockedUnit = nullptr;
+        const size_t byteToUnlock = writtenBytes < 0  ? UnitSize() : std::min<size_t>(writtenBytes, UnitSize());
+        if(0 == byteToUnlock) {
+            SegmentBlockPool::Release(pBuf);
+            return;
+        }
+        std::vector<uint8_t*> blocks(1, pBuf);
+        TSegmentData data(new SegmentData(std::move(blocks), byteToUnlock));
+        // Room is checked on lock
+        CLockObject lock(m_syncAccess);
+        if(m_segments.empty())
+            m_startTime = time(NULL);
+        m_segments.emplace_back(m_length, data);
+        m_length += byteToUnlock;
+        m_endTime = time(NULL);
+    }
+    
+    SegmentCacheBuffer::~SegmentCacheBuffer(){
+        if(m_lockedUnit)
+            SegmentBlockPool::Release(m_lockedUnit);
+    }
+    
+} // namespace
@@ -0,0 +1,91 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef __segment_cache_buffer_hpp__
+#define __segment_cache_buffer_hpp__
+
+#include <deque>
+#include "cache_buffer.h"
+#include "segment_data.hpp"
+#include "p8-platform/threads/mutex.h"
+
+namespace Buffers
+{
+    // Memory timeshift of HLS stream.
+    // Keeps references to data of loaded segments instead of copying it into memory chunks,
+    // i.e. reader is served directly from segment's blocks.
+    // Plain stream units (LockUnitForWrite()) are single blocks of SegmentBlockPool.
+    class SegmentCacheBuffer : public ICacheBuffer
+    {
+    public:
+        SegmentCacheBuffer(uint64_t maxSize);
+        
+        virtual  void Init();
+        virtual  uint32_t UnitSize();
+        
+        // Read interface
+        // Seak read position within cache window
+        virtual int64_t Seek(int64_t iFilePosition, int iWhence) ;
+        // Virtual steream lenght.
+        virtual int64_t Length();
+        // Current read position
+        virtual int64_t Position();
+        // Reads data from Position(),
+        virtual ssize_t Read(void* lpBuf, size_t uiBufSize);
+        
+        // Write interface
+        virtual bool LockUnitForWrite(uint8_t** pBuf);
+        virtual void UnlockAfterWriten(uint8_t* pBuf, ssize_t writtenBytes = -1);
+        virtual bool IsSegmentAware() const {return true;}
+        virtual bool AppendSegment(const TSegmentData& data);
+        
+        virtual time_t StartTime() const {return m_startTime;}
+        virtual time_t EndTime() const {return m_endTime;}
+        virtual float FillingRatio() const {return (float)(m_length - m_position)/ m_maxSize; }
+        
+        ~SegmentCacheBuffer();
+        
+    private:
+        struct CachedSegment {
+            CachedSegment(int64_t b, const TSegmentData& d) : begin(b), data(d) {}
+            // Stream position of first byte
+            int64_t begin;
+            TSegmentData data;
+        };
+        typedef std::deque<CachedSegment> TSegments;
+        
+        // Index of segment containing position
+        size_t SegmentIndexFor(int64_t position) const;
+        
+        mutable P8PLATFORM::CMutex m_syncAccess;
+        TSegments m_segments;
+        int64_t m_length;
+        int64_t m_position;
+        int64_t m_begin;// virtual start of cache
+        const int64_t m_maxSize;
+        uint8_t* m_lockedUnit;
+        time_t m_startTime;
+        time_t m_endTime;
+    };
+}
+#endif // __segment_cache_buffer_hpp__
@@ -0,0 +1,61 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#define NOMINMAX
+#include <algorithm>
+#include <string.h>
+#include "segment_data.hpp"
+#include "segment_block_pool.hpp"
+
+namespace Buffers {
+
+    SegmentData::SegmentData(std::vector<uint8_t*>&& blocks, size_t size)
+    : m_blocks(std::move(blocks))
+    , m_size(size)
+    {
+    }
+    
+    SegmentData::~SegmentData()
+    {
+        for (auto block : m_blocks) {
+            SegmentBlockPool::Release(block);
+        }
+    }
+    
+    size_t SegmentData::Read(size_t offset, uint8_t* buffer, size_t size) const
+    {
+        if(offset >= m_size)
+            return 0;
+        const size_t actual = std::min(size, m_size - offset);
+        size_t copied = 0;
+        // Copy data across block boundaries
+        while(copied < actual) {
+            const size_t position = offset + copied;
+            const size_t posInBlock = position % SegmentBlockPool::BLOCK_SIZE;
+            const size_t chunk = std::min(actual - copied, SegmentBlockPool::BLOCK_SIZE - posInBlock);
+            memcpy(buffer + copied, m_blocks[position / SegmentBlockPool::BLOCK_SIZE] + posInBlock, chunk);
+            copied += chunk;
+        }
+        return copied;
+    }
+}
@@ -0,0 +1,58 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef __segment_data_hpp__
+#define __segment_data_hpp__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <memory>
+
+namespace Buffers {
+
+    // Immutable data of loaded HLS segment (blocks of SegmentBlockPool).
+    // Data is shared by reference between playlist cache and timeshift,
+    // blocks are returned to the pool with the last reference.
+    class SegmentData
+    {
+    public:
+        // Takes ownership of blocks
+        SegmentData(std::vector<uint8_t*>&& blocks, size_t size);
+        ~SegmentData();
+        
+        size_t Size() const {return m_size;}
+        // Copies up to size bytes from offset. Returns amount of copied bytes.
+        size_t Read(size_t offset, uint8_t* buffer, size_t size) const;
+        
+    private:
+        SegmentData(const SegmentData&) = delete;
+        SegmentData& operator=(const SegmentData&) = delete;
+        
+        std::vector<uint8_t*> m_blocks;
+        const size_t m_size;
+    };
+    
+    typedef std::shared_ptr<const SegmentData> TSegmentData;
+}
+#endif /* __segment_data_hpp__ */
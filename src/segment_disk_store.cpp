@@ -0,0 +1,274 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#if (defined(_WIN32) || defined(_WIN64))
+#define __STDC_FORMAT_MACROS
+#endif
+#define NOMINMAX
+#include <algorithm>
+#include <inttypes.h>
+#include "p8-platform/os.h"
+#include "p8-platform/util/util.h"
+#include "kodi/Filesystem.h"
+#include "segment_disk_store.hpp"
+#include "segment_block_pool.hpp"
+#include "playlist_cache.hpp"
+#include "ActionQueue.hpp"
+#include "helpers.h"
+#include "globals.hpp"
+
+namespace Buffers {
+    using namespace P8PLATFORM;
+    using namespace Globals;
+
+    static const size_t c_maxPendingWrites = 1000;
+    // Max time to wait for pending write on load
+    static const int c_maxWaitForWriteMs = 5000;
+
+    CMutex SegmentDiskStore::s_syncAccess;
+    std::string SegmentDiskStore::s_folder;
+    uint64_t SegmentDiskStore::s_sizeLimit = 0;
+    uint64_t SegmentDiskStore::s_usedSize = 0;
+    unsigned int SegmentDiskStore::s_storeCounter = 0;
+
+    void SegmentDiskStore::SetFolder(const std::string& folder)
+    {
+        CLockObject lock(s_syncAccess);
+        s_folder = folder;
+    }
+
+    void SegmentDiskStore::SetSizeLimitInMb(int sizeInMb)
+    {
+        CLockObject lock(s_syncAccess);
+        s_sizeLimit = (sizeInMb > 0) ? (uint64_t)sizeInMb * 1024 * 1024 : 0;
+    }
+
+    bool SegmentDiskStore::IsEnabled()
+    {
+        CLockObject lock(s_syncAccess);
+        return !s_folder.empty() && s_sizeLimit > 0;
+    }
+
+    SegmentDiskStore::SegmentDiskStore()
+    : m_writer(new ActionQueue::CActionQueue(c_maxPendingWrites, "Segment Disk Store"))
+    {
+        {
+            CLockObject lock(s_syncAccess);
+            m_filePrefix = s_folder + PATH_SEPARATOR_CHAR + "HlsSegments-" + Helpers::n_to_string(s_storeCounter++) + "-";
+        }
+        m_writer->CreateThread();
+    }
+
+    SegmentDiskStore::~SegmentDiskStore()
+    {
+        // Pending writes will be canceled
+        m_writer->StopThread();
+        SAFE_DELETE(m_writer);
+
+        CLockObject lock(m_syncAccess);
+        while(!m_segments.empty()) {
+            Remove(m_segments.begin());
+        }
+    }
+
+    void SegmentDiskStore::Store(uint64_t index, const std::vector<uint8_t*>& blocks, size_t size)
+    {
+        bool isAccepted = false;
+        {
+            CLockObject lock(m_syncAccess);
+            // Already stored segment (e.g. loaded from disk and evicted again)
+            // does not need a new copy
+            if(m_segments.count(index) == 0 && size > 0 && MakeRoom(size)) {
+                m_segments.emplace(index, StoredSegment(m_filePrefix + Helpers::n_to_string(index) + ".bin", size));
+                m_storeOrder.push_back(index);
+                isAccepted = true;
+            }
+        }
+        if(!isAccepted) {
+            for (auto block : blocks) {
+                SegmentBlockPool::Release(block);
+            }
+            return;
+        }
+        m_writer->PerformAsync([this, index, blocks, size] {
+            Write(index, blocks, size);
+        }, [this, index, blocks](const ActionQueue::ActionResult& s) {
+            for (auto block : blocks) {
+                SegmentBlockPool::Release(block);
+            }
+            if(s.status != ActionQueue::kActionCompleted) {
+                CLockObject lock(m_syncAccess);
+                auto it = m_segments.find(index);
+                if(it != m_segments.end() && !it->second.isWritten)
+                    it->second.isFailed = true;
+                m_writeDone.Signal();
+            }
+        });
+    }
+
+    bool SegmentDiskStore::Contains(uint64_t index) const
+    {
+        CLockObject lock(m_syncAccess);
+        auto it = m_segments.find(index);
+        return it != m_segments.end() && !it->second.isFailed;
+    }
+
+    bool SegmentDiskStore::Load(uint64_t index, MutableSegment& segment)
+    {
+        std::string path;
+        size_t size = 0;
+        int waitingMs = 0;
+        while(true) {
+            {
+                CLockObject lock(m_syncAccess);
+                auto it = m_segments.find(index);
+                if(it == m_segments.end())
+                    return false;
+                if(it->second.isFailed) {
+                    Remove(it);
+                    return false;
+                }
+                if(it->second.isWritten) {
+                    path = it->second.path;
+                    size = it->second.size;
+                    // Most recently used goes last
+                    m_storeOrder.erase(std::find(m_storeOrder.begin(), m_storeOrder.end(), index));
+                    m_storeOrder.push_back(index);
+                    break;
+                }
+            }
+            if(waitingMs >= c_maxWaitForWriteMs) {
+                LogError("SegmentDiskStore: segment #%" PRIu64 " is not written in %d ms.", index, c_maxWaitForWriteMs);
+                return false;
+            }
+            m_writeDone.Wait(100);
+            waitingMs += 100;
+        }
+
+        kodi::vfs::CFile f;
+        size_t offset = 0;
+        if(f.OpenFile(path, ADDON_READ_NO_CACHE)) {
+            segment.Reserve(size);
+            while(offset < size) {
+                uint8_t* buffer = nullptr;
+                const size_t bufferSize = std::min(segment.LockForWrite(offset, &buffer), size - offset);
+                const ssize_t bytesRead = f.Read(buffer, bufferSize);
+                if(bytesRead <= 0)
+                    break;
+                offset += bytesRead;
+            }
+            f.Close();
+        }
+        if(offset != size) {
+            LogError("SegmentDiskStore: failed to read segment #%" PRIu64 " from %s", index, path.c_str());
+            segment.Discard();
+            CLockObject lock(m_syncAccess);
+            auto it = m_segments.find(index);
+            if(it != m_segments.end())
+                Remove(it);
+            return false;
+        }
+        segment.UnlockAfterWriten(size);
+        LogDebug("SegmentDiskStore: segment #%" PRIu64 " loaded from disk (%d bytes).", index, size);
+        return true;
+    }
+
+    void SegmentDiskStore::Write(uint64_t index, const std::vector<uint8_t*>& blocks, size_t size)
+    {
+        std::string path;
+        {
+            CLockObject lock(m_syncAccess);
+            auto it = m_segments.find(index);
+            if(it == m_segments.end())
+                return;
+            path = it->second.path;
+        }
+
+        kodi::vfs::CFile f;
+        bool succeeded = f.OpenFileForWrite(path, true);
+        size_t written = 0;
+        for (size_t i = 0; succeeded && i < blocks.size() && written < size; ++i) {
+            const size_t chunk = std::min(SegmentBlockPool::BLOCK_SIZE, size - written);
+            succeeded = f.Write(blocks[i], chunk) == (ssize_t)chunk;
+            written += chunk;
+        }
+        f.Close();
+        if(!succeeded) {
+            LogError("SegmentDiskStore: failed to write segment #%" PRIu64 " to %s", index, path.c_str());
+        }
+
+        {
+            CLockObject lock(m_syncAccess);
+            auto it = m_segments.find(index);
+            if(it != m_segments.end()) {
+                it->second.isWritten = succeeded;
+                it->second.isFailed = !succeeded;
+            }
+        }
+        m_writeDone.Signal();
+    }
+
+    // Should be called with locked m_syncAccess
+    bool SegmentDiskStore::MakeRoom(size_t size)
+    {
+        {
+            CLockObject lock(s_syncAccess);
+            if(s_folder.empty() || size > s_sizeLimit)
+                return false;
+        }
+        while(true) {
+            {
+                CLockObject lock(s_syncAccess);
+                if(s_usedSize + size <= s_sizeLimit) {
+                    s_usedSize += size;
+                    return true;
+                }
+            }
+            // Drop least recently used segment (pending write can't be dropped)
+            auto victim = std::find_if(m_storeOrder.begin(), m_storeOrder.end(), [this](uint64_t idx) {
+                const auto& s = m_segments.at(idx);
+                return s.isWritten || s.isFailed;
+            });
+            // Rest of space is used by other streams
+            if(victim == m_storeOrder.end())
+                return false;
+            Remove(m_segments.find(*victim));
+        }
+    }
+
+    // Should be called with locked m_syncAccess
+    void SegmentDiskStore::Remove(TStoredSegments::iterator it)
+    {
+        const auto& path = it->second.path;
+        if(kodi::vfs::FileExists(path, false) && !kodi::vfs::DeleteFile(path)) {
+            LogError("SegmentDiskStore: failed to delete %s", path.c_str());
+        }
+        {
+            CLockObject lock(s_syncAccess);
+            s_usedSize -= std::min<uint64_t>(s_usedSize, it->second.size);
+        }
+        auto order = std::find(m_storeOrder.begin(), m_storeOrder.end(), it->first);
+        if(order != m_storeOrder.end())
+            m_storeOrder.erase(order);
+        m_segments.erase(it);
+    }
+}
@@ -0,0 +1,96 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#ifndef __segment_disk_store_hpp__
+#define __segment_disk_store_hpp__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include "p8-platform/threads/mutex.h"
+
+namespace ActionQueue {
+    class CActionQueue;
+}
+
+namespace Buffers {
+
+    class MutableSegment;
+
+    // On-disk tier for segments evicted from PlaylistCache.
+    // Segment data is written asynchronously, total size of all stores is limited.
+    // Files are created in timeshift folder with *.bin extension,
+    // i.e. leftovers are removed on timeshift folder cleanup.
+    class SegmentDiskStore
+    {
+    public:
+        static void SetFolder(const std::string& folder);
+        // Total size limit for all stores. 0 - disabled.
+        static void SetSizeLimitInMb(int sizeInMb);
+        static bool IsEnabled();
+
+        SegmentDiskStore();
+        ~SegmentDiskStore();
+
+        // Takes ownership of segment's data blocks (see SegmentBlockPool).
+        // Blocks are released after write.
+        void Store(uint64_t index, const std::vector<uint8_t*>& blocks, size_t size);
+        // Stored or pending for write
+        bool Contains(uint64_t index) const;
+        // Reads stored data into empty segment. Waits for pending write.
+        bool Load(uint64_t index, MutableSegment& segment);
+
+    private:
+        struct StoredSegment {
+            StoredSegment(const std::string& p, size_t s) : path(p), size(s), isWritten(false), isFailed(false) {}
+            std::string path;
+            size_t size;
+            bool isWritten;
+            bool isFailed;
+        };
+        typedef std::map<uint64_t, StoredSegment> TStoredSegments;
+
+        SegmentDiskStore(const SegmentDiskStore&) = delete;
+        SegmentDiskStore& operator=(const SegmentDiskStore&) = delete;
+
+        void Write(uint64_t index, const std::vector<uint8_t*>& blocks, size_t size);
+        bool MakeRoom(size_t size);
+        void Remove(TStoredSegments::iterator it);
+
+        static P8PLATFORM::CMutex s_syncAccess;
+        static std::string s_folder;
+        static uint64_t s_sizeLimit;
+        static uint64_t s_usedSize;
+        static unsigned int s_storeCounter;
+
+        mutable P8PLATFORM::CMutex m_syncAccess;
+        P8PLATFORM::CEvent m_writeDone;
+        ActionQueue::CActionQueue* m_writer;
+        std::string m_filePrefix;
+        TStoredSegments m_segments;
+        // Order of storing, oldest first
+        std::deque<uint64_t> m_storeOrder;
+    };
+}
+#endif /* __segment_disk_store_hpp__ */
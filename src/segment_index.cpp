@@ -0,0 +1,243 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <algorithm>
+#include "segment_index.hpp"
+
+namespace Buffers {
+
+    SegmentIndex::SegmentIndex()
+    : m_unknownSizes(0)
+    , m_bitrate(0.0)
+    , m_isTreeValid(true)
+    {}
+
+    void SegmentIndex::Add(uint64_t index, TimeOffset timeOffset, float duration)
+    {
+        auto it = std::lower_bound(m_entries.begin(), m_entries.end(), index, [](const Entry& e, uint64_t i) {
+            return e.index < i;
+        });
+        if(it != m_entries.end() && it->index == index) {
+            it->timeOffset = timeOffset;
+            it->duration = duration;
+            m_isTreeValid = false;
+            return;
+        }
+        if(it != m_entries.end()) {
+            // Insertion in the middle (e.g. seek over not loaded range of dynamic playlist)
+            m_entries.emplace(it, index, timeOffset, duration);
+            ++m_unknownSizes;
+            m_isTreeValid = false;
+            return;
+        }
+        m_entries.emplace_back(index, timeOffset, duration);
+        ++m_unknownSizes;
+        if(!m_isTreeValid)
+            return;
+        // Append to Fenwick tree: new node covers (n - lowbit(n), n]
+        const size_t n = m_entries.size();
+        const size_t lowbit = n & (~n + 1);
+        const double value = GapBytes(n - 1) + SegmentBytes(n - 1);
+        m_tree.push_back(value + PrefixSum(n - 1) - PrefixSum(n - lowbit));
+    }
+
+    void SegmentIndex::SetSize(uint64_t index, size_t size)
+    {
+        UpdateSize(index, size, true);
+    }
+
+    void SegmentIndex::SetProbedSize(uint64_t index, size_t size)
+    {
+        UpdateSize(index, size, false);
+    }
+
+    void SegmentIndex::UpdateSize(uint64_t index, size_t size, bool isLoaded)
+    {
+        auto it = std::lower_bound(m_entries.begin(), m_entries.end(), index, [](const Entry& e, uint64_t i) {
+            return e.index < i;
+        });
+        if(it == m_entries.end() || it->index != index)
+            return;
+        // Decrypted and filtered data differs from HEAD size
+        if(it->isLoaded && !isLoaded)
+            return;
+        it->isLoaded = isLoaded;
+        if(it->size == size)
+            return;
+        const size_t pos = it - m_entries.begin();
+        const double before = SegmentBytes(pos);
+        if(0 == it->size)
+            --m_unknownSizes;
+        else if(0 == size)
+            ++m_unknownSizes;
+        it->size = size;
+        if(m_isTreeValid)
+            UpdateTree(pos, SegmentBytes(pos) - before);
+    }
+
+    void SegmentIndex::SetBitrate(float bitrate)
+    {
+        if(m_bitrate == bitrate)
+            return;
+        m_bitrate = bitrate;
+        m_isTreeValid = false;
+    }
+
+    int64_t SegmentIndex::TotalLength() const
+    {
+        if((m_bitrate == 0.0 && !HasAllSizes()) || m_entries.empty())
+            return -1;
+        if(!m_isTreeValid)
+            Rebuild();
+        return (int64_t)PrefixSum(m_entries.size());
+    }
+
+    TimeOffset SegmentIndex::EndTime() const
+    {
+        if(m_entries.empty())
+            return 0.0;
+        const auto& e = m_entries.back();
+        return e.timeOffset + e.duration;
+    }
+
+    bool SegmentIndex::FindByTime(TimeOffset timeOffset, uint64_t& index, float& positionFactor) const
+    {
+        // First segment started after time offset
+        auto it = std::upper_bound(m_entries.begin(), m_entries.end(), timeOffset, [](TimeOffset t, const Entry& e) {
+            return t < e.timeOffset;
+        });
+        if(it == m_entries.begin())
+            return false;
+        --it;
+        if(timeOffset >= it->timeOffset + it->duration)
+            return false;
+        index = it->index;
+        positionFactor = (timeOffset - it->timeOffset) / it->duration;
+        return true;
+    }
+
+    bool SegmentIndex::FindByPosition(int64_t position, uint64_t& index, float& positionFactor) const
+    {
+        size_t pos;
+        double offsetInSegment;
+        if(!Find(position, pos, offsetInSegment))
+            return false;
+        const double segmentBytes = SegmentBytes(pos);
+        index = m_entries[pos].index;
+        positionFactor = segmentBytes > 0 ? offsetInSegment / segmentBytes : 0.0;
+        return true;
+    }
+
+    bool SegmentIndex::TimeOffsetForPosition(int64_t position, TimeOffset& timeOffset) const
+    {
+        size_t pos;
+        double offsetInSegment;
+        if(!Find(position, pos, offsetInSegment))
+            return false;
+        const double segmentBytes = SegmentBytes(pos);
+        const auto& e = m_entries[pos];
+        timeOffset = e.timeOffset + (segmentBytes > 0 ? e.duration * offsetInSegment / segmentBytes : 0.0);
+        return true;
+    }
+
+    bool SegmentIndex::Find(int64_t position, size_t& pos, double& offsetInSegment) const
+    {
+        // Without bitrate only exact sizes can be used
+        if((m_bitrate == 0.0 && !HasAllSizes()) || position < 0 || m_entries.empty())
+            return false;
+        if(!m_isTreeValid)
+            Rebuild();
+        // Fenwick descent: pos - amount of entries that end before (or at) position
+        const size_t n = m_entries.size();
+        size_t step = 1;
+        while(step * 2 <= n)
+            step *= 2;
+        pos = 0;
+        double rest = position;
+        for(; step > 0; step /= 2) {
+            if(pos + step <= n && m_tree[pos + step - 1] <= rest) {
+                pos += step;
+                rest -= m_tree[pos - 1];
+            }
+        }
+        if(pos == n)
+            return false;
+        // Position inside of missing segments range
+        rest -= GapBytes(pos);
+        if(rest < 0)
+            return false;
+        offsetInSegment = rest;
+        return true;
+    }
+
+    double SegmentIndex::SegmentBytes(size_t pos) const
+    {
+        const auto& e = m_entries[pos];
+        return e.size > 0 ? e.size : e.duration * m_bitrate;
+    }
+
+    double SegmentIndex::GapBytes(size_t pos) const
+    {
+        const auto& e = m_entries[pos];
+        TimeOffset gapStart = 0.0;
+        if(pos > 0) {
+            const auto& prev = m_entries[pos - 1];
+            // Continuous segments have no gap
+            if(prev.index + 1 == e.index)
+                return 0.0;
+            gapStart = prev.timeOffset + prev.duration;
+        }
+        return std::max(e.timeOffset - gapStart, 0.0f) * m_bitrate;
+    }
+
+    void SegmentIndex::Rebuild() const
+    {
+        const size_t n = m_entries.size();
+        m_tree.assign(n, 0.0);
+        for (size_t i = 0; i < n; ++i) {
+            m_tree[i] += GapBytes(i) + SegmentBytes(i);
+            // Push partial sum to parent node
+            const size_t node = i + 1;
+            const size_t parent = node + (node & (~node + 1));
+            if(parent <= n)
+                m_tree[parent - 1] += m_tree[i];
+        }
+        m_isTreeValid = true;
+    }
+
+    void SegmentIndex::UpdateTree(size_t pos, double delta)
+    {
+        for (size_t node = pos + 1; node <= m_tree.size(); node += node & (~node + 1)) {
+            m_tree[node - 1] += delta;
+        }
+    }
+
+    // Sum of first count entries
+    double SegmentIndex::PrefixSum(size_t count) const
+    {
+        double sum = 0.0;
+        for (size_t node = count; node > 0; node -= node & (~node + 1)) {
+            sum += m_tree[node - 1];
+        }
+        return sum;
+    }
+}
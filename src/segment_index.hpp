@@ -0,0 +1,94 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#ifndef __segment_index_hpp__
+#define __segment_index_hpp__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "Playlist.hpp"
+
+namespace Buffers {
+
+    // Time and data offsets of seekable stream segments (ordered by segment index).
+    // Data offsets are prefix sums (Fenwick tree) of segment sizes:
+    // real size for loaded segment and bitrate estimation for others.
+    // Lookup by time or data position is O(log N).
+    class SegmentIndex
+    {
+    public:
+        SegmentIndex();
+        // Appends (usual case) or inserts new segment
+        void Add(uint64_t index, TimeOffset timeOffset, float duration);
+        // Real size of loaded segment replaces bitrate estimation
+        void SetSize(uint64_t index, size_t size);
+        // Probed (HEAD) size is used until segment is loaded, i.e. it never replaces real size
+        void SetProbedSize(uint64_t index, size_t size);
+        // Stream bitrate (bytes per second) for size estimation
+        void SetBitrate(float bitrate);
+        // Segment containing time offset and relative position inside of segment
+        bool FindByTime(TimeOffset timeOffset, uint64_t& index, float& positionFactor) const;
+        // Segment containing data position and relative position inside of segment
+        bool FindByPosition(int64_t position, uint64_t& index, float& positionFactor) const;
+        // Time offset of data position (interpolated inside of segment)
+        bool TimeOffsetForPosition(int64_t position, TimeOffset& timeOffset) const;
+        // Data offsets are exact, i.e. bitrate estimation is not needed
+        bool HasAllSizes() const {return m_unknownSizes == 0 && !m_entries.empty();}
+        // Sum of all segment sizes (estimated or exact), -1 when it can't be estimated
+        int64_t TotalLength() const;
+        // End time of last segment
+        TimeOffset EndTime() const;
+
+    private:
+        struct Entry {
+            Entry(uint64_t i, TimeOffset t, float d) : index(i), timeOffset(t), duration(d), size(0), isLoaded(false) {}
+            uint64_t index;
+            TimeOffset timeOffset;
+            float duration;
+            // 0 - unknown yet
+            size_t size;
+            // Size is real size of loaded data (not probed one)
+            bool isLoaded;
+        };
+        typedef std::vector<Entry> TEntries;
+
+        // Position of entry containing data position and offset inside of segment
+        bool Find(int64_t position, size_t& pos, double& offsetInSegment) const;
+        void UpdateSize(uint64_t index, size_t size, bool isLoaded);
+        // Estimated segment size in bytes
+        double SegmentBytes(size_t pos) const;
+        // Estimated size of missing segments (if any) before entry
+        double GapBytes(size_t pos) const;
+        void Rebuild() const;
+        void UpdateTree(size_t pos, double delta);
+        double PrefixSum(size_t count) const;
+
+        TEntries m_entries;
+        size_t m_unknownSizes;
+        float m_bitrate;
+        // Fenwick tree (1-based) of gap + segment bytes per entry
+        mutable std::vector<double> m_tree;
+        mutable bool m_isTreeValid;
+    };
+}
+#endif /* __segment_index_hpp__ */
@@ -0,0 +1,110 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <algorithm>
+#include <inttypes.h>
+#include "segment_mirrors.hpp"
+#include "globals.hpp"
+
+namespace Buffers {
+    using namespace P8PLATFORM;
+    using namespace Globals;
+
+    // Broken or lagging mirror's playlist is not requested more often
+    static const std::chrono::milliseconds c_mirrorReloadInterval(2000);
+    // Latency window
+    static const size_t c_maxLatencySamples = 64;
+    static const size_t c_minLatencySamples = 16;
+
+    bool SegmentMirrors::s_hedgedRequests = false;
+
+    SegmentMirrors::SegmentMirrors(const TUrls& playlistUrls)
+    {
+        for (const auto& url : playlistUrls) {
+            m_mirrors.emplace_back(url);
+        }
+        LogDebug("SegmentMirrors: %d mirror(s) of stream.", (int)m_mirrors.size());
+    }
+
+    SegmentMirrors::~SegmentMirrors()
+    {
+    }
+
+    bool SegmentMirrors::FindSegment(size_t mirror, const SegmentInfo& segment, SegmentInfo& info)
+    {
+        if(mirror >= m_mirrors.size())
+            return false;
+        // NOTE: playlist is loaded under lock, failover is rare
+        CLockObject lock(m_mirrorsAccess);
+        auto& m = m_mirrors[mirror];
+        const auto now = std::chrono::steady_clock::now();
+        if(!m.playlist) {
+            if(m.loadedAt != TimePoint() && now - m.loadedAt < c_mirrorReloadInterval)
+                return false;
+            m.loadedAt = now;
+            try {
+                m.playlist.reset(new Playlist(m.url));
+                m.playlist->EnableIncrementalReload(true);
+            } catch (std::exception& ex) {
+                LogError("SegmentMirrors: failed to load mirror #%d. Error: %s", (int)mirror + 1, ex.what());
+                return false;
+            }
+        }
+        // Partial segment (low-latency stream) has no URL until it's completed
+        if(m.playlist->SegmentForMediaSequence(segment.mediaSequence, info) && !info.url.empty())
+            return true;
+        // Live mirror may lag behind primary source
+        if(m.playlist->IsVod() || now - m.loadedAt < c_mirrorReloadInterval)
+            return false;
+        m.loadedAt = now;
+        if(!m.playlist->Reload())
+            return false;
+        if(m.playlist->SegmentForMediaSequence(segment.mediaSequence, info) && !info.url.empty())
+            return true;
+        LogDebug("SegmentMirrors: mirror #%d has no segment with sequence number %" PRIu64 ".", (int)mirror + 1, segment.mediaSequence);
+        return false;
+    }
+
+    void SegmentMirrors::AddLatency(uint32_t ms)
+    {
+        CLockObject lock(m_latencyAccess);
+        if(m_latencies.size() >= c_maxLatencySamples)
+            m_latencies.pop_front();
+        m_latencies.push_back(ms);
+    }
+
+    bool SegmentMirrors::LatencyP95(uint32_t& ms) const
+    {
+        std::vector<uint32_t> latencies;
+        {
+            CLockObject lock(m_latencyAccess);
+            if(m_latencies.size() < c_minLatencySamples)
+                return false;
+            latencies.assign(m_latencies.begin(), m_latencies.end());
+        }
+        auto p95 = latencies.begin() + (latencies.size() * 95) / 100;
+        std::nth_element(latencies.begin(), p95, latencies.end());
+        ms = *p95;
+        return true;
+    }
+}
@@ -0,0 +1,84 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef __segment_mirrors_hpp__
+#define __segment_mirrors_hpp__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <chrono>
+#include "Playlist.hpp"
+#include "p8-platform/threads/mutex.h"
+
+namespace Buffers {
+
+    // Alternative sources (mirrors) of live HLS stream.
+    // Segment which failed on primary source is requested from mirror
+    // by its media sequence number, i.e. mirrors are expected to be
+    // aligned by sequence numbers (same origin behind different CDNs).
+    // Also collects request latencies of the stream to detect slow responses.
+    class SegmentMirrors
+    {
+    public:
+        typedef std::vector<std::string> TUrls;
+
+        SegmentMirrors(const TUrls& playlistUrls);
+        ~SegmentMirrors();
+
+        // When enabled, slow segment request (see LatencyP95()) is duplicated to first mirror
+        static void SetHedgedRequests(bool enable) {s_hedgedRequests = enable;}
+        static bool IsHedgingEnabled() {return s_hedgedRequests;}
+
+        size_t Count() const {return m_mirrors.size();}
+        // Info of segment with same media sequence in mirror's playlist.
+        // Mirror's playlist is loaded on first use and reloaded when segment is missing.
+        bool FindSegment(size_t mirror, const SegmentInfo& segment, SegmentInfo& info);
+        // Time to first response of segment request
+        void AddLatency(uint32_t ms);
+        // 95th percentile of recent latencies. False while there are not enough samples.
+        bool LatencyP95(uint32_t& ms) const;
+
+    private:
+        typedef std::chrono::steady_clock::time_point TimePoint;
+        struct Mirror {
+            Mirror(const std::string& u) : url(u) {}
+            std::string url;
+            std::unique_ptr<Playlist> playlist;
+            // Last (re)load attempt, throttles requests to broken or lagging mirror
+            TimePoint loadedAt;
+        };
+
+        SegmentMirrors(const SegmentMirrors&) = delete;
+        SegmentMirrors& operator=(const SegmentMirrors&) = delete;
+
+        P8PLATFORM::CMutex m_mirrorsAccess;
+        std::vector<Mirror> m_mirrors;
+        mutable P8PLATFORM::CMutex m_latencyAccess;
+        std::deque<uint32_t> m_latencies;
+        static bool s_hedgedRequests;
+    };
+}
+#endif /* __segment_mirrors_hpp__ */
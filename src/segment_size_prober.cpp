@@ -0,0 +1,123 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#if (defined(_WIN32) || defined(_WIN64))
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+#include <algorithm>
+#include "kodi/Filesystem.h"
+#include "segment_size_prober.hpp"
+#include "globals.hpp"
+
+namespace Buffers {
+    using namespace P8PLATFORM;
+    using namespace Globals;
+
+    SegmentSizeProber::SegmentSizeProber(const TSegments& segments, size_t maxConcurrentProbes)
+    : m_segments(segments)
+    , m_nextSegment(0)
+    , m_isCanceled(false)
+    , m_probedCount(0)
+    , m_totalLength(0)
+    {
+        const size_t workers = std::min(std::max<size_t>(maxConcurrentProbes, 1), m_segments.size());
+        for (size_t i = 0; i < workers; ++i) {
+            m_workers.emplace_back(&SegmentSizeProber::Worker, this);
+        }
+        LogDebug("SegmentSizeProber: probing %d segments (%d connections).", m_segments.size(), workers);
+    }
+
+    SegmentSizeProber::~SegmentSizeProber()
+    {
+        m_isCanceled = true;
+        for (auto& w : m_workers) {
+            w.join();
+        }
+    }
+
+    void SegmentSizeProber::TakeSizes(TSegmentSizes& sizes)
+    {
+        CLockObject lock(m_syncAccess);
+        sizes.insert(sizes.end(), m_probedSizes.begin(), m_probedSizes.end());
+        m_probedSizes.clear();
+    }
+
+    bool SegmentSizeProber::ProbeSize(const std::string& url, const ByteRange& range, int64_t& size)
+    {
+        if(!range.IsEmpty()) {
+            size = range.length;
+            return true;
+        }
+        // HEAD request for HTTP(S) URL
+        kodi::vfs::FileStatus status;
+        if(!kodi::vfs::StatFile(url, status) || status.GetSize() <= 0)
+            return false;
+        size = status.GetSize();
+        return true;
+    }
+
+    bool SegmentSizeProber::ProbeInitSize(const SegmentInfo& segment, int64_t& size)
+    {
+        size = 0;
+        if(segment.initUrl.empty())
+            return true;
+        const std::string key = segment.initUrl + "@" + std::to_string(segment.initRange.offset);
+        {
+            CLockObject lock(m_syncAccess);
+            auto it = m_initSizes.find(key);
+            if(it != m_initSizes.end()) {
+                size = it->second;
+                return true;
+            }
+        }
+        // Concurrent workers may probe same section, it's cheap
+        if(!ProbeSize(segment.initUrl, segment.initRange, size))
+            return false;
+        CLockObject lock(m_syncAccess);
+        m_initSizes[key] = size;
+        return true;
+    }
+
+    void SegmentSizeProber::Worker()
+    {
+        size_t i;
+        while(!m_isCanceled && (i = m_nextSegment++) < m_segments.size()) {
+            const auto& segment = m_segments[i];
+            int64_t size = 0, initSize = 0;
+            const bool succeeded = ProbeSize(segment.url, segment.range, size) && ProbeInitSize(segment, initSize);
+            if(!succeeded) {
+                // Server does not provide content length. Don't bother it anymore.
+                LogError("SegmentSizeProber: failed to obtain size of segment #%" PRIu64 ". Probing stopped.", segment.index);
+                m_isCanceled = true;
+                break;
+            }
+            size += initSize;
+            CLockObject lock(m_syncAccess);
+            m_probedSizes.emplace_back(segment.index, size);
+            m_totalLength += size;
+            if(++m_probedCount == m_segments.size()) {
+                LogNotice("SegmentSizeProber: exact length of %d segments is %" PRId64 " bytes.", m_segments.size(), m_totalLength);
+            }
+        }
+    }
+}
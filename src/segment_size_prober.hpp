@@ -0,0 +1,77 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#ifndef __segment_size_prober_hpp__
+#define __segment_size_prober_hpp__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <utility>
+#include <map>
+#include "p8-platform/threads/mutex.h"
+#include "Playlist.hpp"
+
+namespace Buffers {
+
+    // Background stage for VOD playlists.
+    // Requests size (HTTP HEAD) of every segment with bounded parallelism,
+    // i.e. exact data offsets are known before segments are loaded.
+    // Size of byte range segment is known from playlist,
+    // size of initialization section (prepended to each segment) is requested once.
+    class SegmentSizeProber
+    {
+    public:
+        typedef std::vector<SegmentInfo> TSegments;
+        // Segment index and size
+        typedef std::vector<std::pair<uint64_t, int64_t>> TSegmentSizes;
+
+        SegmentSizeProber(const TSegments& segments, size_t maxConcurrentProbes);
+        ~SegmentSizeProber();
+
+        // Moves sizes probed since last call to sizes
+        void TakeSizes(TSegmentSizes& sizes);
+
+    private:
+        SegmentSizeProber(const SegmentSizeProber&) = delete;
+        SegmentSizeProber& operator=(const SegmentSizeProber&) = delete;
+
+        void Worker();
+        bool ProbeSize(const std::string& url, const ByteRange& range, int64_t& size);
+        bool ProbeInitSize(const SegmentInfo& segment, int64_t& size);
+
+        const TSegments m_segments;
+        std::vector<std::thread> m_workers;
+        std::atomic<size_t> m_nextSegment;
+        std::atomic<bool> m_isCanceled;
+
+        mutable P8PLATFORM::CMutex m_syncAccess;
+        TSegmentSizes m_probedSizes;
+        size_t m_probedCount;
+        int64_t m_totalLength;
+        // Init section URL and size
+        std::map<std::string, int64_t> m_initSizes;
+    };
+}
+#endif /* __segment_size_prober_hpp__ */
@@ -219,9 +219,9 @@ public:
         
         _channelId =  epgTag.UniqueChannelId;
     }
-    virtual int SegmentsAmountToCache() const {
-        // 10 segments cache
-        return 10;
+    virtual int SecondsToCache() const {
+        // 1 minute cache
+        return 60;
     }
 
     virtual time_t Duration() const
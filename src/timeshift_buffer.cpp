@@ -37,6 +37,7 @@
 #include "helpers.h"
 #include <sstream>
 #include <functional>
+#include <vector>
 #include "globals.hpp"
 
 namespace Buffers {
@@ -50,6 +51,7 @@ namespace Buffers {
     , m_cache(cache)
     , m_cacheToSwap(nullptr)
     , m_isWaitingForRead(false)
+    , m_tsFilter(nullptr)
 //    , m_downloadSpeed(33 * 1024 * 1024)
 //    , m_playbackSpeed(33 * 1024 * 1024)
     {
@@ -72,6 +74,18 @@ namespace Buffers {
         m_writeEvent.Reset();
         m_cache->Init();
         m_isInputBufferValid = false;
+        // New stream, new counters
+        if(m_tsFilter) {
+            delete m_tsFilter;
+            m_tsFilter = nullptr;
+        }
+        TsStreamHealth inputHealth;
+        if(!m_inputBuffer->GetStreamHealth(inputHealth))
+            m_tsFilter = new TsPacketFilter();
+        {
+            CLockObject lock(m_healthAccess);
+            m_streamHealth = TsStreamHealth();
+        }
 //        test_read_started = false;
 //        m_downloadSpeed.Start();
         CreateThread();
@@ -86,6 +100,17 @@ namespace Buffers {
             delete m_inputBuffer;
         if(m_cache)
              delete m_cache;
+        if(m_tsFilter)
+            delete m_tsFilter;
+    }
+
+    bool TimeshiftBuffer::GetStreamHealth(TsStreamHealth& health) const
+    {
+        if(nullptr == m_tsFilter)
+            return m_inputBuffer->GetStreamHealth(health);
+        CLockObject lock(m_healthAccess);
+        health = m_streamHealth;
+        return true;
     }
     
     void TimeshiftBuffer::CheckAndWaitForSwap() {
@@ -131,10 +156,26 @@ namespace Buffers {
     void *TimeshiftBuffer::Process()
     {
         bool isError = false;
+        std::vector<uint8_t> filterInput;
         try {
             while (!isError && m_inputBuffer != NULL && !IsStopped()) {
                 
                 CheckAndWaitForSwap() ;
+                // Segments of HLS stream are cached by reference
+                if(nullptr == m_tsFilter && m_cache->IsSegmentAware() && m_inputBuffer->CanReadSegments()) {
+                    TSegmentData data;
+                    ssize_t bytesRead = m_inputBuffer->ReadSegment(data, 30*1000);
+                    isError = bytesRead < 0;
+                    if(bytesRead > 0) {
+                        while(!IsStopped() && !m_cache->AppendSegment(data)) {
+                            LogError("TimeshiftBuffer: no room for segment. Cache is full? ");
+                            Sleep(1000);
+                        }
+                        m_isInputBufferValid = true;
+                        m_writeEvent.Signal();
+                    }
+                    continue;
+                }
                 // Fill read buffer
                 const size_t bufferLenght = m_cache->UnitSize();
                 uint8_t* buffer = nullptr;
@@ -145,11 +186,32 @@ namespace Buffers {
                 ssize_t bytesRead = 0;
                
                 while (!isError && (bytesRead < bufferLenght) && !IsStopped() && m_inputBuffer != NULL){
+                    if(m_tsFilter) {
+                        // Filter's output includes data held back from previous read
+                        const size_t room = bufferLenght - bytesRead;
+                        if(room <= m_tsFilter->PendingSize())
+                            break;
+                        filterInput.resize(room - m_tsFilter->PendingSize());
+                        ssize_t loacalBytesRad = m_inputBuffer->Read(filterInput.data(), filterInput.size(), 30*1000);
+                        isError = loacalBytesRad < 0;
+                        if(loacalBytesRad > 0) {
+                            bytesRead += m_tsFilter->Filter(filterInput.data(), loacalBytesRad, buffer + bytesRead);
+                            continue;
+                        }
+                        // End of input (or no data within timeout).
+                        // Last packet is held back by filter until then, room for it is checked above.
+                        bytesRead += m_tsFilter->Finish(buffer + bytesRead);
+                        break;
+                    }
                     // Use some "common" timeout (30 sec) since it is background process
                     ssize_t loacalBytesRad = m_inputBuffer->Read(buffer + bytesRead, bufferLenght - bytesRead, 30*1000);
                     bytesRead += loacalBytesRad;
                     isError = loacalBytesRad < 0;
                 }
+                if(m_tsFilter) {
+                    CLockObject lock(m_healthAccess);
+                    m_streamHealth = m_tsFilter->Health();
+                }
 
                 if(nullptr != buffer) {
                     m_cache->UnlockAfterWriten(buffer, bytesRead);
@@ -33,6 +33,7 @@
 #include "p8-platform/util/buffer.h"
 #include "input_buffer.h"
 #include "cache_buffer.h"
+#include "ts_packet_filter.hpp"
 #include "Speedometer.h"
 
 namespace Buffers {
@@ -50,6 +51,7 @@ namespace Buffers {
         int64_t Seek(int64_t iPosition, int iWhence);
         bool SwitchStream(const std::string &newUrl);
         void AbortRead();
+        bool GetStreamHealth(TsStreamHealth& health) const;
 //        float GetSpeedRatio() const ;
 
         void SwapCache(ICacheBuffer* cache){
@@ -86,6 +88,10 @@ namespace Buffers {
         ICacheBuffer* m_cacheToSwap;
         bool m_isInputBufferValid;
         bool m_isWaitingForRead;
+        // Filters direct input (HLS segments are filtered by loader)
+        TsPacketFilter* m_tsFilter;
+        mutable P8PLATFORM::CMutex m_healthAccess;
+        TsStreamHealth m_streamHealth;
 //        Helpers::Speedometer m_downloadSpeed;
 //        Helpers::Speedometer m_playbackSpeed;
 
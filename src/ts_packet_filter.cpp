@@ -0,0 +1,292 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <string.h>
+#include "ts_packet_filter.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TS_SCAN_SSE2
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define TS_SCAN_NEON
+#include <arm_neon.h>
+#endif
+
+namespace Buffers {
+
+    static const uint8_t c_syncByte = 0x47;
+    static const uint16_t c_nullPid = 0x1FFF;
+    static const uint8_t c_unknownContinuity = 0xFF;
+
+    static size_t ScanSync(const uint8_t* data, size_t from, size_t last)
+    {
+        const size_t s = TsPacketFilter::PACKET_SIZE;
+        for (size_t i = from; i < last; ++i) {
+            if(data[i] == c_syncByte && data[i + s] == c_syncByte && data[i + 2 * s] == c_syncByte)
+                return i;
+        }
+        return last;
+    }
+
+#if defined(TS_SCAN_SSE2) || defined(TS_SCAN_NEON)
+    static inline int FirstBit(uint32_t mask)
+    {
+#if defined(_MSC_VER)
+        unsigned long idx;
+        _BitScanForward(&idx, mask);
+        return (int)idx;
+#else
+        return __builtin_ctz(mask);
+#endif
+    }
+#endif
+
+    size_t TsPacketFilter::FindSync(const uint8_t* data, size_t size)
+    {
+        const size_t s = PACKET_SIZE;
+        if(size <= 2 * s)
+            return size;
+        // Candidates are [0, last)
+        const size_t last = size - 2 * s;
+        size_t i = 0;
+#if defined(TS_SCAN_SSE2)
+        // 16 candidates per step: sync at offset, offset + 188 and offset + 376
+        const __m128i sync = _mm_set1_epi8((char)c_syncByte);
+        for (; i + 16 <= last; i += 16) {
+            const __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + i)), sync);
+            const __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + i + s)), sync);
+            const __m128i c = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + i + 2 * s)), sync);
+            const uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(_mm_and_si128(a, b), c));
+            if(mask)
+                return i + FirstBit(mask);
+        }
+#elif defined(TS_SCAN_NEON)
+        const uint8x16_t sync = vdupq_n_u8(c_syncByte);
+        for (; i + 16 <= last; i += 16) {
+            const uint8x16_t m = vandq_u8(vandq_u8(vceqq_u8(vld1q_u8(data + i), sync),
+                                                   vceqq_u8(vld1q_u8(data + i + s), sync)),
+                                          vceqq_u8(vld1q_u8(data + i + 2 * s), sync));
+            // Any match? Then find it (rare, i.e. byte loop is fine)
+            const uint64x2_t m64 = vreinterpretq_u64_u8(m);
+            if(vgetq_lane_u64(m64, 0) | vgetq_lane_u64(m64, 1)) {
+                uint8_t bytes[16];
+                vst1q_u8(bytes, m);
+                uint32_t mask = 0;
+                for (int j = 0; j < 16; ++j) {
+                    mask |= (bytes[j] & 1u) << j;
+                }
+                return i + FirstBit(mask);
+            }
+        }
+#endif
+        const size_t found = ScanSync(data, i, last);
+        return found < last ? found : size;
+    }
+
+    size_t TsPacketFilter::FindSyncScalar(const uint8_t* data, size_t size)
+    {
+        if(size <= 2 * PACKET_SIZE)
+            return size;
+        const size_t last = size - 2 * PACKET_SIZE;
+        const size_t found = ScanSync(data, 0, last);
+        return found < last ? found : size;
+    }
+
+    TsPacketFilter::TsPacketFilter()
+    : m_mode(k_Detecting)
+    , m_pendingSize(0)
+    , m_detectionSize(0)
+    , m_detectionScanned(0)
+    {
+        memset(m_continuity, c_unknownContinuity, sizeof(m_continuity));
+    }
+
+    uint32_t TsPacketFilter::ContinuityErrors(uint16_t pid) const
+    {
+        auto it = m_pidErrors.find(pid);
+        return it == m_pidErrors.end() ? 0 : it->second;
+    }
+
+    void TsPacketFilter::CheckContinuity(const uint8_t* packet)
+    {
+        const uint16_t pid = ((packet[1] & 0x1F) << 8) | packet[2];
+        if(c_nullPid == pid)
+            return;
+        const bool hasPayload = (packet[3] & 0x10) != 0;
+        const bool hasAdaptation = (packet[3] & 0x20) != 0;
+        const uint8_t counter = packet[3] & 0x0F;
+        // Discontinuity indicator of adaptation field
+        const bool isDiscontinuity = hasAdaptation && packet[4] > 0 && (packet[5] & 0x80) != 0;
+        uint8_t& last = m_continuity[pid];
+        if(c_unknownContinuity != last && !isDiscontinuity) {
+            // Counter grows with payload only, one duplicate packet is allowed
+            const bool isValid = hasPayload ? (counter == ((last + 1) & 0x0F) || counter == last) : counter == last;
+            if(!isValid) {
+                ++m_health.continuityErrors;
+                ++m_pidErrors[pid];
+            }
+        }
+        last = counter;
+    }
+
+    // Processes contiguous data while it's possible.
+    // Returns offset of unprocessed data (less than MAX_PENDING_SIZE bytes).
+    size_t TsPacketFilter::Scan(const uint8_t* data, size_t size, uint8_t* out, size_t& written)
+    {
+        const size_t s = PACKET_SIZE;
+        size_t pos = 0;
+        while(true) {
+            if(k_Synced == m_mode) {
+                // Packet is valid when next one starts with sync byte too.
+                // Valid run is copied at once.
+                const size_t runStart = pos;
+                while(size - pos > s && data[pos] == c_syncByte && data[pos + s] == c_syncByte) {
+                    CheckContinuity(data + pos);
+                    pos += s;
+                }
+                if(pos > runStart) {
+                    memcpy(out + written, data + runStart, pos - runStart);
+                    written += pos - runStart;
+                    m_health.packets += (pos - runStart) / s;
+                }
+                // Wait for next packet's sync byte
+                if(size - pos <= s)
+                    break;
+                m_mode = k_LostSync;
+                ++m_health.resyncs;
+                // Current packet is corrupted (e.g. truncated)
+                ++pos;
+                ++m_health.droppedBytes;
+            } else if(k_PassThrough == m_mode) {
+                memcpy(out + written, data + pos, size - pos);
+                written += size - pos;
+                return size;
+            } else {
+                if(size - pos < MAX_PENDING_SIZE)
+                    break;
+                const size_t found = FindSync(data + pos, size - pos);
+                if(found == size - pos) {
+                    // Tail may contain start of next valid packet
+                    const size_t tail = 2 * s;
+                    m_health.droppedBytes += size - tail - pos;
+                    pos = size - tail;
+                    break;
+                }
+                m_health.droppedBytes += found;
+                pos += found;
+                m_mode = k_Synced;
+            }
+        }
+        return pos;
+    }
+
+    bool TsPacketFilter::Detect(bool isLast)
+    {
+        const size_t found = FindSync(m_detection + m_detectionScanned, m_detectionSize - m_detectionScanned);
+        if(found < m_detectionSize - m_detectionScanned) {
+            // Garbage before first packet is dropped by sync search
+            m_mode = k_LostSync;
+            return true;
+        }
+        if(!isLast && m_detectionSize < DETECTION_SIZE) {
+            // Candidates up to size - 2 * PACKET_SIZE are checked already
+            if(m_detectionSize > 2 * PACKET_SIZE)
+                m_detectionScanned = m_detectionSize - 2 * PACKET_SIZE;
+            return false;
+        }
+        // Not a transport stream at all (or too short to be detected)
+        m_mode = k_PassThrough;
+        return true;
+    }
+
+    size_t TsPacketFilter::Filter(const uint8_t* in, size_t size, uint8_t* out)
+    {
+        if(k_Detecting != m_mode)
+            return FilterDetected(in, size, out);
+        const size_t taken = size < DETECTION_SIZE - m_detectionSize ? size : DETECTION_SIZE - m_detectionSize;
+        memcpy(m_detection + m_detectionSize, in, taken);
+        m_detectionSize += taken;
+        if(!Detect(false))
+            return 0;
+        // Held back data goes first
+        size_t written = FilterDetected(m_detection, m_detectionSize, out);
+        m_detectionSize = 0;
+        written += FilterDetected(in + taken, size - taken, out + written);
+        return written;
+    }
+
+    size_t TsPacketFilter::FilterDetected(const uint8_t* in, size_t size, uint8_t* out)
+    {
+        size_t written = 0;
+        if(k_PassThrough == m_mode) {
+            memcpy(out, in, size);
+            return size;
+        }
+        // Data held back from previous call and beginning of new one
+        if(m_pendingSize > 0) {
+            uint8_t bridge[2 * MAX_PENDING_SIZE];
+            const size_t taken = size < MAX_PENDING_SIZE ? size : MAX_PENDING_SIZE;
+            memcpy(bridge, m_pending, m_pendingSize);
+            memcpy(bridge + m_pendingSize, in, taken);
+            const size_t bridgeSize = m_pendingSize + taken;
+            const size_t pos = Scan(bridge, bridgeSize, out, written);
+            if(pos < m_pendingSize) {
+                // Short input, i.e. all of it is in the bridge
+                m_pendingSize = bridgeSize - pos;
+                memmove(m_pending, bridge + pos, m_pendingSize);
+                return written;
+            }
+            in += pos - m_pendingSize;
+            size -= pos - m_pendingSize;
+            m_pendingSize = 0;
+        }
+        const size_t pos = Scan(in, size, out, written);
+        m_pendingSize = size - pos;
+        memcpy(m_pending, in + pos, m_pendingSize);
+        return written;
+    }
+
+    size_t TsPacketFilter::Finish(uint8_t* out)
+    {
+        size_t written = 0;
+        if(k_Detecting == m_mode) {
+            Detect(true);
+            written = FilterDetected(m_detection, m_detectionSize, out);
+            m_detectionSize = 0;
+        }
+        if(k_Synced == m_mode && m_pendingSize >= PACKET_SIZE && m_pending[0] == c_syncByte) {
+            CheckContinuity(m_pending);
+            memcpy(out + written, m_pending, PACKET_SIZE);
+            written += PACKET_SIZE;
+            ++m_health.packets;
+            m_health.droppedBytes += m_pendingSize - PACKET_SIZE;
+        } else {
+            m_health.droppedBytes += m_pendingSize;
+        }
+        m_pendingSize = 0;
+        return written;
+    }
+}
@@ -0,0 +1,118 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef __ts_packet_filter_hpp__
+#define __ts_packet_filter_hpp__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <map>
+
+namespace Buffers {
+
+    // Transport stream health counters
+    struct TsStreamHealth
+    {
+        TsStreamHealth() : packets(0), droppedBytes(0), resyncs(0), continuityErrors(0) {}
+        void Add(const TsStreamHealth& h) {
+            packets += h.packets;
+            droppedBytes += h.droppedBytes;
+            resyncs += h.resyncs;
+            continuityErrors += h.continuityErrors;
+        }
+        // Valid packets passed
+        uint64_t packets;
+        // Garbage and partial packets
+        uint64_t droppedBytes;
+        // Sync byte losses
+        uint64_t resyncs;
+        uint64_t continuityErrors;
+    };
+
+    // Passes aligned 188 bytes MPEG-TS packets only.
+    // Corrupted and partial packets are dropped, sync is restored after corruption.
+    // Data that is not transport stream (e.g. packed audio) passes as is.
+    // Stream type is detected on first DETECTION_SIZE bytes (or less on Finish()),
+    // they are held back until then, i.e. output does not depend on input portions.
+    class TsPacketFilter
+    {
+    public:
+        static const size_t PACKET_SIZE = 188;
+        // Max amount of data held back between calls after detection
+        static const size_t MAX_PENDING_SIZE = 3 * PACKET_SIZE;
+        // Max amount of data held back before detection
+        static const size_t DETECTION_SIZE = 16 * 1024;
+
+        TsPacketFilter();
+
+        // Copies valid packets from in to out.
+        // out should have room for size + PendingSize() bytes.
+        // Returns number of bytes written to out.
+        size_t Filter(const uint8_t* in, size_t size, uint8_t* out);
+        // End of data (e.g. segment). Flushes last packet, partial one is dropped.
+        // out should have room for PendingSize() bytes.
+        size_t Finish(uint8_t* out);
+        size_t PendingSize() const {return m_pendingSize + m_detectionSize;}
+        bool IsPassThrough() const {return k_PassThrough == m_mode;}
+
+        const TsStreamHealth& Health() const {return m_health;}
+        uint32_t ContinuityErrors(uint16_t pid) const;
+
+        // Offset of first 3 consecutive sync bytes at packet stride.
+        // Searches offsets up to size - 2 * PACKET_SIZE - 1, returns size when not found.
+        static size_t FindSync(const uint8_t* data, size_t size);
+        // Same without SIMD (reference for tests and benchmark)
+        static size_t FindSyncScalar(const uint8_t* data, size_t size);
+
+    private:
+        enum Mode {
+            k_Detecting,
+            k_Synced,
+            k_LostSync,
+            k_PassThrough
+        };
+
+        TsPacketFilter(const TsPacketFilter&) = delete;
+        TsPacketFilter& operator=(const TsPacketFilter&) = delete;
+
+        size_t Scan(const uint8_t* data, size_t size, uint8_t* out, size_t& written);
+        size_t FilterDetected(const uint8_t* in, size_t size, uint8_t* out);
+        // Decides stream type on held back data. False when more data is needed.
+        bool Detect(bool isLast);
+        void CheckContinuity(const uint8_t* packet);
+
+        Mode m_mode;
+        uint8_t m_pending[MAX_PENDING_SIZE];
+        size_t m_pendingSize;
+        // Data held back while detecting
+        uint8_t m_detection[DETECTION_SIZE];
+        size_t m_detectionSize;
+        // Sync is not found before this offset of m_detection
+        size_t m_detectionScanned;
+        TsStreamHealth m_health;
+        // Last continuity counter per PID, 0xFF - unknown
+        uint8_t m_continuity[8192];
+        std::map<uint16_t, uint32_t> m_pidErrors;
+    };
+}
+#endif /* __ts_packet_filter_hpp__ */
@@ -0,0 +1,213 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "aes_decryptor.hpp"
+#include "test_utils.hpp"
+
+using namespace Buffers;
+
+namespace {
+
+    struct KnownAnswer
+    {
+        const char* name;
+        const char* key;
+        const char* iv;
+        const char* plaintext;
+        const char* ciphertext;
+    };
+
+    // FIPS-197 appendix C.1 (single block, CBC with zero IV is ECB)
+    // and RFC 3602 section 4 AES-128-CBC test cases.
+    const KnownAnswer c_knownAnswers[] = {
+        {"FIPS-197 C.1",
+            "000102030405060708090a0b0c0d0e0f",
+            "00000000000000000000000000000000",
+            "00112233445566778899aabbccddeeff",
+            "69c4e0d86a7b0430d8cdb78070b4c55a"},
+        {"RFC 3602 case 1",
+            "06a9214036b8a15b512e03d534120006",
+            "3dafba429d9eb430b422da802c9fac41",
+            "53696e676c6520626c6f636b206d7367", // "Single block msg"
+            "e353779c1079aeb82708942dbe77181a"},
+        {"RFC 3602 case 2",
+            "c286696d887c9aa0611bbb3e2025a45a",
+            "562e17996d093d28ddb3ba695a2e6f58",
+            "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f",
+            "d296cd94c2cccf8a3a863028b5e1dc0a7586602d253cfff91b8266bea6d61ab1"},
+        {"RFC 3602 case 3",
+            "6c3ea0477630ce21a2ce334aa746c2cd",
+            "c782dc4c098c66cbd9cd27d825682c81",
+            "5468697320697320612034382d62797465206d657373616765202865786163746c7920332041455320626c6f636b7329",
+            "d0a02b3836451753d493665d33f0e8862dea54cdb293abc7506939276772f8d5021c19216bad525c8579695d83ba2684"},
+        {"RFC 3602 case 4",
+            "56e47a38c5598974bc46903dba290349",
+            "8ce82eefbea0da3c44699ed7db51b7d9",
+            "a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebfc0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf",
+            "c30e32ffedc0774e6aff6af0869f71aa0f3af07a9a31a9c684db207eb0ef8e4e35907aa632c3ffdf868bb7b29d3d46ad83ce9f9a102ee99d49a53e87f4c3da55"},
+    };
+
+    // Vectors have no PKCS7 padding: one more block makes Update() decrypt all of them.
+    std::vector<uint8_t> DecryptUnpadded(const KnownAnswer& v, bool allowHardware)
+    {
+        const auto key = FromHex(v.key);
+        const auto iv = FromHex(v.iv);
+        auto ciphertext = FromHex(v.ciphertext);
+        ciphertext.resize(ciphertext.size() + AesDecryptor::BLOCK_SIZE, 0);
+        AesDecryptor decryptor(key.data(), iv.data(), allowHardware);
+        std::vector<uint8_t> out(ciphertext.size() + AesDecryptor::BLOCK_SIZE);
+        out.resize(decryptor.Update(ciphertext.data(), ciphertext.size(), out.data()));
+        return out;
+    }
+
+    void TestKnownAnswers(bool allowHardware)
+    {
+        for (const auto& v : c_knownAnswers) {
+            const bool isEqual = DecryptUnpadded(v, allowHardware) == FromHex(v.plaintext);
+            if(!isEqual)
+                fprintf(stderr, "%s (hardware %d)\n", v.name, allowHardware);
+            TEST_CHECK(isEqual);
+        }
+    }
+
+    // FIPS-197 block decrypts to 0x10 x 16 (full padding block) with IV = plaintext ^ 0x10
+    void TestPadding(bool allowHardware)
+    {
+        const auto& v = c_knownAnswers[0];
+        const auto key = FromHex(v.key);
+        const auto ciphertext = FromHex(v.ciphertext);
+        auto iv = FromHex(v.plaintext);
+        for (auto& b : iv) {
+            b ^= 0x10;
+        }
+        uint8_t out[2 * AesDecryptor::BLOCK_SIZE];
+        size_t size = 1;
+        {
+            AesDecryptor decryptor(key.data(), iv.data(), allowHardware);
+            TEST_CHECK(0 == decryptor.Update(ciphertext.data(), ciphertext.size(), out));
+            TEST_CHECK(decryptor.Finish(out, size));
+            TEST_CHECK(0 == size);
+        }
+        // Last plaintext byte 0xff is not valid padding
+        {
+            const auto zeroIv = FromHex(v.iv);
+            AesDecryptor decryptor(key.data(), zeroIv.data(), allowHardware);
+            decryptor.Update(ciphertext.data(), ciphertext.size(), out);
+            TEST_CHECK(!decryptor.Finish(out, size));
+        }
+        // Truncated data
+        {
+            AesDecryptor decryptor(key.data(), iv.data(), allowHardware);
+            decryptor.Update(ciphertext.data(), ciphertext.size() - 1, out);
+            TEST_CHECK(!decryptor.Finish(out, size));
+        }
+    }
+
+    struct StreamResult
+    {
+        std::vector<uint8_t> data;
+        bool isFinished;
+    };
+
+    // Decrypts data fed by chunks of random size (0 - whole data at once)
+    StreamResult DecryptStream(const std::vector<uint8_t>& ciphertext, const uint8_t* key, const uint8_t* iv,
+                               bool allowHardware, size_t maxChunk, TestRandom& random)
+    {
+        AesDecryptor decryptor(key, iv, allowHardware);
+        StreamResult result;
+        result.data.resize(ciphertext.size() + AesDecryptor::BLOCK_SIZE);
+        size_t written = 0;
+        size_t pos = 0;
+        while(pos < ciphertext.size()) {
+            const size_t rest = ciphertext.size() - pos;
+            const size_t chunk = 0 == maxChunk ? rest : std::min(random.Range(1, maxChunk), rest);
+            written += decryptor.Update(ciphertext.data() + pos, chunk, result.data.data() + written);
+            pos += chunk;
+        }
+        size_t last = 0;
+        result.isFinished = decryptor.Finish(result.data.data() + written, last);
+        result.data.resize(written + last);
+        return result;
+    }
+
+    void TestStreaming()
+    {
+        TestRandom random;
+        std::vector<uint8_t> key(AesDecryptor::KEY_SIZE), iv(AesDecryptor::BLOCK_SIZE);
+        random.Fill(key);
+        random.Fill(iv);
+        // Segment sized data, last block forms valid padding (see TestPadding)
+        const auto& v = c_knownAnswers[0];
+        std::vector<uint8_t> ciphertext(256 * 1024);
+        random.Fill(ciphertext);
+
+        const StreamResult reference = DecryptStream(ciphertext, key.data(), iv.data(), false, 0, random);
+        TEST_CHECK(reference.data.size() >= ciphertext.size() - AesDecryptor::BLOCK_SIZE);
+        for (int hardware = 0; hardware < 2; ++hardware) {
+            const bool allowHardware = hardware != 0;
+            const size_t maxChunks[] = {1, 15, 17, 188, 1500, 64 * 1024};
+            for (size_t maxChunk : maxChunks) {
+                const StreamResult result = DecryptStream(ciphertext, key.data(), iv.data(), allowHardware, maxChunk, random);
+                TEST_CHECK(result.isFinished == reference.isFinished);
+                TEST_CHECK(result.data == reference.data);
+            }
+        }
+        // Padded stream: known answer block chained after random blocks
+        {
+            const auto fipsKey = FromHex(v.key);
+            std::vector<uint8_t> padded(1024);
+            random.Fill(padded);
+            // Previous ciphertext block is IV of the last one
+            auto previous = FromHex(v.plaintext);
+            for (auto& b : previous) {
+                b ^= 0x10;
+            }
+            padded.insert(padded.end(), previous.begin(), previous.end());
+            const auto last = FromHex(v.ciphertext);
+            padded.insert(padded.end(), last.begin(), last.end());
+            const StreamResult whole = DecryptStream(padded, fipsKey.data(), iv.data(), true, 0, random);
+            TEST_CHECK(whole.isFinished);
+            TEST_CHECK(whole.data.size() == padded.size() - AesDecryptor::BLOCK_SIZE);
+            for (int i = 0; i < 20; ++i) {
+                const StreamResult chunked = DecryptStream(padded, fipsKey.data(), iv.data(), i % 2 == 0, 100, random);
+                TEST_CHECK(chunked.isFinished);
+                TEST_CHECK(chunked.data == whole.data);
+            }
+        }
+    }
+}
+
+int main()
+{
+    printf("AES hardware acceleration: %s\n", AesDecryptor::IsHardwareAccelerated() ? "yes" : "no");
+    TestKnownAnswers(false);
+    TestKnownAnswers(true);
+    TestPadding(false);
+    TestPadding(true);
+    TestStreaming();
+    return TestResult("aes_decryptor_test");
+}
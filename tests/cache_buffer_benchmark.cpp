@@ -0,0 +1,113 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+// Throughput of memory timeshift caches, one writer and one reader thread:
+//   cache_buffer_benchmark [megabytes]
+// Chunked MemoryCacheBuffer is compared with preallocated RingCacheBuffer of the same size.
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "memory_cache_buffer.hpp"
+#include "ring_cache_buffer.hpp"
+#include "test_utils.hpp"
+
+using namespace Buffers;
+
+namespace {
+
+    const size_t c_cacheSize = 16 * 1024 * 1024;
+
+    // Writer copies stream into cache units, reader drains the cache.
+    // Best of several runs, MB/s
+    double Measure(const char* name, size_t bytes, std::function<ICacheBuffer*()> createCache)
+    {
+        std::vector<uint8_t> input(1024 * 1024);
+        TestRandom random;
+        random.Fill(input);
+        double best = 0.0;
+        for (int i = 0; i < 5; ++i) {
+            std::unique_ptr<ICacheBuffer> cache(createCache());
+            cache->Init();
+            const size_t unitSize = cache->UnitSize();
+            const int64_t streamLength = bytes / unitSize * unitSize;
+            uint64_t inputSum = 0;
+            const auto started = std::chrono::steady_clock::now();
+            std::thread writer([&] {
+                int64_t written = 0;
+                while (written < streamLength) {
+                    uint8_t* unit = nullptr;
+                    if(!cache->LockUnitForWrite(&unit)) {
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    const uint8_t* source = &input[written % input.size()];
+                    memcpy(unit, source, unitSize);
+                    inputSum += source[0];
+                    cache->UnlockAfterWriten(unit, unitSize);
+                    written += unitSize;
+                }
+            });
+            std::vector<uint8_t> output(unitSize);
+            uint64_t outputSum = 0;
+            int64_t totalRead = 0;
+            while (totalRead < streamLength) {
+                const ssize_t bytesRead = cache->Read(output.data(), output.size());
+                if(bytesRead <= 0) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                // Reads are unit aligned
+                outputSum += output[0];
+                totalRead += bytesRead;
+            }
+            writer.join();
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+            TEST_CHECK(totalRead == streamLength);
+            TEST_CHECK(outputSum == inputSum);
+            best = std::max(best, streamLength / elapsed.count() / (1024 * 1024));
+        }
+        printf("%-32s %10.1f MB/s\n", name, best);
+        return best;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const size_t megabytes = argc > 1 ? (size_t)atoi(argv[1]) : 1024;
+    const size_t bytes = megabytes * 1024 * 1024;
+    printf("%zu MB through %zu MB cache\n", megabytes, c_cacheSize / (1024 * 1024));
+
+    Measure("MemoryCacheBuffer", bytes, [] {
+        return new MemoryCacheBuffer(c_cacheSize / MemoryCacheBuffer::CHUNK_SIZE_LIMIT);
+    });
+    Measure("RingCacheBuffer", bytes, [] {
+        return new RingCacheBuffer(c_cacheSize);
+    });
+    return TestResult("cache_buffer_benchmark");
+}
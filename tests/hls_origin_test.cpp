@@ -0,0 +1,229 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+// Encrypted HLS segments generated locally (OpenSSL as reference encryptor)
+// and served by stand-in origin on loopback interface.
+// Client side mirrors segment pipeline: key is loaded once per URI,
+// segment data is decrypted by portions of network-like size.
+
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <openssl/evp.h>
+#include "httplib.h"
+#include "aes_decryptor.hpp"
+#include "test_utils.hpp"
+
+using namespace Buffers;
+
+namespace {
+
+    const size_t c_tsPacketSize = 188;
+    const int c_segmentsCount = 5;
+    const uint64_t c_firstMediaSequence = 1234567;
+
+    // TS packets with incremented continuity counter
+    std::vector<uint8_t> MakeTsSegment(size_t packets, uint8_t& continuityCounter, TestRandom& random)
+    {
+        std::vector<uint8_t> segment(packets * c_tsPacketSize);
+        random.Fill(segment);
+        for (size_t pos = 0; pos < segment.size(); pos += c_tsPacketSize) {
+            segment[pos] = 0x47;
+            segment[pos + 1] = 0x01;
+            segment[pos + 2] = 0x00;
+            segment[pos + 3] = 0x10 | (continuityCounter++ & 0x0F);
+        }
+        return segment;
+    }
+
+    // HLS default IV: media sequence number as big-endian 128-bit integer
+    std::vector<uint8_t> SequenceIv(uint64_t mediaSequence)
+    {
+        std::vector<uint8_t> iv(AesDecryptor::BLOCK_SIZE, 0);
+        for (int i = 0; i < 8; ++i) {
+            iv[15 - i] = (uint8_t)(mediaSequence >> (8 * i));
+        }
+        return iv;
+    }
+
+    // AES-128-CBC with PKCS7 padding
+    std::vector<uint8_t> Encrypt(const std::vector<uint8_t>& data, const std::vector<uint8_t>& key, const std::vector<uint8_t>& iv)
+    {
+        std::vector<uint8_t> out(data.size() + AesDecryptor::BLOCK_SIZE);
+        EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+        int size = 0, finalSize = 0;
+        EVP_EncryptInit_ex(ctx, EVP_aes_128_cbc(), nullptr, key.data(), iv.data());
+        EVP_EncryptUpdate(ctx, out.data(), &size, data.data(), (int)data.size());
+        EVP_EncryptFinal_ex(ctx, out.data() + size, &finalSize);
+        EVP_CIPHER_CTX_free(ctx);
+        out.resize(size + finalSize);
+        return out;
+    }
+
+    std::string ToHex(const std::vector<uint8_t>& data)
+    {
+        static const char* c_digits = "0123456789abcdef";
+        std::string hex;
+        for (uint8_t b : data) {
+            hex += c_digits[b >> 4];
+            hex += c_digits[b & 0x0F];
+        }
+        return hex;
+    }
+
+    std::string ToString(const std::vector<uint8_t>& data)
+    {
+        return std::string(data.begin(), data.end());
+    }
+
+    struct Origin
+    {
+        std::vector<uint8_t> key;
+        std::string playlist;
+        // Path -> content
+        std::map<std::string, std::string> files;
+        std::vector<std::vector<uint8_t>> plaintexts;
+        std::vector<std::vector<uint8_t>> ivs;
+        std::map<std::string, int> requests;
+    };
+
+    void GenerateContent(Origin& origin, TestRandom& random)
+    {
+        origin.key.resize(AesDecryptor::KEY_SIZE);
+        random.Fill(origin.key);
+        origin.files["/key.bin"] = ToString(origin.key);
+
+        origin.playlist = "#EXTM3U\n#EXT-X-VERSION:3\n#EXT-X-TARGETDURATION:4\n";
+        origin.playlist += "#EXT-X-MEDIA-SEQUENCE:" + std::to_string(c_firstMediaSequence) + "\n";
+        origin.playlist += "#EXT-X-KEY:METHOD=AES-128,URI=\"key.bin\"\n";
+        uint8_t continuityCounter = 0;
+        for (int i = 0; i < c_segmentsCount; ++i) {
+            // Odd segments have explicit IV
+            std::vector<uint8_t> iv = SequenceIv(c_firstMediaSequence + i);
+            if(i % 2 == 1) {
+                random.Fill(iv);
+                origin.playlist += "#EXT-X-KEY:METHOD=AES-128,URI=\"key.bin\",IV=0x" + ToHex(iv) + "\n";
+            }
+            // Different sizes to get different padding
+            const auto plaintext = MakeTsSegment(random.Range(200, 1000), continuityCounter, random);
+            const std::string name = "seg" + std::to_string(i) + ".ts";
+            origin.playlist += "#EXTINF:4.0,\n" + name + "\n";
+            origin.files["/" + name] = ToString(Encrypt(plaintext, origin.key, iv));
+            origin.plaintexts.push_back(plaintext);
+            origin.ivs.push_back(iv);
+        }
+        origin.playlist += "#EXT-X-ENDLIST\n";
+        origin.files["/index.m3u8"] = origin.playlist;
+    }
+
+    // Feeds downloaded body to decryptor by portions (as it arrives from network)
+    bool DecryptSegment(const std::string& body, const uint8_t* key, const uint8_t* iv,
+                        std::vector<uint8_t>& out, TestRandom& random)
+    {
+        AesDecryptor decryptor(key, iv);
+        out.resize(body.size() + AesDecryptor::BLOCK_SIZE);
+        size_t written = 0;
+        size_t pos = 0;
+        while(pos < body.size()) {
+            const size_t chunk = std::min(random.Range(1, 16 * 1024), body.size() - pos);
+            written += decryptor.Update((const uint8_t*)body.data() + pos, chunk, out.data() + written);
+            pos += chunk;
+        }
+        size_t last = 0;
+        if(!decryptor.Finish(out.data() + written, last))
+            return false;
+        out.resize(written + last);
+        return true;
+    }
+}
+
+int main()
+{
+    TestRandom random;
+    Origin origin;
+    GenerateContent(origin, random);
+
+    httplib::Server server;
+    server.Get(".*", [&origin](const httplib::Request& req, httplib::Response& res) {
+        ++origin.requests[req.path];
+        auto file = origin.files.find(req.path);
+        if(file == origin.files.end()) {
+            res.status = 404;
+            return;
+        }
+        res.set_content(file->second, "application/octet-stream");
+    });
+    const int port = server.bind_to_any_port("127.0.0.1");
+    if(port <= 0) {
+        fprintf(stderr, "Can't bind stand-in origin.\n");
+        return 1;
+    }
+    std::thread serverThread([&server] { server.listen_after_bind(); });
+
+    {
+        httplib::Client client("127.0.0.1", port, 5);
+        auto playlist = client.Get("/index.m3u8");
+        TEST_CHECK(playlist && 200 == playlist->status && playlist->body == origin.playlist);
+
+        // Key cache per URI
+        std::map<std::string, std::string> keys;
+        for (int i = 0; i < c_segmentsCount; ++i) {
+            const std::string keyUri = "/key.bin";
+            if(keys.count(keyUri) == 0) {
+                auto key = client.Get(keyUri.c_str());
+                TEST_CHECK(key && 200 == key->status && key->body.size() == AesDecryptor::KEY_SIZE);
+                if(!key || key->body.size() != AesDecryptor::KEY_SIZE)
+                    break;
+                keys[keyUri] = key->body;
+            }
+            const std::string path = "/seg" + std::to_string(i) + ".ts";
+            auto segment = client.Get(path.c_str());
+            TEST_CHECK(segment && 200 == segment->status);
+            if(!segment)
+                continue;
+            // Encrypted data is padded to block size
+            TEST_CHECK(0 == segment->body.size() % AesDecryptor::BLOCK_SIZE);
+            TEST_CHECK(segment->body.size() > origin.plaintexts[i].size());
+            std::vector<uint8_t> decrypted;
+            TEST_CHECK(DecryptSegment(segment->body, (const uint8_t*)keys[keyUri].data(), origin.ivs[i].data(), decrypted, random));
+            TEST_CHECK(decrypted == origin.plaintexts[i]);
+        }
+        // Wrong IV breaks first block only (CBC)
+        auto segment = client.Get("/seg0.ts");
+        if(segment) {
+            std::vector<uint8_t> decrypted;
+            const auto wrongIv = SequenceIv(c_firstMediaSequence + 1);
+            TEST_CHECK(DecryptSegment(segment->body, origin.key.data(), wrongIv.data(), decrypted, random));
+            TEST_CHECK(decrypted != origin.plaintexts[0]);
+            TEST_CHECK(std::equal(decrypted.begin() + AesDecryptor::BLOCK_SIZE, decrypted.end(),
+                                  origin.plaintexts[0].begin() + AesDecryptor::BLOCK_SIZE));
+        }
+    }
+    server.stop();
+    serverThread.join();
+    TEST_CHECK(1 == origin.requests["/key.bin"]);
+    return TestResult("hls_origin_test");
+}
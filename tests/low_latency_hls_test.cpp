@@ -0,0 +1,249 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+// Low-latency HLS against stand-in live origin, which publishes a part every 200 ms.
+// Origin holds blocking playlist reloads (_HLS_msn/_HLS_part) and preload hint requests until the part is published.
+// Partial segment is read by parts before the segment is completed,
+// glass-to-glass latency is measured from capture time of each TS packet.
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "plist_buffer.h"
+#include "test_origin.hpp"
+#include "test_utils.hpp"
+
+using namespace Buffers;
+
+namespace {
+
+    typedef std::chrono::steady_clock Clock;
+
+    const size_t c_packetSize = TsPacketFilter::PACKET_SIZE;
+    const size_t c_partPackets = 20;
+    const int c_partsPerSegment = 5;
+    const double c_partDuration = 0.2;
+    const double c_segmentDuration = c_partsPerSegment * c_partDuration;
+    const int c_windowSegments = 4;
+    // Parts to read, the first segment is a start-up (reader catches up with live edge)
+    const uint64_t c_partsToRead = 6 * c_partsPerSegment;
+    const uint64_t c_warmUpParts = c_partsPerSegment;
+
+    // Encoder captures part k of segment n in [(n * c_partsPerSegment + k) * c_partDuration, +c_partDuration)
+    // from origin start, and publishes it at the end of this interval.
+    Clock::time_point s_start;
+    std::atomic<bool> s_isStopped(false);
+    std::atomic<int> s_blockingReloads(0);
+    std::atomic<int> s_heldReloads(0);
+    std::atomic<int> s_partsBeforeSegment(0);
+
+    Clock::time_point CaptureTime(uint64_t part, size_t packet)
+    {
+        const double seconds = (part + (double)packet / c_partPackets) * c_partDuration;
+        return s_start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    }
+
+    Clock::time_point PublishTime(uint64_t part)
+    {
+        return CaptureTime(part + 1, 0);
+    }
+
+    uint64_t PublishedParts()
+    {
+        const std::chrono::duration<double> elapsed = Clock::now() - s_start;
+        return (uint64_t)(elapsed.count() / c_partDuration);
+    }
+
+    // Holds request until the part is published, false on timeout
+    bool WaitForPart(uint64_t part, std::chrono::milliseconds timeout)
+    {
+        const auto deadline = Clock::now() + timeout;
+        while (PublishedParts() <= part) {
+            if(s_isStopped || Clock::now() > deadline)
+                return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        return true;
+    }
+
+    // Valid TS packets (continuous counter), payload starts with part number and packet index in part
+    std::string MakePart(uint64_t part)
+    {
+        std::string data(c_partPackets * c_packetSize, '\0');
+        TestRandom random((uint32_t)part + 1);
+        for (size_t i = 0; i < c_partPackets; ++i) {
+            char* packet = &data[i * c_packetSize];
+            packet[0] = 0x47;
+            packet[1] = 0x01;
+            packet[2] = 0x00;
+            packet[3] = (char)(0x10 | ((part * c_partPackets + i) & 0x0F));
+            const uint64_t header[2] = {part, i};
+            memcpy(packet + 4, header, sizeof(header));
+            for (size_t j = 4 + sizeof(header); j < c_packetSize; ++j) {
+                packet[j] = (char)random.Next();
+            }
+        }
+        return data;
+    }
+
+    std::string MakePlaylist(uint64_t publishedParts)
+    {
+        const uint64_t segments = publishedParts / c_partsPerSegment;
+        const uint64_t first = segments > c_windowSegments ? segments - c_windowSegments : 0;
+        std::string data = "#EXTM3U\n#EXT-X-VERSION:6\n#EXT-X-TARGETDURATION:1\n";
+        data += "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=0.6\n";
+        data += "#EXT-X-PART-INF:PART-TARGET=0.2\n";
+        data += "#EXT-X-MEDIA-SEQUENCE:" + std::to_string(first) + "\n";
+        for (uint64_t n = first; n <= segments; ++n) {
+            // Parts of the last two complete segments and of the incomplete one
+            const int parts = n < segments ? c_partsPerSegment : (int)(publishedParts % c_partsPerSegment);
+            for (int k = 0; k < parts && n + 2 >= segments; ++k) {
+                data += "#EXT-X-PART:DURATION=0.2,URI=\"" + std::to_string(n) + "." + std::to_string(k) + ".ts\",INDEPENDENT=YES\n";
+            }
+            if(n < segments)
+                data += "#EXTINF:1.0,\n" + std::to_string(n) + ".ts\n";
+            else
+                data += "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"" + std::to_string(n) + "." + std::to_string(parts) + ".ts\"\n";
+        }
+        return data;
+    }
+
+    void OriginHandler(const httplib::Request& req, httplib::Response& res)
+    {
+        unsigned long long segment = 0, part = 0;
+        if(req.path == "/live.m3u8") {
+            if(req.has_param("_HLS_msn")) {
+                ++s_blockingReloads;
+                // _HLS_part past the last part of segment is a part of following segment
+                const uint64_t awaited = std::stoull(req.get_param_value("_HLS_msn")) * c_partsPerSegment
+                                       + (req.has_param("_HLS_part") ? std::stoull(req.get_param_value("_HLS_part")) : 0);
+                if(PublishedParts() <= awaited)
+                    ++s_heldReloads;
+                // Spec: respond in 3 target durations anyway
+                WaitForPart(awaited, std::chrono::milliseconds(3000));
+            }
+            res.set_content(MakePlaylist(PublishedParts()), "application/vnd.apple.mpegurl");
+        } else if(2 == sscanf(req.path.c_str(), "/%llu.%llu.ts", &segment, &part)) {
+            // Preload hint is held until the part is published
+            const uint64_t index = segment * c_partsPerSegment + part;
+            if(!WaitForPart(index, std::chrono::milliseconds(3000))) {
+                res.status = 404;
+                return;
+            }
+            if(Clock::now() < PublishTime(segment * c_partsPerSegment + c_partsPerSegment - 1))
+                ++s_partsBeforeSegment;
+            res.set_content(MakePart(index), "video/mp2t");
+        } else if(1 == sscanf(req.path.c_str(), "/%llu.ts", &segment)) {
+            std::string data;
+            for (int k = 0; k < c_partsPerSegment; ++k) {
+                const uint64_t index = segment * c_partsPerSegment + k;
+                if(!WaitForPart(index, std::chrono::milliseconds(3000))) {
+                    res.status = 404;
+                    return;
+                }
+                data += MakePart(index);
+            }
+            res.set_content(data, "video/mp2t");
+        } else {
+            res.status = 404;
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    TestOrigin origin(OriginHandler);
+    TEST_CHECK(origin.IsRunning());
+    if(!origin.IsRunning())
+        return TestResult("low_latency_hls_test");
+
+    // Live stream runs for a while already
+    s_start = Clock::now() - std::chrono::milliseconds((int)(2.5 * c_segmentDuration * 1000));
+    PlaylistBuffer::SetNumberOfHlsTreads(2);
+    PlaylistBuffer::SetAdaptiveHlsThreads(false);
+    PlaylistBuffer::SetNumberOfSegmentRanges(1);
+    PlaylistBuffer::SetLiveStartSegments(0);
+
+    bool isContiguous = true;
+    uint64_t firstPart = 0, partsRead = 0;
+    size_t nextPacket = 0;
+    int segmentsBeforeCompletion = 0, measuredSegments = 0;
+    double latencySum = 0.0, maxLatency = 0.0;
+    size_t measuredPackets = 0;
+    {
+        std::unique_ptr<PlaylistBuffer> buffer(new PlaylistBuffer(origin.Url("/live.m3u8"), nullptr, false));
+        uint8_t packet[c_packetSize];
+        while (isContiguous && partsRead < c_partsToRead) {
+            // Packet by packet, Read waits for whole buffer
+            if(buffer->Read(packet, sizeof(packet), 5000) != sizeof(packet)) {
+                isContiguous = false;
+                break;
+            }
+            const auto readTime = Clock::now();
+            uint64_t header[2];
+            memcpy(header, packet + 4, sizeof(header));
+            const uint64_t part = header[0];
+            if(0 == partsRead && 0 == nextPacket)
+                firstPart = part;
+            isContiguous = packet[0] == 0x47 && part == firstPart + partsRead && header[1] == nextPacket;
+            if(++nextPacket == c_partPackets) {
+                nextPacket = 0;
+                ++partsRead;
+            }
+            if(part - firstPart < c_warmUpParts)
+                continue;
+            const std::chrono::duration<double> latency = readTime - CaptureTime(part, header[1]);
+            latencySum += latency.count();
+            maxLatency = std::max(maxLatency, latency.count());
+            ++measuredPackets;
+            // Segment starts to play before it's completed on origin
+            if(0 == header[1] && 0 == part % c_partsPerSegment) {
+                ++measuredSegments;
+                if(readTime < PublishTime(part + c_partsPerSegment - 1))
+                    ++segmentsBeforeCompletion;
+            }
+        }
+        s_isStopped = true;
+    }
+    TEST_CHECK(isContiguous);
+    TEST_CHECK(partsRead == c_partsToRead);
+    const double meanLatency = measuredPackets > 0 ? latencySum / measuredPackets : 0.0;
+    printf("Started from part %d of segment #%d\n", (int)(firstPart % c_partsPerSegment), (int)(firstPart / c_partsPerSegment));
+    printf("Glass-to-glass latency: mean %0.3f s, max %0.3f s (part %0.1f s, segment %0.1f s)\n", meanLatency, maxLatency, c_partDuration, c_segmentDuration);
+    printf("Blocking reloads %d (held %d), parts served before their segment %d, segments read before completion %d of %d\n",
+           (int)s_blockingReloads, (int)s_heldReloads, (int)s_partsBeforeSegment, segmentsBeforeCompletion, measuredSegments);
+    TEST_CHECK(measuredPackets > 0);
+    // Whole segment loading can't start before the segment is completed, i.e. its mean latency exceeds segment duration
+    TEST_CHECK(meanLatency < c_segmentDuration / 2);
+    TEST_CHECK(s_blockingReloads > 0);
+    TEST_CHECK(s_heldReloads > 0);
+    TEST_CHECK(s_partsBeforeSegment > 0);
+    TEST_CHECK(measuredSegments > 0);
+    TEST_CHECK(segmentsBeforeCompletion == measuredSegments);
+    return TestResult("low_latency_hls_test");
+}
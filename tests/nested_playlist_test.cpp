@@ -0,0 +1,144 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+
+// Segments of TTV/ACE streams are nested playlists of media segments.
+// Nested media segments are appended in playlist order, prefetches of all loaders
+// are bounded by the number of loaders.
+
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include "plist_buffer.h"
+#include "test_origin.hpp"
+#include "test_utils.hpp"
+
+using namespace Buffers;
+
+namespace {
+
+    const int c_segments = 3;
+    const int c_nestedSegments = 8;
+    const size_t c_nestedSize = 100 * 1000;
+    const size_t c_connectionRate = 1000 * 1000;
+    const int c_loaders = 3;
+
+    // Nested playlist has absolute URLs only
+    std::string s_originUrl;
+    std::atomic<int> s_nestedRequests(0);
+    std::atomic<int> s_maxNestedRequests(0);
+
+    std::string NestedSegment(int segment, int nested)
+    {
+        std::string data(c_nestedSize, '\0');
+        TestRandom random(segment * c_nestedSegments + nested + 1);
+        for (auto& c : data) {
+            c = (char)random.Next();
+        }
+        return data;
+    }
+
+    void OriginHandler(const httplib::Request& req, httplib::Response& res)
+    {
+        int segment = 0, nested = 0;
+        if(req.path == "/index.m3u8") {
+            std::string data = "#EXTM3U\n#EXT-X-TARGETDURATION:5\n#EXT-X-MEDIA-SEQUENCE:0\n";
+            for (int i = 0; i < c_segments; ++i) {
+                data += "#EXTINF:5.0,\n" + std::to_string(i) + ".m3u8\n";
+            }
+            res.set_content(data, "application/vnd.apple.mpegurl");
+        } else if(2 == sscanf(req.path.c_str(), "/%d/%d.ts", &segment, &nested)) {
+            const int requests = ++s_nestedRequests;
+            int maxRequests = s_maxNestedRequests;
+            while(requests > maxRequests && !s_maxNestedRequests.compare_exchange_weak(maxRequests, requests))
+                ;
+            std::shared_ptr<bool> isCounted = std::make_shared<bool>(true);
+            TestOrigin::SetThrottledContent(res, NestedSegment(segment, nested), [] {return c_connectionRate;});
+            // Request is over with last portion of body (client may start next one before final call)
+            auto streamcb = res.streamcb;
+            res.streamcb = [streamcb, isCounted](uint64_t offset) {
+                std::string portion = streamcb(offset);
+                if(offset + portion.size() >= c_nestedSize && *isCounted) {
+                    *isCounted = false;
+                    --s_nestedRequests;
+                }
+                return portion;
+            };
+        } else if(1 == sscanf(req.path.c_str(), "/%d.m3u8", &segment)) {
+            // Segment of outer playlist is a playlist of nested segments
+            std::string data = "#EXTM3U\n#EXT-X-TARGETDURATION:1\n";
+            for (int i = 0; i < c_nestedSegments; ++i) {
+                data += "#EXTINF:1.0,\n" + s_originUrl + "/" + std::to_string(segment) + "/" + std::to_string(i) + ".ts\n";
+            }
+            data += "#EXT-X-ENDLIST\n";
+            res.set_content(data, "application/vnd.apple.mpegurl");
+        } else {
+            res.status = 404;
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    TestOrigin origin(OriginHandler);
+    TEST_CHECK(origin.IsRunning());
+    if(!origin.IsRunning())
+        return TestResult("nested_playlist_test");
+
+    s_originUrl = origin.Url("");
+    // Limited by number of CPUs
+    const int loaders = PlaylistBuffer::SetNumberOfHlsTreads(c_loaders);
+    PlaylistBuffer::SetAdaptiveHlsThreads(false);
+    PlaylistBuffer::SetNumberOfSegmentRanges(1);
+    PlaylistBuffer::SetLiveStartSegments(0);
+
+    std::string expected;
+    for (int i = 0; i < c_segments; ++i) {
+        for (int j = 0; j < c_nestedSegments; ++j) {
+            expected += NestedSegment(i, j);
+        }
+    }
+    std::string stream;
+    {
+        std::unique_ptr<PlaylistBuffer> buffer(new PlaylistBuffer(origin.Url("/index.m3u8"), nullptr, false));
+        std::vector<unsigned char> portion(64 * 1024);
+        while(stream.size() < expected.size()) {
+            // Read waits for whole portion, i.e. the end of live stream is not awaited
+            const ssize_t bytesRead = buffer->Read(&portion[0], std::min(portion.size(), expected.size() - stream.size()), 10000);
+            if(bytesRead <= 0)
+                break;
+            stream.append((const char*)&portion[0], bytesRead);
+        }
+    }
+    TEST_CHECK(stream.size() == expected.size());
+    TEST_CHECK(stream == expected);
+    // Each loader streams one nested segment, prefetches of all loaders share (loaders - 1) connections
+    printf("Max concurrent nested requests %d\n", (int)s_maxNestedRequests);
+    TEST_CHECK(s_maxNestedRequests <= 2 * loaders - 1);
+    if(loaders > 1)
+        TEST_CHECK(s_maxNestedRequests > 1);
+    return TestResult("nested_playlist_test");
+}
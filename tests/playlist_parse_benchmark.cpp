@@ -0,0 +1,117 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+// Parsing speed of big live playlist (10k segments by default):
+//   playlist_parse_benchmark [iterations] [segments]
+// Full parse of new playlist and incremental reload of sliding window are measured.
+// Parsed segments are checked, i.e. benchmark fails on wrong parsing.
+
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include "Playlist.hpp"
+#include "test_utils.hpp"
+
+using namespace Buffers;
+
+namespace {
+
+    const uint64_t c_firstMediaSequence = 1000000;
+
+    // Live media playlist of [first, first + segments) window.
+    // Every segment has key rotation, byte range and date-time tags as seen at real origins.
+    std::string MakePlaylist(uint64_t first, size_t segments)
+    {
+        std::string data = "#EXTM3U\n#EXT-X-VERSION:6\n#EXT-X-TARGETDURATION:6\n#EXT-X-MEDIA-SEQUENCE:" + std::to_string(first) + "\n";
+        data.reserve(segments * 200);
+        for (uint64_t i = first; i < first + segments; ++i) {
+            if(0 == i % 100)
+                data += "#EXT-X-KEY:METHOD=AES-128,URI=\"http://origin.test/keys/" + std::to_string(i / 100) + ".key\",IV=0x" + std::to_string(1000000 + i) + "\n";
+            data += "#EXT-X-PROGRAM-DATE-TIME:2021-05-01T10:00:00.000Z\n";
+            data += "#EXTINF:5.995,\n";
+            data += "#EXT-X-BYTERANGE:" + std::to_string(100000 + i % 1000) + "@188\n";
+            data += "http://origin.test/live/segment_" + std::to_string(i) + ".ts\n";
+        }
+        return data;
+    }
+
+    size_t CountSegments(Playlist& playlist)
+    {
+        size_t count = 0;
+        SegmentInfo info;
+        bool hasMore = true;
+        while(hasMore && playlist.NextSegment(info, hasMore)) {
+            ++count;
+        }
+        return count;
+    }
+
+    // Best of iterations, microseconds per call
+    double Measure(const char* name, size_t bytes, int iterations, std::function<void()> run)
+    {
+        double best = 1e12;
+        for (int i = 0; i < iterations; ++i) {
+            const auto started = std::chrono::steady_clock::now();
+            run();
+            const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - started;
+            best = std::min(best, elapsed.count());
+        }
+        printf("%-32s %10.0f us %10.1f MB/s\n", name, best, bytes / best);
+        return best;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const int iterations = argc > 1 ? atoi(argv[1]) : 20;
+    const size_t segments = argc > 2 ? (size_t)atoi(argv[2]) : 10000;
+
+    const std::string data = MakePlaylist(c_firstMediaSequence, segments);
+    printf("Playlist of %zu segments (%zu KB), best of %d runs:\n", segments, data.size() / 1024, iterations);
+
+    Measure("Full parse", data.size(), iterations, [&data, segments] {
+        Playlist playlist(data);
+        TEST_CHECK(CountSegments(playlist) == segments);
+    });
+
+    // Window slides by one segment per reload, only the new one is parsed
+    Playlist live(data);
+    live.EnableIncrementalReload(true);
+    TEST_CHECK(live.ApplyUpdate(data));
+    std::vector<std::string> updates;
+    for (int i = 1; i <= iterations; ++i) {
+        updates.push_back(MakePlaylist(c_firstMediaSequence + i, segments));
+    }
+    size_t update = 0;
+    Measure("Incremental reload", data.size(), iterations, [&live, &updates, &update] {
+        TEST_CHECK(live.ApplyUpdate(updates[update++]));
+        TEST_CHECK(live.IsUpdated());
+    });
+    SegmentInfo last;
+    TEST_CHECK(live.SegmentForMediaSequence(c_firstMediaSequence + iterations + segments - 1, last));
+    TEST_CHECK(last.range.length == 100000 + (c_firstMediaSequence + iterations + segments - 1) % 1000);
+
+    return TestResult("playlist_parse_benchmark");
+}
@@ -0,0 +1,81 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+// Incremental reload of live media playlists.
+
+#include <string>
+#include "Playlist.hpp"
+#include "test_utils.hpp"
+
+using namespace Buffers;
+
+namespace {
+
+    const uint64_t c_rangeLength = 1000;
+    const uint64_t c_rangesPerResource = 10;
+
+    // Live window of byte ranges, every resource holds several segments
+    std::string MakeRangesPlaylist(uint64_t first, uint64_t segments)
+    {
+        std::string data = "#EXTM3U\n#EXT-X-VERSION:4\n#EXT-X-TARGETDURATION:2\n#EXT-X-MEDIA-SEQUENCE:" + std::to_string(first) + "\n";
+        for (uint64_t i = first; i < first + segments; ++i) {
+            data += "#EXTINF:2.0,\n";
+            data += "#EXT-X-BYTERANGE:" + std::to_string(c_rangeLength) + "@" + std::to_string(i % c_rangesPerResource * c_rangeLength) + "\n";
+            data += "http://origin.test/live/chunk_" + std::to_string(i / c_rangesPerResource) + ".ts\n";
+        }
+        return data;
+    }
+
+    void CheckSegment(const Playlist& playlist, uint64_t mediaSequence)
+    {
+        SegmentInfo info;
+        TEST_CHECK(playlist.SegmentForMediaSequence(mediaSequence, info));
+        TEST_CHECK(info.url == "http://origin.test/live/chunk_" + std::to_string(mediaSequence / c_rangesPerResource) + ".ts");
+        TEST_CHECK(info.range.offset == mediaSequence % c_rangesPerResource * c_rangeLength);
+        TEST_CHECK(info.range.length == c_rangeLength);
+    }
+
+    // Last known URI is not unique in reloaded playlist, new segments must be found anyway
+    void TestSharedResourceReload()
+    {
+        const uint64_t first = 100;
+        const uint64_t segments = 25;
+        Playlist playlist(MakeRangesPlaylist(first, segments));
+        playlist.EnableIncrementalReload(true);
+        TEST_CHECK(playlist.ApplyUpdate(MakeRangesPlaylist(first, segments)));
+        for (uint64_t shift = 1; shift <= 2 * c_rangesPerResource; ++shift) {
+            TEST_CHECK(playlist.ApplyUpdate(MakeRangesPlaylist(first + shift, segments)));
+            TEST_CHECK(playlist.IsUpdated());
+            CheckSegment(playlist, first + shift + segments - 1);
+        }
+        // Same window again brings nothing new
+        TEST_CHECK(playlist.ApplyUpdate(MakeRangesPlaylist(first + 2 * c_rangesPerResource, segments)));
+        TEST_CHECK(!playlist.IsUpdated());
+    }
+}
+
+int main()
+{
+    TestSharedResourceReload();
+    return TestResult("playlist_test");
+}
@@ -0,0 +1,188 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+
+// Ranged download of big segments against stand-in origin with per-connection rate limit:
+//   ranged_segment_benchmark [segments]
+// Time to first byte and read time of stream loaded by single connection and by ranges are measured.
+// Read data is checked, i.e. benchmark fails on wrong assembly of ranges.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "plist_buffer.h"
+#include "test_origin.hpp"
+#include "test_utils.hpp"
+
+using namespace Buffers;
+
+namespace {
+
+    const size_t c_packetSize = TsPacketFilter::PACKET_SIZE;
+    // 2 MB segment, i.e. up to 4 ranges of 512K
+    const size_t c_segmentPackets = 2 * 1024 * 1024 / c_packetSize + 1;
+    // Per connection, i.e. single stream loads segment in 1 sec
+    const size_t c_connectionRate = 2 * 1024 * 1024;
+    const int c_numOfRanges = 4;
+    // Range requests (besides the first one) to fail, download is resumed by single stream
+    std::atomic<int> s_rangesToFail(0);
+
+    // Valid TS packets (continuous counter), filter passes them as is
+    std::string MakeSegment(uint64_t index)
+    {
+        std::string data(c_segmentPackets * c_packetSize, '\0');
+        TestRandom random((uint32_t)index + 1);
+        for (size_t i = 0; i < c_segmentPackets; ++i) {
+            char* packet = &data[i * c_packetSize];
+            packet[0] = 0x47;
+            packet[1] = 0x01;
+            packet[2] = 0x00;
+            packet[3] = (char)(0x10 | (i & 0x0F));
+            for (size_t j = 4; j < c_packetSize; ++j) {
+                packet[j] = (char)random.Next();
+            }
+        }
+        return data;
+    }
+
+    std::string MediaPlaylist(int segments)
+    {
+        std::string data = "#EXTM3U\n#EXT-X-TARGETDURATION:4\n#EXT-X-MEDIA-SEQUENCE:0\n";
+        for (int i = 0; i < segments; ++i) {
+            data += "#EXTINF:4.0,\n" + std::to_string(i) + ".ts\n";
+        }
+        return data;
+    }
+
+    // Serves "Range: bytes=from-to" requests, each response is throttled separately
+    TestOrigin::Handler OriginHandler(int segments, std::map<uint64_t, std::string>& content)
+    {
+        return [segments, &content](const httplib::Request& req, httplib::Response& res) {
+            if(req.path == "/index.m3u8") {
+                res.set_content(MediaPlaylist(segments), "application/vnd.apple.mpegurl");
+                return;
+            }
+            unsigned long long index = 0;
+            if(1 != sscanf(req.path.c_str(), "/%llu.ts", &index) || content.count(index) == 0) {
+                res.status = 404;
+                return;
+            }
+            const std::string& segment = content[index];
+            res.set_header("Accept-Ranges", "bytes");
+            unsigned long long from = 0, to = 0;
+            if(2 == sscanf(req.get_header_value("Range").c_str(), "bytes=%llu-%llu", &from, &to) && from <= to && to < segment.size()) {
+                if(s_rangesToFail-- > 0) {
+                    res.status = 503;
+                    return;
+                }
+                res.status = 206;
+                const std::string range = "bytes " + std::to_string(from) + "-" + std::to_string(to) + "/" + std::to_string(segment.size());
+                res.set_header("Content-Range", range.c_str());
+                TestOrigin::SetThrottledContent(res, segment.substr(from, to - from + 1), [] {return c_connectionRate;});
+            } else {
+                TestOrigin::SetThrottledContent(res, segment, [] {return c_connectionRate;});
+            }
+        };
+    }
+
+    struct Timing
+    {
+        double firstByte;
+        double total;
+    };
+
+    // Reads whole stream, seconds
+    bool Measure(const TestOrigin& origin, int numOfRanges, int segments, const std::map<uint64_t, std::string>& content, Timing& timing)
+    {
+        PlaylistBuffer::SetNumberOfSegmentRanges(numOfRanges);
+        const auto started = std::chrono::steady_clock::now();
+        // Live stream (without delegate) is read as it's loaded
+        std::unique_ptr<PlaylistBuffer> buffer(new PlaylistBuffer(origin.Url("/index.m3u8"), nullptr, false));
+        std::string stream;
+        const size_t expected = segments * c_segmentPackets * c_packetSize;
+        std::vector<unsigned char> portion(64 * 1024);
+        timing.firstByte = 0.0;
+        while(stream.size() < expected) {
+            // Read waits for whole portion, i.e. the end of live stream is not awaited
+            const ssize_t bytesRead = buffer->Read(&portion[0], std::min(portion.size(), expected - stream.size()), 10000);
+            if(bytesRead <= 0)
+                break;
+            if(stream.empty()) {
+                const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+                timing.firstByte = elapsed.count();
+            }
+            stream.append((const char*)&portion[0], bytesRead);
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+        timing.total = elapsed.count();
+        buffer.reset();
+
+        std::string origininal;
+        for (const auto& segment : content) {
+            origininal += segment.second;
+        }
+        return stream == origininal;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const int segments = argc > 1 ? atoi(argv[1]) : 4;
+    std::map<uint64_t, std::string> content;
+    for (int i = 0; i < segments; ++i) {
+        content[i] = MakeSegment(i);
+    }
+    TestOrigin origin(OriginHandler(segments, content));
+    TEST_CHECK(origin.IsRunning());
+    if(!origin.IsRunning())
+        return TestResult("ranged_segment_benchmark");
+
+    // Segments are loaded one by one, connections of ranges are not shared with other segments
+    PlaylistBuffer::SetNumberOfHlsTreads(1);
+    PlaylistBuffer::SetAdaptiveHlsThreads(false);
+    PlaylistBuffer::SetLiveStartSegments(0);
+
+    Timing single, ranged, resumed;
+    TEST_CHECK(Measure(origin, 1, segments, content, single));
+    TEST_CHECK(Measure(origin, c_numOfRanges, segments, content, ranged));
+    // Published part of segment is kept, the rest is appended
+    s_rangesToFail = 1;
+    TEST_CHECK(Measure(origin, c_numOfRanges, segments, content, resumed));
+    TEST_CHECK(s_rangesToFail <= 0);
+    printf("%d segments of %zu KB, %zu KB/s per connection\n", segments, c_segmentPackets * c_packetSize / 1024, c_connectionRate / 1024);
+    printf("%-16s first byte %6.3f s, total %6.3f s\n", "single stream", single.firstByte, single.total);
+    printf("%-16s first byte %6.3f s, total %6.3f s\n", "ranges", ranged.firstByte, ranged.total);
+    printf("%-16s first byte %6.3f s, total %6.3f s\n", "failed range", resumed.firstByte, resumed.total);
+
+    // Ranged segment is read while loading, i.e. first byte does not wait for whole segment
+    // (published after all ranges are done it takes whole segment time).
+    TEST_CHECK(ranged.firstByte < ranged.total / segments / 2);
+    TEST_CHECK(ranged.total < single.total);
+    return TestResult("ranged_segment_benchmark");
+}
@@ -0,0 +1,219 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+// Ring cache buffer: units wrapped over the ring end, reads across the ring end,
+// seek within cache window and concurrent writer/reader.
+
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "ring_cache_buffer.hpp"
+#include "test_utils.hpp"
+
+using namespace Buffers;
+
+namespace {
+
+    const size_t c_unitSize = RingCacheBuffer::UNIT_SIZE;
+    // Minimal ring, RingCacheBuffer(0)
+    const size_t c_capacity = 2 * 1024 * 1024;
+
+    // Byte of the stream at position, not periodic with ring capacity
+    inline uint8_t StreamByte(int64_t position)
+    {
+        return (uint8_t)(position ^ (position >> 11) ^ (position >> 19));
+    }
+
+    void FillStream(uint8_t* buffer, int64_t position, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i) {
+            buffer[i] = StreamByte(position + i);
+        }
+    }
+
+    bool IsStream(const uint8_t* buffer, int64_t position, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i) {
+            if(buffer[i] != StreamByte(position + i))
+                return false;
+        }
+        return true;
+    }
+
+    // Writes unit of given size (-1 for whole unit), false when ring is full
+    bool WriteUnit(RingCacheBuffer& ring, ssize_t size)
+    {
+        uint8_t* unit = nullptr;
+        if(!ring.LockUnitForWrite(&unit))
+            return false;
+        FillStream(unit, ring.Length(), size < 0 ? c_unitSize : size);
+        ring.UnlockAfterWriten(unit, size);
+        return true;
+    }
+
+    // Random unit and read sizes, i.e. units and reads are not aligned with ring end
+    void TestWrapAround()
+    {
+        RingCacheBuffer ring(0);
+        ring.Init();
+        TestRandom random;
+        std::vector<uint8_t> buffer(2 * c_unitSize);
+        int wrappedUnits = 0;
+        int wrappedReads = 0;
+        bool isValid = true;
+        while (ring.Length() < 4 * (int64_t)c_capacity && isValid) {
+            // Writer is ahead of reader, ring is full most of the time
+            if(random.Range(0, 2) > 0) {
+                const int64_t length = ring.Length();
+                const ssize_t size = random.Range(0, 7) == 0 ? -1 : (ssize_t)random.Range(1, c_unitSize);
+                if(WriteUnit(ring, size) && (length % c_capacity) + ring.Length() - length > c_capacity)
+                    ++wrappedUnits;
+                continue;
+            }
+            const int64_t position = ring.Position();
+            const size_t size = random.Range(1, buffer.size());
+            const ssize_t bytesRead = ring.Read(buffer.data(), size);
+            TEST_CHECK(bytesRead == std::min<int64_t>(size, ring.Length() - position));
+            TEST_CHECK(ring.Position() == position + bytesRead);
+            isValid = IsStream(buffer.data(), position, bytesRead);
+            if((position % c_capacity) + bytesRead > c_capacity)
+                ++wrappedReads;
+        }
+        TEST_CHECK(isValid);
+        TEST_CHECK(wrappedUnits > 0);
+        TEST_CHECK(wrappedReads > 0);
+        // Rest of the stream
+        while (isValid && ring.Position() < ring.Length()) {
+            const int64_t position = ring.Position();
+            const ssize_t bytesRead = ring.Read(buffer.data(), buffer.size());
+            isValid = bytesRead > 0 && IsStream(buffer.data(), position, bytesRead);
+        }
+        TEST_CHECK(isValid);
+    }
+
+    // Reader frees oldest data for writer only when ring is almost full
+    void TestFullRing()
+    {
+        RingCacheBuffer ring(0);
+        ring.Init();
+        std::vector<uint8_t> buffer(c_unitSize);
+        int units = 0;
+        while (units < 16 && WriteUnit(ring, -1)) {
+            ++units;
+        }
+        TEST_CHECK(ring.Read(buffer.data(), buffer.size()) == c_unitSize);
+        TEST_CHECK(ring.Seek(0, SEEK_SET) == 0);
+        while (WriteUnit(ring, -1)) {
+            ++units;
+        }
+        TEST_CHECK(units == c_capacity / c_unitSize);
+        // Just enough room for one unit
+        TEST_CHECK(ring.Read(buffer.data(), buffer.size()) == c_unitSize);
+        TEST_CHECK(ring.Seek(0, SEEK_SET) == c_unitSize);
+        TEST_CHECK(WriteUnit(ring, -1));
+        TEST_CHECK(!WriteUnit(ring, -1));
+        // Data behind read position is kept for seek back, except of free threshold (1/8 of small ring)
+        TEST_CHECK(ring.Seek(c_capacity / 2, SEEK_SET) == c_capacity / 2);
+        TEST_CHECK(ring.Read(buffer.data(), buffer.size()) == c_unitSize);
+        TEST_CHECK(ring.Seek(0, SEEK_SET) == c_unitSize + c_capacity / 8);
+        units = 0;
+        while (WriteUnit(ring, -1)) {
+            ++units;
+        }
+        TEST_CHECK(units == c_capacity / 8 / c_unitSize);
+    }
+
+    // Seek is clamped to cache window [begin, length]
+    void TestSeek()
+    {
+        RingCacheBuffer ring(0);
+        ring.Init();
+        std::vector<uint8_t> buffer(c_unitSize);
+        // Reader follows writer, oldest data is freed
+        for (size_t i = 0; i < 3 * c_capacity / c_unitSize; ++i) {
+            TEST_CHECK(WriteUnit(ring, c_unitSize - i % 188));
+            TEST_CHECK(ring.Read(buffer.data(), buffer.size()) > 0);
+        }
+        const int64_t length = ring.Length();
+        TEST_CHECK(ring.Position() == length);
+        const int64_t begin = ring.Seek(0, SEEK_SET);
+        TEST_CHECK(begin > 0);
+        TEST_CHECK(begin >= length - (int64_t)c_capacity);
+        TEST_CHECK(ring.Position() == begin);
+        TEST_CHECK(ring.Seek(begin - 1, SEEK_SET) == begin);
+        TEST_CHECK(ring.Seek(-(int64_t)c_capacity, SEEK_CUR) == begin);
+        TEST_CHECK(ring.Seek(-100, SEEK_END) == length - 100);
+        TEST_CHECK(ring.Seek(100, SEEK_END) == length);
+        TEST_CHECK(ring.Seek(length + 1, SEEK_SET) == length);
+        TEST_CHECK(ring.Read(buffer.data(), buffer.size()) == 0);
+        // Whole window is readable after seek to its start
+        TEST_CHECK(ring.Seek(begin, SEEK_SET) == begin);
+        bool isValid = true;
+        while (isValid && ring.Position() < length) {
+            const int64_t position = ring.Position();
+            const ssize_t bytesRead = ring.Read(buffer.data(), buffer.size());
+            isValid = bytesRead > 0 && IsStream(buffer.data(), position, bytesRead);
+        }
+        TEST_CHECK(isValid);
+        TEST_CHECK(ring.Position() == length);
+    }
+
+    // One writer and one reader thread, i.e. timeshift buffer usage
+    void TestConcurrentAccess()
+    {
+        const int64_t streamLength = 16 * c_capacity;
+        RingCacheBuffer ring(0);
+        ring.Init();
+        std::atomic<bool> isValid(true);
+        std::thread writer([&] {
+            TestRandom random;
+            while (ring.Length() < streamLength && isValid) {
+                if(!WriteUnit(ring, random.Range(1, c_unitSize)))
+                    std::this_thread::yield();
+            }
+        });
+        std::vector<uint8_t> buffer(c_unitSize + 1000);
+        // Length is final when reader gets to the end of stream
+        while ((ring.Position() < streamLength || ring.Position() < ring.Length()) && isValid) {
+            const int64_t position = ring.Position();
+            const ssize_t bytesRead = ring.Read(buffer.data(), buffer.size());
+            if(bytesRead == 0)
+                std::this_thread::yield();
+            else if(!IsStream(buffer.data(), position, bytesRead))
+                isValid = false;
+        }
+        writer.join();
+        TEST_CHECK(isValid);
+        TEST_CHECK(ring.Position() == ring.Length());
+    }
+}
+
+int main()
+{
+    TestWrapAround();
+    TestFullRing();
+    TestSeek();
+    TestConcurrentAccess();
+    return TestResult("ring_cache_buffer_test");
+}
@@ -0,0 +1,167 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+// Seek cancels loading of segments far from the target.
+// Canceled segment stalls on origin, its loader should be released without waiting for the stalled read,
+// i.e. seek target is loaded right away (even by single loader).
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "plist_buffer.h"
+#include "plist_buffer_delegate.h"
+#include "test_origin.hpp"
+#include "test_utils.hpp"
+
+using namespace Buffers;
+
+namespace {
+
+    typedef std::chrono::steady_clock Clock;
+
+    const size_t c_packetSize = TsPacketFilter::PACKET_SIZE;
+    const size_t c_segmentPackets = 1000;
+    const size_t c_segmentSize = c_segmentPackets * c_packetSize;
+    const int c_segments = 12;
+    const int c_segmentDuration = 10;
+    const int c_seekTarget = c_segments - 1;
+    // Bitrate of VOD is known after a few segments are loaded
+    const int c_bitrateSegments = 4;
+    // Segments besides the first ones and seek target stall after first portion
+    const size_t c_sentBeforeStall = 64 * 1024;
+    const std::chrono::seconds c_stallTime(3);
+    std::atomic<bool> s_isStopped(false);
+
+    // Valid TS packets (continuous counter), payload starts with segment index
+    std::string MakeSegment(int index)
+    {
+        std::string data(c_segmentSize, '\0');
+        TestRandom random((uint32_t)index + 1);
+        for (size_t i = 0; i < c_segmentPackets; ++i) {
+            char* packet = &data[i * c_packetSize];
+            packet[0] = 0x47;
+            packet[1] = 0x01;
+            packet[2] = 0x00;
+            packet[3] = (char)(0x10 | (i & 0x0F));
+            packet[4] = (char)index;
+            for (size_t j = 5; j < c_packetSize; ++j) {
+                packet[j] = (char)random.Next();
+            }
+        }
+        return data;
+    }
+
+    void OriginHandler(const httplib::Request& req, httplib::Response& res)
+    {
+        int segment = 0;
+        if(req.path == "/vod.m3u8") {
+            std::string data = "#EXTM3U\n#EXT-X-TARGETDURATION:" + std::to_string(c_segmentDuration) + "\n#EXT-X-MEDIA-SEQUENCE:0\n";
+            for (int i = 0; i < c_segments; ++i) {
+                data += "#EXTINF:" + std::to_string(c_segmentDuration) + ".0,\n" + std::to_string(i) + ".ts\n";
+            }
+            data += "#EXT-X-ENDLIST\n";
+            res.set_content(data, "application/vnd.apple.mpegurl");
+        } else if(1 == sscanf(req.path.c_str(), "/%d.ts", &segment)) {
+            const bool isStalled = segment >= c_bitrateSegments && segment != c_seekTarget;
+            TestOrigin::SetThrottledContent(res, MakeSegment(segment), [] {return (size_t)0;});
+            auto streamcb = res.streamcb;
+            res.streamcb = [streamcb, isStalled](uint64_t offset) {
+                if(isStalled && offset >= c_sentBeforeStall) {
+                    const auto stallEnd = Clock::now() + c_stallTime;
+                    while(!s_isStopped && Clock::now() < stallEnd) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                    }
+                }
+                return streamcb(offset);
+            };
+        } else {
+            res.status = 404;
+        }
+    }
+
+    class VodDelegate : public IPlaylistBufferDelegate
+    {
+    public:
+        VodDelegate(const std::string& url) : m_url(url) {}
+        virtual int SecondsToCache() const {return c_segments * c_segmentDuration;}
+        virtual time_t Duration() const {return c_segments * c_segmentDuration;}
+        virtual std::string UrlForTimeshift(time_t timeshift, time_t* timeshiftAdjusted) const
+        {
+            if(timeshiftAdjusted)
+                *timeshiftAdjusted = timeshift;
+            return m_url;
+        }
+    private:
+        const std::string m_url;
+    };
+}
+
+int main(int argc, char** argv)
+{
+    TestOrigin origin(OriginHandler);
+    TEST_CHECK(origin.IsRunning());
+    if(!origin.IsRunning())
+        return TestResult("seek_cancel_test");
+
+    // Single loader is busy with stalled segment at the moment of seek
+    PlaylistBuffer::SetNumberOfHlsTreads(1);
+    PlaylistBuffer::SetAdaptiveHlsThreads(false);
+    PlaylistBuffer::SetNumberOfSegmentRanges(1);
+
+    const std::string url = origin.Url("/vod.m3u8");
+    double seekTime = 0.0;
+    {
+        std::unique_ptr<PlaylistBuffer> buffer(new PlaylistBuffer(url, PlaylistBufferDelegate(new VodDelegate(url)), true));
+        const std::string expected = MakeSegment(0);
+        std::string stream;
+        std::vector<unsigned char> portion(64 * 1024);
+        while(stream.size() < expected.size()) {
+            const ssize_t bytesRead = buffer->Read(&portion[0], std::min(portion.size(), expected.size() - stream.size()), 10000);
+            if(bytesRead <= 0)
+                break;
+            stream.append((const char*)&portion[0], bytesRead);
+        }
+        TEST_CHECK(stream == expected);
+        // Loader gets stalled segment
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+        const auto seekStarted = Clock::now();
+        const int64_t target = c_seekTarget * (int64_t)c_segmentSize;
+        TEST_CHECK(buffer->Seek(target, SEEK_SET) == target);
+        uint8_t packet[c_packetSize];
+        TEST_CHECK(buffer->Read(packet, sizeof(packet), 10000) == sizeof(packet));
+        const std::chrono::duration<double> elapsed = Clock::now() - seekStarted;
+        seekTime = elapsed.count();
+        TEST_CHECK(packet[0] == 0x47 && packet[4] == c_seekTarget);
+        // Stalled responses are over
+        s_isStopped = true;
+    }
+    printf("Seek target is read in %0.3f s (canceled segment stalls for %d s)\n", seekTime, (int)c_stallTime.count());
+    TEST_CHECK(seekTime < 1.0);
+    return TestResult("seek_cancel_test");
+}
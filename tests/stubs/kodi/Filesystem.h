@@ -0,0 +1,110 @@
+#pragma once
+// Test stand-in of Kodi VFS.
+// CFile reads http:// URLs (see kodi_stubs.cpp), other functions work with local files.
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <sys/types.h>
+
+#define ADDON_READ_TRUNCATED 0x01
+#define ADDON_READ_CHUNKED 0x02
+#define ADDON_READ_CACHED 0x04
+#define ADDON_READ_NO_CACHE 0x08
+#define ADDON_READ_BITRATE 0x10
+#define ADDON_READ_MULTI_STREAM 0x20
+#define ADDON_READ_AUDIO_VIDEO 0x40
+#define ADDON_READ_AFTER_WRITE 0x80
+#define ADDON_READ_REOPEN 0x100
+
+enum FilePropertyTypes
+{
+    ADDON_FILE_PROPERTY_RESPONSE_PROTOCOL,
+    ADDON_FILE_PROPERTY_RESPONSE_HEADER,
+    ADDON_FILE_PROPERTY_CONTENT_TYPE,
+    ADDON_FILE_PROPERTY_CONTENT_CHARSET,
+    ADDON_FILE_PROPERTY_MIME_TYPE,
+    ADDON_FILE_PROPERTY_EFFECTIVE_URL
+};
+
+enum CURLOptiontype
+{
+    ADDON_CURL_OPTION_OPTION,
+    ADDON_CURL_OPTION_PROTOCOL,
+    ADDON_CURL_OPTION_CREDENTIALS,
+    ADDON_CURL_OPTION_HEADER
+};
+
+namespace kodi
+{
+    namespace vfs
+    {
+        class FileStatus
+        {
+        public:
+            FileStatus() : m_size(0) {}
+            uint64_t GetSize() const { return m_size; }
+            void SetSize(uint64_t size) { m_size = size; }
+        private:
+            uint64_t m_size;
+        };
+
+        class CDirEntry
+        {
+        public:
+            CDirEntry(const std::string& path = "", int64_t size = 0) : m_path(path), m_size(size) {}
+            int64_t Size() const { return m_size; }
+            bool IsFolder() const { return false; }
+            const std::string& Path() const { return m_path; }
+        private:
+            std::string m_path;
+            int64_t m_size;
+        };
+
+        class CFile
+        {
+        public:
+            CFile();
+            ~CFile();
+
+            bool OpenFile(const std::string& filename, unsigned int flags = 0);
+            bool OpenFileForWrite(const std::string& filename, bool overwrite = false);
+            bool IsOpen() const;
+            void Close();
+            bool CURLCreate(const std::string& url);
+            bool CURLAddOption(CURLOptiontype type, const std::string& name, const std::string& value);
+            bool CURLOpen(unsigned int flags = 0);
+            ssize_t Read(void* ptr, size_t size);
+            ssize_t Write(const void* ptr, size_t size);
+            int64_t Seek(int64_t position, int whence = SEEK_SET);
+            int64_t GetPosition() const;
+            int64_t GetLength() const;
+            int Truncate(int64_t size);
+            void Flush() {}
+            std::string GetPropertyValue(FilePropertyTypes type, const std::string& name) const;
+
+        private:
+            CFile(const CFile&);
+            CFile& operator=(const CFile&);
+
+            std::string m_url;
+            std::map<std::string, std::string> m_requestHeaders;
+            std::map<std::string, std::string> m_responseHeaders;
+            std::atomic<int> m_socket;
+            FILE* m_localFile;
+            int64_t m_length;
+            int64_t m_position;
+        };
+
+        bool StatFile(const std::string& filename, FileStatus& buffer);
+        bool FileExists(const std::string& filename, bool usecache = false);
+        bool DeleteFile(const std::string& filename);
+        bool DirectoryExists(const std::string& path);
+        bool CreateDirectory(const std::string& path);
+        bool RemoveDirectory(const std::string& path, bool recursive = false);
+        bool GetDirectory(const std::string& path, const std::string& mask, std::vector<CDirEntry>& items);
+        inline std::string TranslateSpecialProtocol(const std::string& source) { return source; }
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+// Test stand-in of Kodi add-on API: logging, notifications and settings
+#include <string>
+
+enum ADDON_STATUS { ADDON_STATUS_OK, ADDON_STATUS_LOST_CONNECTION, ADDON_STATUS_NEED_RESTART, ADDON_STATUS_NEED_SETTINGS, ADDON_STATUS_UNKNOWN, ADDON_STATUS_PERMANENT_FAILURE };
+enum AddonLog { ADDON_LOG_DEBUG, ADDON_LOG_INFO, ADDON_LOG_WARNING, ADDON_LOG_ERROR, ADDON_LOG_FATAL };
+enum QueueMsg { QUEUE_INFO, QUEUE_WARNING, QUEUE_ERROR, QUEUE_OWN_STYLE };
+
+namespace kodi
+{
+    class CSettingValue
+    {
+    public:
+        int GetInt() const { return 0; }
+        bool GetBoolean() const { return false; }
+        float GetFloat() const { return 0.0f; }
+        std::string GetString() const { return std::string(); }
+    };
+
+    void Log(AddonLog loglevel, const char* format, ...);
+    void QueueFormattedNotification(QueueMsg type, const char* format, ...);
+    inline std::string GetLocalizedString(unsigned int labelId, const std::string& defaultStr = "") { return defaultStr; }
+}
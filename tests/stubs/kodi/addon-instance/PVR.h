@@ -0,0 +1,31 @@
+#pragma once
+// Test stand-in of Kodi PVR add-on API (types referenced by addon.h only)
+#include <string>
+#include <ctime>
+#include <cstdint>
+#include "../General.h"
+
+enum PVR_ERROR { PVR_ERROR_NO_ERROR = 0, PVR_ERROR_UNKNOWN = -1, PVR_ERROR_NOT_IMPLEMENTED = -2, PVR_ERROR_FAILED = -9 };
+struct PVR_CHANNEL {};
+
+namespace kodi
+{
+    namespace addon
+    {
+        struct PVRTimer {};
+        struct PVRMenuhook {};
+        struct PVRCapabilities {};
+        struct PVRSignalStatus {};
+        struct PVREPGTag {};
+        struct PVREPGTagsResultSet {};
+        struct PVRChannel {};
+        struct PVRChannelsResultSet {};
+        struct PVRChannelGroup {};
+        struct PVRChannelGroupsResultSet {};
+        struct PVRChannelGroupMembersResultSet {};
+        struct PVRStreamTimes {};
+        struct PVRRecording {};
+        struct PVRRecordingsResultSet {};
+        struct PVRTimersResultSet {};
+    }
+}
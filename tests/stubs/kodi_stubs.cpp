@@ -0,0 +1,463 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+// Implementation of Kodi add-on API stand-ins.
+// Log goes to stderr when PVR_TEST_LOG environment variable is set.
+// CFile is minimal HTTP/1.1 client (GET, Content-Length or chunked body, redirects),
+// i.e. segment data is read progressively as served by test origin.
+// Close() shuts socket down, so blocked Read() of another thread returns immediately.
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <string>
+#include "globals.hpp"
+#include "kodi/General.h"
+#include "kodi/Filesystem.h"
+
+namespace
+{
+    bool IsLogEnabled()
+    {
+        static const bool isEnabled = nullptr != getenv("PVR_TEST_LOG");
+        return isEnabled;
+    }
+
+    void PrintToLog(const char* level, const char* format, va_list args)
+    {
+        if(!IsLogEnabled())
+            return;
+        fprintf(stderr, "%s: ", level);
+        vfprintf(stderr, format, args);
+        fprintf(stderr, "\n");
+    }
+
+    bool IsHttpUrl(const std::string& url)
+    {
+        return 0 == url.compare(0, 7, "http://");
+    }
+
+    // Reads single CRLF terminated line byte by byte (headers only)
+    bool ReadLine(int socket, std::string& line)
+    {
+        line.clear();
+        char c;
+        while(recv(socket, &c, 1, 0) == 1) {
+            if('\n' == c) {
+                if(!line.empty() && '\r' == line.back())
+                    line.pop_back();
+                return true;
+            }
+            line += c;
+        }
+        return false;
+    }
+
+    bool SendAll(int socket, const std::string& data)
+    {
+        size_t sent = 0;
+        while(sent < data.size()) {
+            const ssize_t result = send(socket, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if(result <= 0)
+                return false;
+            sent += result;
+        }
+        return true;
+    }
+
+    int Connect(const std::string& host, const std::string& port)
+    {
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo* result = nullptr;
+        if(0 != getaddrinfo(host.c_str(), port.c_str(), &hints, &result))
+            return -1;
+        int sock = -1;
+        for(auto rp = result; rp != nullptr; rp = rp->ai_next) {
+            sock = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+            if(-1 == sock)
+                continue;
+            if(0 == connect(sock, rp->ai_addr, rp->ai_addrlen))
+                break;
+            close(sock);
+            sock = -1;
+        }
+        freeaddrinfo(result);
+        return sock;
+    }
+
+    // Chunked transfer decoding state is kept in negative length:
+    // -1 means "read next chunk header", -(n + 2) means n bytes left in current chunk.
+    const int64_t c_chunkHeader = -1;
+}
+
+namespace kodi
+{
+    void Log(AddonLog loglevel, const char* format, ...)
+    {
+        static const char* c_levels[] = {"DEBUG", "INFO", "WARNING", "ERROR", "FATAL"};
+        va_list args;
+        va_start(args, format);
+        PrintToLog(c_levels[loglevel], format, args);
+        va_end(args);
+    }
+
+    void QueueFormattedNotification(QueueMsg type, const char* format, ...)
+    {
+        va_list args;
+        va_start(args, format);
+        PrintToLog("NOTIFICATION", format, args);
+        va_end(args);
+    }
+
+    namespace vfs
+    {
+        CFile::CFile()
+        : m_socket(-1)
+        , m_localFile(nullptr)
+        , m_length(-1)
+        , m_position(0)
+        {}
+
+        CFile::~CFile()
+        {
+            Close();
+        }
+
+        bool CFile::OpenFile(const std::string& filename, unsigned int flags)
+        {
+            if(!CURLCreate(filename))
+                return false;
+            return CURLOpen(flags);
+        }
+
+        bool CFile::OpenFileForWrite(const std::string& filename, bool overwrite)
+        {
+            Close();
+            m_localFile = fopen(filename.c_str(), overwrite ? "w+b" : "a+b");
+            return nullptr != m_localFile;
+        }
+
+        bool CFile::IsOpen() const
+        {
+            return -1 != m_socket || nullptr != m_localFile;
+        }
+
+        void CFile::Close()
+        {
+            // Wakes up reader of another thread
+            const int sock = m_socket.exchange(-1);
+            if(-1 != sock) {
+                shutdown(sock, SHUT_RDWR);
+                close(sock);
+            }
+            if(nullptr != m_localFile) {
+                fclose(m_localFile);
+                m_localFile = nullptr;
+            }
+        }
+
+        bool CFile::CURLCreate(const std::string& url)
+        {
+            Close();
+            m_requestHeaders.clear();
+            m_responseHeaders.clear();
+            m_url = url;
+            // Kodi's URL|Name=value&Name2=value2 headers
+            const auto headersPos = m_url.find('|');
+            if(std::string::npos != headersPos) {
+                std::string headers = m_url.substr(headersPos + 1);
+                m_url.erase(headersPos);
+                std::string::size_type pos = 0;
+                while(pos < headers.size()) {
+                    auto end = headers.find('&', pos);
+                    if(std::string::npos == end)
+                        end = headers.size();
+                    const auto header = headers.substr(pos, end - pos);
+                    const auto eq = header.find('=');
+                    if(std::string::npos != eq)
+                        m_requestHeaders[header.substr(0, eq)] = header.substr(eq + 1);
+                    pos = end + 1;
+                }
+            }
+            return true;
+        }
+
+        bool CFile::CURLAddOption(CURLOptiontype type, const std::string& name, const std::string& value)
+        {
+            if(ADDON_CURL_OPTION_HEADER == type)
+                m_requestHeaders[name] = value;
+            return true;
+        }
+
+        bool CFile::CURLOpen(unsigned int flags)
+        {
+            m_position = 0;
+            m_length = -1;
+            if(!IsHttpUrl(m_url)) {
+                m_localFile = fopen(m_url.c_str(), "rb");
+                if(nullptr == m_localFile)
+                    return false;
+                struct stat st;
+                if(0 == fstat(fileno(m_localFile), &st))
+                    m_length = st.st_size;
+                return true;
+            }
+            for(int redirects = 0; redirects < 5; ++redirects) {
+                const auto hostPos = strlen("http://");
+                auto pathPos = m_url.find('/', hostPos);
+                if(std::string::npos == pathPos)
+                    pathPos = m_url.size();
+                std::string host = m_url.substr(hostPos, pathPos - hostPos);
+                const std::string path = pathPos < m_url.size() ? m_url.substr(pathPos) : "/";
+                std::string port = "80";
+                const auto portPos = host.find(':');
+                if(std::string::npos != portPos) {
+                    port = host.substr(portPos + 1);
+                    host.erase(portPos);
+                }
+                const int sock = Connect(host, port);
+                if(-1 == sock)
+                    return false;
+                m_socket = sock;
+                std::string request = "GET " + path + " HTTP/1.1\r\nHost: " + host + ":" + port + "\r\nConnection: close\r\n";
+                for(const auto& header : m_requestHeaders) {
+                    if(header.first != "postdata")
+                        request += header.first + ": " + header.second + "\r\n";
+                }
+                request += "\r\n";
+                std::string line;
+                if(!SendAll(sock, request) || !ReadLine(sock, line) || line.size() < 12) {
+                    Close();
+                    return false;
+                }
+                const int status = atoi(line.c_str() + 9);
+                m_responseHeaders.clear();
+                while(ReadLine(sock, line) && !line.empty()) {
+                    const auto colon = line.find(':');
+                    if(std::string::npos == colon)
+                        continue;
+                    auto value = line.substr(colon + 1);
+                    value.erase(0, value.find_first_not_of(' '));
+                    m_responseHeaders[line.substr(0, colon)] = value;
+                }
+                const std::string location = GetPropertyValue(ADDON_FILE_PROPERTY_RESPONSE_HEADER, "Location");
+                if((301 == status || 302 == status) && !location.empty()) {
+                    Close();
+                    m_url = location;
+                    continue;
+                }
+                if(status < 200 || status >= 300) {
+                    Close();
+                    return false;
+                }
+                const std::string length = GetPropertyValue(ADDON_FILE_PROPERTY_RESPONSE_HEADER, "Content-Length");
+                if(!length.empty())
+                    m_length = atoll(length.c_str());
+                else if(0 == strcasecmp(GetPropertyValue(ADDON_FILE_PROPERTY_RESPONSE_HEADER, "Transfer-Encoding").c_str(), "chunked"))
+                    m_length = c_chunkHeader;
+                return true;
+            }
+            return false;
+        }
+
+        ssize_t CFile::Read(void* ptr, size_t size)
+        {
+            if(nullptr != m_localFile) {
+                const size_t result = fread(ptr, 1, size, m_localFile);
+                m_position += result;
+                return result;
+            }
+            const int sock = m_socket;
+            if(-1 == sock)
+                return -1;
+            if(m_length >= 0) {
+                if(m_position >= m_length)
+                    return 0;
+                size = (size_t)std::min<int64_t>(size, m_length - m_position);
+                const ssize_t result = recv(sock, ptr, size, 0);
+                if(result > 0)
+                    m_position += result;
+                return result < 0 ? -1 : result;
+            }
+            // Chunked body
+            if(c_chunkHeader == m_length) {
+                std::string line;
+                if(!ReadLine(sock, line))
+                    return -1;
+                const int64_t chunkSize = strtoll(line.c_str(), nullptr, 16);
+                if(0 == chunkSize) {
+                    m_length = m_position;
+                    return 0;
+                }
+                m_length = -(chunkSize + 2);
+            }
+            const int64_t chunkLeft = -m_length - 2;
+            const ssize_t result = recv(sock, ptr, (size_t)std::min<int64_t>(size, chunkLeft), 0);
+            if(result <= 0)
+                return -1;
+            m_position += result;
+            m_length += result;
+            if(-2 == m_length) {
+                std::string crlf;
+                ReadLine(sock, crlf);
+                m_length = c_chunkHeader;
+            }
+            return result;
+        }
+
+        ssize_t CFile::Write(const void* ptr, size_t size)
+        {
+            if(nullptr == m_localFile)
+                return -1;
+            return fwrite(ptr, 1, size, m_localFile);
+        }
+
+        int64_t CFile::Seek(int64_t position, int whence)
+        {
+            if(nullptr == m_localFile || 0 != fseeko(m_localFile, position, whence))
+                return -1;
+            return m_position = ftello(m_localFile);
+        }
+
+        int64_t CFile::GetPosition() const
+        {
+            return m_position;
+        }
+
+        int64_t CFile::GetLength() const
+        {
+            return m_length >= 0 ? m_length : 0;
+        }
+
+        int CFile::Truncate(int64_t size)
+        {
+            if(nullptr == m_localFile)
+                return -1;
+            return ftruncate(fileno(m_localFile), size);
+        }
+
+        std::string CFile::GetPropertyValue(FilePropertyTypes type, const std::string& name) const
+        {
+            switch (type) {
+                case ADDON_FILE_PROPERTY_EFFECTIVE_URL:
+                    return m_url;
+                case ADDON_FILE_PROPERTY_CONTENT_TYPE:
+                    return GetPropertyValue(ADDON_FILE_PROPERTY_RESPONSE_HEADER, "Content-Type");
+                case ADDON_FILE_PROPERTY_RESPONSE_HEADER:
+                    for(const auto& header : m_responseHeaders) {
+                        if(0 == strcasecmp(header.first.c_str(), name.c_str()))
+                            return header.second;
+                    }
+                    return std::string();
+                default:
+                    return std::string();
+            }
+        }
+
+        bool StatFile(const std::string& filename, FileStatus& buffer)
+        {
+            CFile f;
+            if(!f.OpenFile(filename))
+                return false;
+            buffer.SetSize(f.GetLength());
+            return true;
+        }
+
+        bool FileExists(const std::string& filename, bool usecache)
+        {
+            struct stat st;
+            return 0 == stat(filename.c_str(), &st);
+        }
+
+        bool DeleteFile(const std::string& filename)
+        {
+            return 0 == unlink(filename.c_str());
+        }
+
+        bool DirectoryExists(const std::string& path)
+        {
+            struct stat st;
+            return 0 == stat(path.c_str(), &st) && S_ISDIR(st.st_mode);
+        }
+
+        bool CreateDirectory(const std::string& path)
+        {
+            return 0 == mkdir(path.c_str(), 0755);
+        }
+
+        bool RemoveDirectory(const std::string& path, bool recursive)
+        {
+            return 0 == rmdir(path.c_str());
+        }
+
+        bool GetDirectory(const std::string& path, const std::string& mask, std::vector<CDirEntry>& items)
+        {
+            items.clear();
+            return DirectoryExists(path);
+        }
+    }
+}
+
+namespace Globals
+{
+    static IAddonDelegate* s_pvr = nullptr;
+    IAddonDelegate* const& PVR = s_pvr;
+
+#define PRINT_TO_LOG(level) \
+    va_list args; \
+    va_start(args, format); \
+    PrintToLog(level, format, args); \
+    va_end(args);
+
+    void LogFatal(const char *format, ... ) { PRINT_TO_LOG("FATAL") }
+    void LogError(const char *format, ... ) { PRINT_TO_LOG("ERROR") }
+    void LogInfo(const char *format, ... ) { PRINT_TO_LOG("INFO") }
+    void LogNotice(const char *format, ... ) { PRINT_TO_LOG("NOTICE") }
+    void LogDebug(const char *format, ... ) { PRINT_TO_LOG("DEBUG") }
+
+    kodi::vfs::CFile* XBMC_OpenFile(const std::string& path, unsigned int flags)
+    {
+        auto f = new kodi::vfs::CFile();
+        if(f->OpenFile(path, flags))
+            return f;
+        delete f;
+        return nullptr;
+    }
+}
+
+// helpers.cpp depends on rapidjson, buffers need number formatting only
+namespace Helpers
+{
+    std::string n_to_string(int64_t n)
+    {
+        return std::to_string(n);
+    }
+}
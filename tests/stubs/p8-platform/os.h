@@ -0,0 +1,7 @@
+#pragma once
+// Test stand-in of p8-platform/os.h
+#include <sys/types.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#define PATH_SEPARATOR_CHAR '/'
@@ -0,0 +1,93 @@
+#pragma once
+// Test stand-in of p8-platform/threads/mutex.h (on top of C++11 threads)
+#include "../os.h"
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <thread>
+
+namespace P8PLATFORM
+{
+    inline uint64_t GetTimeMs()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    class CMutex
+    {
+    public:
+        bool Lock() { m_mutex.lock(); return true; }
+        bool TryLock() { return m_mutex.try_lock(); }
+        void Unlock() { m_mutex.unlock(); }
+        std::recursive_mutex& Native() { return m_mutex; }
+    private:
+        std::recursive_mutex m_mutex;
+    };
+
+    class CLockObject
+    {
+    public:
+        CLockObject(CMutex& mutex, bool bClearOnExit = false) : m_mutex(mutex) { m_mutex.Lock(); }
+        ~CLockObject() { m_mutex.Unlock(); }
+        void Lock() { m_mutex.Lock(); }
+        void Unlock() { m_mutex.Unlock(); }
+    private:
+        CMutex& m_mutex;
+    };
+
+    class CTryLockObject
+    {
+    public:
+        CTryLockObject(CMutex& mutex) : m_mutex(mutex), m_isLocked(mutex.TryLock()) {}
+        ~CTryLockObject() { if(m_isLocked) m_mutex.Unlock(); }
+        bool IsLocked() const { return m_isLocked; }
+    private:
+        CMutex& m_mutex;
+        const bool m_isLocked;
+    };
+
+    class CTimeout
+    {
+    public:
+        CTimeout() : m_end(0) {}
+        CTimeout(uint32_t iTimeout) { Init(iTimeout); }
+        void Init(uint32_t iTimeout) { m_end = GetTimeMs() + iTimeout; }
+        uint32_t TimeLeft() const { const uint64_t now = GetTimeMs(); return now < m_end ? uint32_t(m_end - now) : 0; }
+    private:
+        uint64_t m_end;
+    };
+
+    class CEvent
+    {
+    public:
+        CEvent(bool bAutoReset = true) : m_autoReset(bAutoReset), m_signaled(false), m_broadcast(false), m_waiting(0) {}
+        void Signal() { std::lock_guard<std::mutex> lock(m_mutex); m_signaled = true; m_condition.notify_one(); }
+        void Broadcast() { std::lock_guard<std::mutex> lock(m_mutex); m_signaled = m_broadcast = true; m_condition.notify_all(); }
+        void Reset() { std::lock_guard<std::mutex> lock(m_mutex); m_signaled = m_broadcast = false; }
+        bool Wait() { return Wait(0); }
+        // 0 means infinite timeout
+        bool Wait(uint32_t iTimeout)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            ++m_waiting;
+            auto isSignaled = [this] { return m_signaled; };
+            bool result = true;
+            if(0 == iTimeout)
+                m_condition.wait(lock, isSignaled);
+            else
+                result = m_condition.wait_for(lock, std::chrono::milliseconds(iTimeout), isSignaled);
+            if(result && m_autoReset && (!m_broadcast || 1 == m_waiting))
+                m_signaled = m_broadcast = false;
+            --m_waiting;
+            return result;
+        }
+        static void Sleep(uint32_t iTimeout) { std::this_thread::sleep_for(std::chrono::milliseconds(iTimeout)); }
+    private:
+        const bool m_autoReset;
+        bool m_signaled;
+        bool m_broadcast;
+        int m_waiting;
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+    };
+}
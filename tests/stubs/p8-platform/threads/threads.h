@@ -0,0 +1,49 @@
+#pragma once
+// Test stand-in of p8-platform/threads/threads.h
+#include <atomic>
+#include "mutex.h"
+
+namespace P8PLATFORM
+{
+    class CThread
+    {
+    public:
+        CThread() : m_bStop(false), m_bRunning(false) {}
+        virtual ~CThread() { StopThread(0); }
+
+        virtual bool CreateThread(bool bWait = true)
+        {
+            if(m_bRunning)
+                return false;
+            m_bStop = false;
+            m_bRunning = true;
+            m_thread = std::thread([this] {
+                Process();
+                m_bRunning = false;
+            });
+            return true;
+        }
+        // Negative timeout means "don't wait for thread exit"
+        virtual bool StopThread(int iWaitMs = 5000)
+        {
+            m_bStop = true;
+            m_stopEvent.Broadcast();
+            if(iWaitMs >= 0 && m_thread.joinable() && m_thread.get_id() != std::this_thread::get_id())
+                m_thread.join();
+            return !m_bRunning;
+        }
+        virtual bool IsStopped() const { return m_bStop; }
+        virtual bool IsRunning() const { return m_bRunning; }
+        virtual bool Sleep(uint32_t iTimeout)
+        {
+            return m_bStop ? false : !m_stopEvent.Wait(iTimeout);
+        }
+        virtual void* Process() = 0;
+
+    private:
+        std::atomic<bool> m_bStop;
+        std::atomic<bool> m_bRunning;
+        CEvent m_stopEvent;
+        std::thread m_thread;
+    };
+}
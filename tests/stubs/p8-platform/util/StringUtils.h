@@ -0,0 +1,37 @@
+#pragma once
+// Test stand-in of p8-platform/util/StringUtils.h
+#include <string>
+#include <vector>
+#include <cstdarg>
+#include <cstdio>
+
+class StringUtils
+{
+public:
+    static std::vector<std::string> Split(const std::string& input, const std::string& delimiter, unsigned int iMaxStrings = 0)
+    {
+        std::vector<std::string> results;
+        std::string::size_type pos = 0, found;
+        while(!delimiter.empty() && std::string::npos != (found = input.find(delimiter, pos))
+              && (0 == iMaxStrings || results.size() + 1 < iMaxStrings)) {
+            results.push_back(input.substr(pos, found - pos));
+            pos = found + delimiter.size();
+        }
+        results.push_back(input.substr(pos));
+        return results;
+    }
+    static std::string FormatV(const char* fmt, va_list args)
+    {
+        char buffer[4096];
+        vsnprintf(buffer, sizeof(buffer), fmt, args);
+        return buffer;
+    }
+    static std::string Format(const char* fmt, ...)
+    {
+        va_list args;
+        va_start(args, fmt);
+        std::string result = FormatV(fmt, args);
+        va_end(args);
+        return result;
+    }
+};
@@ -0,0 +1,67 @@
+#pragma once
+// Test stand-in of p8-platform/util/buffer.h
+#include <queue>
+#include "../threads/mutex.h"
+
+namespace P8PLATFORM
+{
+    template<typename T> class SyncedBuffer
+    {
+    public:
+        SyncedBuffer(size_t iMaxSize = 100) : m_maxSize(iMaxSize), m_hasMessages(true) {}
+        virtual ~SyncedBuffer() { Clear(); }
+
+        void Clear()
+        {
+            CLockObject lock(m_mutex);
+            while(!m_buffer.empty())
+                m_buffer.pop();
+            m_hasMessages.Reset();
+        }
+        size_t Size()
+        {
+            CLockObject lock(m_mutex);
+            return m_buffer.size();
+        }
+        bool IsEmpty()
+        {
+            CLockObject lock(m_mutex);
+            return m_buffer.empty();
+        }
+        bool Push(T entry)
+        {
+            CLockObject lock(m_mutex);
+            if(m_buffer.size() == m_maxSize)
+                return false;
+            m_buffer.push(entry);
+            m_hasMessages.Signal();
+            return true;
+        }
+        bool Pop(T& entry, uint32_t iTimeoutMs = 0)
+        {
+            CLockObject lock(m_mutex);
+            while(m_buffer.empty()) {
+                if(0 == iTimeoutMs)
+                    return false;
+                lock.Unlock();
+                const bool signaled = m_hasMessages.Wait(iTimeoutMs);
+                lock.Lock();
+                if(!signaled && m_buffer.empty())
+                    return false;
+            }
+            entry = m_buffer.front();
+            m_buffer.pop();
+            return true;
+        }
+        bool PushBlocking(T entry, uint32_t iTimeoutMs = 0)
+        {
+            return Push(entry);
+        }
+
+    private:
+        size_t m_maxSize;
+        std::queue<T> m_buffer;
+        CMutex m_mutex;
+        CEvent m_hasMessages;
+    };
+}
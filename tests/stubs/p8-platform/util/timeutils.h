@@ -0,0 +1,3 @@
+#pragma once
+// Test stand-in of p8-platform/util/timeutils.h
+#include "../threads/mutex.h"
@@ -0,0 +1,4 @@
+#pragma once
+// Test stand-in of p8-platform/util/util.h
+#define SAFE_DELETE(p) do { delete (p); (p) = NULL; } while (0)
+#define SAFE_DELETE_ARRAY(p) do { delete[] (p); (p) = NULL; } while (0)
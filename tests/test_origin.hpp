@@ -0,0 +1,87 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef __test_origin_hpp__
+#define __test_origin_hpp__
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include "httplib.h"
+
+// Stand-in HLS origin on loopback interface.
+// Requests are served by single handler, content may be streamed at limited rate.
+class TestOrigin
+{
+public:
+    typedef std::function<void(const httplib::Request&, httplib::Response&)> Handler;
+
+    explicit TestOrigin(Handler handler)
+    : m_port(0)
+    {
+        m_server.Get(".*", handler);
+        m_port = m_server.bind_to_any_port("127.0.0.1");
+        if(m_port > 0)
+            m_thread = std::thread([this] { m_server.listen_after_bind(); });
+        else
+            fprintf(stderr, "Can't bind stand-in origin.\n");
+    }
+    ~TestOrigin()
+    {
+        if(m_port <= 0)
+            return;
+        m_server.stop();
+        m_thread.join();
+    }
+    bool IsRunning() const {return m_port > 0;}
+    std::string Url(const std::string& path) const
+    {
+        return "http://127.0.0.1:" + std::to_string(m_port) + path;
+    }
+
+    // Body is sent by 16 KB portions at bytesPerSecond() rate (0 - without limit)
+    static void SetThrottledContent(httplib::Response& res, const std::string& body, std::function<size_t()> bytesPerSecond)
+    {
+        const size_t c_portion = 16 * 1024;
+        std::shared_ptr<std::string> content = std::make_shared<std::string>(body);
+        res.set_header("Content-Length", std::to_string(content->size()).c_str());
+        res.streamcb = [content, bytesPerSecond, c_portion](uint64_t offset) {
+            if(offset >= content->size())
+                return std::string();
+            const size_t size = std::min<size_t>(c_portion, content->size() - offset);
+            const size_t rate = bytesPerSecond();
+            if(rate > 0)
+                std::this_thread::sleep_for(std::chrono::microseconds((uint64_t)size * 1000000 / rate));
+            return content->substr(offset, size);
+        };
+    }
+
+private:
+    httplib::Server m_server;
+    int m_port;
+    std::thread m_thread;
+};
+
+#endif /* __test_origin_hpp__ */
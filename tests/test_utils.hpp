@@ -0,0 +1,87 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#ifndef __test_utils_hpp__
+#define __test_utils_hpp__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Minimal checks for standalone test executables (no test framework dependency).
+// Test passes when main() returns TestResult() == 0.
+
+static int s_failedChecks = 0;
+
+#define TEST_CHECK(condition) \
+    do { \
+        if(!(condition)) { \
+            ++s_failedChecks; \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        } \
+    } while(0)
+
+inline int TestResult(const char* name)
+{
+    if(s_failedChecks > 0)
+        fprintf(stderr, "%s: %d check(s) failed\n", name, s_failedChecks);
+    else
+        printf("%s: passed\n", name);
+    return s_failedChecks > 0 ? 1 : 0;
+}
+
+inline std::vector<uint8_t> FromHex(const std::string& hex)
+{
+    std::vector<uint8_t> bytes;
+    for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+        bytes.push_back((uint8_t)std::stoul(hex.substr(i, 2), nullptr, 16));
+    }
+    return bytes;
+}
+
+// Deterministic pseudo random numbers (xorshift), tests are reproducible
+class TestRandom
+{
+public:
+    explicit TestRandom(uint32_t seed = 2463534242u) : m_state(seed) {}
+    uint32_t Next()
+    {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+    // Number in [min, max]
+    size_t Range(size_t min, size_t max) {return min + Next() % (max - min + 1);}
+    void Fill(std::vector<uint8_t>& data)
+    {
+        for (auto& b : data) {
+            b = (uint8_t)Next();
+        }
+    }
+private:
+    uint32_t m_state;
+};
+
+#endif /* __test_utils_hpp__ */
@@ -0,0 +1,101 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+// Timeshift buffer filters transport stream of direct input.
+// Last packet is held back by the filter until the end of input, i.e. it should be flushed then.
+
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "timeshift_buffer.h"
+#include "ring_cache_buffer.hpp"
+#include "test_utils.hpp"
+
+using namespace Buffers;
+
+namespace {
+
+    const size_t c_packetSize = TsPacketFilter::PACKET_SIZE;
+    const size_t c_packets = 50;
+    // Portions of input are not aligned with packets
+    const size_t c_portionSize = 1000;
+
+    // Finite stream, nothing to read after its end
+    class StreamInput : public InputBuffer
+    {
+    public:
+        StreamInput(const std::vector<uint8_t>& data) : m_data(data), m_position(0), m_isAborted(false) {}
+        virtual const std::string& GetUrl() const {return m_url;}
+        virtual int64_t GetLength() const {return m_data.size();}
+        virtual int64_t GetPosition() const {return m_position;}
+        virtual ssize_t Read(unsigned char *buffer, size_t bufferSize, uint32_t timeoutMs)
+        {
+            if(m_isAborted)
+                return -1;
+            const size_t size = std::min(std::min(bufferSize, c_portionSize), m_data.size() - m_position);
+            if(0 == size) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                return 0;
+            }
+            memcpy(buffer, &m_data[m_position], size);
+            m_position += size;
+            return size;
+        }
+        virtual int64_t Seek(int64_t iPosition, int iWhence) {return -1;}
+        virtual bool SwitchStream(const std::string &newUrl) {return false;}
+        virtual void AbortRead() {m_isAborted = true;}
+    private:
+        const std::string m_url;
+        const std::vector<uint8_t> m_data;
+        size_t m_position;
+        std::atomic<bool> m_isAborted;
+    };
+}
+
+int main()
+{
+    std::vector<uint8_t> stream(c_packets * c_packetSize);
+    TestRandom random;
+    random.Fill(stream);
+    for (size_t i = 0; i < c_packets; ++i) {
+        uint8_t* packet = &stream[i * c_packetSize];
+        packet[0] = 0x47;
+        packet[1] = 0x01;
+        packet[2] = 0x00;
+        packet[3] = 0x10 | (i & 0x0F);
+    }
+    std::vector<uint8_t> output(stream.size());
+    TsStreamHealth health;
+    {
+        TimeshiftBuffer buffer(new StreamInput(stream), new RingCacheBuffer(0));
+        TEST_CHECK(buffer.Read(output.data(), output.size(), 2000) == (ssize_t)output.size());
+        TEST_CHECK(buffer.GetStreamHealth(health));
+    }
+    TEST_CHECK(output == stream);
+    TEST_CHECK(health.packets == c_packets);
+    TEST_CHECK(health.droppedBytes == 0);
+    return TestResult("timeshift_buffer_test");
+}
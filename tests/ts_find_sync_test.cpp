@@ -0,0 +1,99 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <algorithm>
+#include <vector>
+#include "ts_packet_filter.hpp"
+#include "test_utils.hpp"
+
+using namespace Buffers;
+
+namespace {
+
+    const size_t c_packetSize = TsPacketFilter::PACKET_SIZE;
+
+    void CheckEquivalence(const std::vector<uint8_t>& data, size_t offset, size_t size)
+    {
+        const size_t simd = TsPacketFilter::FindSync(data.data() + offset, size);
+        const size_t scalar = TsPacketFilter::FindSyncScalar(data.data() + offset, size);
+        if(simd != scalar)
+            fprintf(stderr, "offset %zu size %zu: SIMD %zu, scalar %zu\n", offset, size, simd, scalar);
+        TEST_CHECK(simd == scalar);
+    }
+
+    // Sync triples at every position relative to 16 bytes SIMD step,
+    // near the end of candidates range and unaligned buffers.
+    void TestSyncPositions()
+    {
+        const size_t size = 3 * c_packetSize + 64;
+        for (size_t sync = 0; sync < size - 2 * c_packetSize; ++sync) {
+            std::vector<uint8_t> data(size + 16, 0x00);
+            data[sync] = data[sync + c_packetSize] = data[sync + 2 * c_packetSize] = 0x47;
+            for (size_t offset = 0; offset < 16 && offset <= sync; ++offset) {
+                CheckEquivalence(data, offset, size - offset);
+                // Candidate range ends right after (or before) the sync
+                CheckEquivalence(data, offset, sync + 2 * c_packetSize + 1 - offset);
+                CheckEquivalence(data, offset, sync + 2 * c_packetSize - offset);
+            }
+        }
+    }
+
+    // Random data with many partial matches (one or two of three sync bytes)
+    void TestRandomData()
+    {
+        TestRandom random;
+        for (int i = 0; i < 2000; ++i) {
+            std::vector<uint8_t> data(random.Range(1, 4096));
+            for (auto& b : data) {
+                b = random.Next() % 4 == 0 ? 0x47 : (uint8_t)random.Next();
+            }
+            // Reduce chance of full match to test search over whole buffer
+            if(i % 2 == 0) {
+                for (size_t pos = 0; pos + 2 * c_packetSize < data.size(); ++pos) {
+                    if(data[pos] == 0x47 && data[pos + c_packetSize] == 0x47 && data[pos + 2 * c_packetSize] == 0x47)
+                        data[pos + 2 * c_packetSize] = 0x00;
+                }
+            }
+            const size_t offset = random.Range(0, std::min<size_t>(15, data.size() - 1));
+            CheckEquivalence(data, offset, data.size() - offset);
+        }
+    }
+
+    void TestShortData()
+    {
+        std::vector<uint8_t> data(3 * c_packetSize, 0x47);
+        for (size_t size = 0; size <= data.size(); ++size) {
+            CheckEquivalence(data, 0, size);
+        }
+        TEST_CHECK(0 == TsPacketFilter::FindSync(data.data(), data.size()));
+        TEST_CHECK(2 * c_packetSize == TsPacketFilter::FindSync(data.data(), 2 * c_packetSize));
+    }
+}
+
+int main()
+{
+    TestSyncPositions();
+    TestRandomData();
+    TestShortData();
+    return TestResult("ts_find_sync_test");
+}
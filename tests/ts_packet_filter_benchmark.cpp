@@ -0,0 +1,111 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+// Throughput of TS sync search and packet filter:
+//   ts_packet_filter_benchmark [megabytes]
+// Results of measured runs are checked, i.e. benchmark fails on wrong output.
+
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <vector>
+#include "ts_packet_filter.hpp"
+#include "test_utils.hpp"
+
+using namespace Buffers;
+
+namespace {
+
+    const size_t c_packetSize = TsPacketFilter::PACKET_SIZE;
+
+    // Best of several runs, MB/s
+    double Measure(const char* name, size_t bytes, std::function<size_t()> run)
+    {
+        double best = 0.0;
+        size_t result = 0;
+        for (int i = 0; i < 5; ++i) {
+            const auto started = std::chrono::steady_clock::now();
+            result += run();
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+            best = std::max(best, bytes / elapsed.count() / (1024 * 1024));
+        }
+        // Result is printed to keep the work from being optimized out
+        printf("%-32s %10.1f MB/s (%zu)\n", name, best, result);
+        return best;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const size_t megabytes = argc > 1 ? (size_t)atoi(argv[1]) : 64;
+    const size_t size = megabytes * 1024 * 1024 / c_packetSize * c_packetSize;
+    TestRandom random;
+
+    // Worst case of sync search: no sync at all
+    std::vector<uint8_t> garbage(size);
+    random.Fill(garbage);
+    std::replace(garbage.begin(), garbage.end(), (uint8_t)0x47, (uint8_t)0x48);
+    printf("Sync search over %zu MB without sync:\n", megabytes);
+    const double simd = Measure("FindSync", size, [&garbage] {
+        return TsPacketFilter::FindSync(garbage.data(), garbage.size());
+    });
+    const double scalar = Measure("FindSyncScalar", size, [&garbage] {
+        return TsPacketFilter::FindSyncScalar(garbage.data(), garbage.size());
+    });
+    printf("%-32s %10.1fx\n", "Speedup", simd / scalar);
+    TEST_CHECK(TsPacketFilter::FindSync(garbage.data(), garbage.size()) == TsPacketFilter::FindSyncScalar(garbage.data(), garbage.size()));
+
+    // Valid transport stream, data fed by network-like portions
+    std::vector<uint8_t> stream(size);
+    random.Fill(stream);
+    for (size_t pos = 0; pos < size; pos += c_packetSize) {
+        stream[pos] = 0x47;
+        stream[pos + 1] = 0x01;
+        stream[pos + 2] = 0x00;
+        stream[pos + 3] = 0x10 | ((pos / c_packetSize) & 0x0F);
+    }
+    // Lost sync byte every ~1 MB
+    std::vector<uint8_t> corrupted(stream);
+    for (size_t pos = 1024 * 1024; pos < size; pos += 1024 * 1024) {
+        corrupted[pos / c_packetSize * c_packetSize] = 0x00;
+    }
+    std::vector<uint8_t> out(size + TsPacketFilter::DETECTION_SIZE);
+    auto filter = [&out](const std::vector<uint8_t>& data) {
+        TsPacketFilter tsFilter;
+        const size_t chunk = 8192;
+        size_t written = 0;
+        for (size_t pos = 0; pos < data.size(); pos += chunk) {
+            written += tsFilter.Filter(data.data() + pos, std::min(chunk, data.size() - pos), out.data() + written);
+        }
+        return written + tsFilter.Finish(out.data() + written);
+    };
+    printf("Filter of %zu MB by 8 KB portions:\n", megabytes);
+    Measure("Clean stream", size, [&filter, &stream] {return filter(stream);});
+    Measure("Corrupted stream", size, [&filter, &corrupted] {return filter(corrupted);});
+    Measure("Not a transport stream", size, [&filter, &garbage] {return filter(garbage);});
+    TEST_CHECK(filter(stream) == size);
+    TEST_CHECK(filter(corrupted) < size);
+    TEST_CHECK(filter(garbage) == size);
+    return TestResult("ts_packet_filter_benchmark");
+}
@@ -0,0 +1,202 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "ts_packet_filter.hpp"
+#include "test_utils.hpp"
+
+using namespace Buffers;
+
+namespace {
+
+    const size_t c_packetSize = TsPacketFilter::PACKET_SIZE;
+
+    void AppendPackets(std::vector<uint8_t>& stream, size_t packets, uint16_t pid, uint8_t& continuityCounter, TestRandom& random)
+    {
+        for (size_t i = 0; i < packets; ++i) {
+            std::vector<uint8_t> packet(c_packetSize);
+            random.Fill(packet);
+            // No sync bytes in payload, i.e. sync search is not fooled by chance
+            std::replace(packet.begin(), packet.end(), (uint8_t)0x47, (uint8_t)0x48);
+            packet[0] = 0x47;
+            packet[1] = (uint8_t)(pid >> 8);
+            packet[2] = (uint8_t)pid;
+            packet[3] = 0x10 | (continuityCounter++ & 0x0F);
+            stream.insert(stream.end(), packet.begin(), packet.end());
+        }
+    }
+
+    void AppendGarbage(std::vector<uint8_t>& stream, size_t size, TestRandom& random)
+    {
+        std::vector<uint8_t> garbage(size);
+        random.Fill(garbage);
+        std::replace(garbage.begin(), garbage.end(), (uint8_t)0x47, (uint8_t)0x48);
+        stream.insert(stream.end(), garbage.begin(), garbage.end());
+    }
+
+    struct FilterResult
+    {
+        std::vector<uint8_t> data;
+        TsStreamHealth health;
+        bool isPassThrough;
+    };
+
+    // Filters stream fed by portions of random size (0 - whole stream at once)
+    FilterResult FilterStream(const std::vector<uint8_t>& stream, size_t maxChunk, TestRandom& random)
+    {
+        TsPacketFilter filter;
+        FilterResult result;
+        result.data.resize(stream.size() + TsPacketFilter::DETECTION_SIZE);
+        size_t written = 0;
+        size_t pos = 0;
+        while(pos < stream.size()) {
+            const size_t rest = stream.size() - pos;
+            const size_t chunk = 0 == maxChunk ? rest : std::min(random.Range(1, maxChunk), rest);
+            // Output room contract
+            const size_t room = chunk + filter.PendingSize();
+            const size_t filtered = filter.Filter(stream.data() + pos, chunk, result.data.data() + written);
+            TEST_CHECK(filtered <= room);
+            written += filtered;
+            pos += chunk;
+        }
+        written += filter.Finish(result.data.data() + written);
+        TEST_CHECK(0 == filter.PendingSize());
+        result.data.resize(written);
+        result.health = filter.Health();
+        result.isPassThrough = filter.IsPassThrough();
+        return result;
+    }
+
+    bool IsSameHealth(const TsStreamHealth& a, const TsStreamHealth& b)
+    {
+        return a.packets == b.packets && a.droppedBytes == b.droppedBytes
+            && a.resyncs == b.resyncs && a.continuityErrors == b.continuityErrors;
+    }
+
+    void CheckChunkingIndependence(const char* name, const std::vector<uint8_t>& stream, TestRandom& random)
+    {
+        const FilterResult reference = FilterStream(stream, 0, random);
+        const size_t maxChunks[] = {1, 7, 188, 563, 564, 565, 1500, 8192, 20000};
+        for (size_t maxChunk : maxChunks) {
+            for (int i = 0; i < 3; ++i) {
+                const FilterResult result = FilterStream(stream, maxChunk, random);
+                const bool isEqual = result.data == reference.data && result.isPassThrough == reference.isPassThrough
+                    && IsSameHealth(result.health, reference.health);
+                if(!isEqual)
+                    fprintf(stderr, "%s: output differs for chunks up to %zu bytes\n", name, maxChunk);
+                TEST_CHECK(isEqual);
+            }
+        }
+    }
+
+    void TestCleanStream(TestRandom& random)
+    {
+        std::vector<uint8_t> stream;
+        uint8_t counter = 0;
+        AppendPackets(stream, 500, 0x100, counter, random);
+        const FilterResult result = FilterStream(stream, 1000, random);
+        TEST_CHECK(result.data == stream);
+        TEST_CHECK(!result.isPassThrough);
+        TEST_CHECK(500 == result.health.packets);
+        TEST_CHECK(0 == result.health.droppedBytes && 0 == result.health.continuityErrors);
+        CheckChunkingIndependence("clean", stream, random);
+    }
+
+    // Garbage longer than first portion used to switch filter to pass-through
+    void TestLeadingGarbage(TestRandom& random)
+    {
+        std::vector<uint8_t> stream;
+        uint8_t counter = 0;
+        AppendGarbage(stream, 5000, random);
+        AppendPackets(stream, 100, 0x100, counter, random);
+        const FilterResult result = FilterStream(stream, 600, random);
+        TEST_CHECK(!result.isPassThrough);
+        TEST_CHECK(100 * c_packetSize == result.data.size());
+        TEST_CHECK(std::equal(result.data.begin(), result.data.end(), stream.begin() + 5000));
+        TEST_CHECK(5000 == result.health.droppedBytes);
+        CheckChunkingIndependence("leading garbage", stream, random);
+    }
+
+    void TestCorruption(TestRandom& random)
+    {
+        std::vector<uint8_t> stream;
+        uint8_t counter = 0;
+        AppendPackets(stream, 50, 0x100, counter, random);
+        // Truncated packet
+        stream.resize(stream.size() - 100);
+        AppendPackets(stream, 50, 0x100, counter, random);
+        // Lost packet (continuity error)
+        ++counter;
+        AppendPackets(stream, 50, 0x100, counter, random);
+        AppendGarbage(stream, 1000, random);
+        AppendPackets(stream, 50, 0x101, counter, random);
+        // Partial packet at the end
+        stream.resize(stream.size() - 50);
+        const FilterResult result = FilterStream(stream, 0, random);
+        TEST_CHECK(0 == result.data.size() % c_packetSize);
+        TEST_CHECK(result.health.resyncs >= 2);
+        TEST_CHECK(result.health.continuityErrors >= 1);
+        TEST_CHECK(result.health.droppedBytes > 1000);
+        CheckChunkingIndependence("corrupted", stream, random);
+    }
+
+    void TestNotTransportStream(TestRandom& random)
+    {
+        std::vector<uint8_t> stream;
+        AppendGarbage(stream, 100 * 1024, random);
+        const FilterResult result = FilterStream(stream, 1000, random);
+        TEST_CHECK(result.isPassThrough);
+        TEST_CHECK(result.data == stream);
+        CheckChunkingIndependence("not TS", stream, random);
+        // Shorter than detection size
+        stream.resize(TsPacketFilter::DETECTION_SIZE / 2);
+        TEST_CHECK(FilterStream(stream, 1000, random).data == stream);
+        CheckChunkingIndependence("short not TS", stream, random);
+    }
+
+    // Sync found after detection size is not used for detection
+    void TestLateSync(TestRandom& random)
+    {
+        std::vector<uint8_t> stream;
+        uint8_t counter = 0;
+        AppendGarbage(stream, TsPacketFilter::DETECTION_SIZE, random);
+        AppendPackets(stream, 100, 0x100, counter, random);
+        const FilterResult result = FilterStream(stream, 3000, random);
+        TEST_CHECK(result.isPassThrough);
+        TEST_CHECK(result.data == stream);
+        CheckChunkingIndependence("late sync", stream, random);
+    }
+}
+
+int main()
+{
+    TestRandom random;
+    TestCleanStream(random);
+    TestLeadingGarbage(random);
+    TestCorruption(random);
+    TestNotTransportStream(random);
+    TestLateSync(random);
+    return TestResult("ts_packet_filter_test");
+}
@@ -0,0 +1,202 @@
+/*
+ *
+ *   Copyright (C) 2021 Sergey Shramchenko
+ *   https://github.com/srg70/pvr.puzzle.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+// Adaptive variant switching against stand-in origin with throttled segments.
+// Loader side mirrors PlaylistBuffer: segment download time is reported to cache,
+// cache decides on variant switch, new variant is loaded and applied.
+
+#include <inttypes.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "kodi/Filesystem.h"
+#include "playlist_cache.hpp"
+#include "test_origin.hpp"
+#include "test_utils.hpp"
+
+using namespace Buffers;
+
+namespace {
+
+    const float c_segmentDuration = 0.25;
+    const int c_windowSize = 40;
+
+    struct VariantInfo
+    {
+        uint64_t bandwidth;
+        uint64_t firstSequence;
+    };
+
+    // Origin throughput (bytes per second), 0 - without limit
+    std::atomic<size_t> s_throughput(0);
+
+    std::string MasterPlaylist(const std::vector<VariantInfo>& variants)
+    {
+        std::string data = "#EXTM3U\n";
+        for (size_t i = 0; i < variants.size(); ++i) {
+            data += "#EXT-X-STREAM-INF:BANDWIDTH=" + std::to_string(variants[i].bandwidth) + "\n";
+            data += "v" + std::to_string(i) + "/index.m3u8\n";
+        }
+        return data;
+    }
+
+    std::string MediaPlaylist(const VariantInfo& variant)
+    {
+        std::string data = "#EXTM3U\n#EXT-X-TARGETDURATION:1\n#EXT-X-MEDIA-SEQUENCE:" + std::to_string(variant.firstSequence) + "\n";
+        for (int i = 0; i < c_windowSize; ++i) {
+            data += "#EXTINF:" + std::to_string(c_segmentDuration) + ",\n" + std::to_string(variant.firstSequence + i) + ".ts\n";
+        }
+        return data;
+    }
+
+    TestOrigin::Handler OriginHandler(const std::vector<VariantInfo>& variants)
+    {
+        return [variants](const httplib::Request& req, httplib::Response& res) {
+            if(req.path == "/master.m3u8") {
+                res.set_content(MasterPlaylist(variants), "application/vnd.apple.mpegurl");
+                return;
+            }
+            unsigned int variant = 0;
+            char name[32];
+            if(2 != sscanf(req.path.c_str(), "/v%u/%31s", &variant, name) || variant >= variants.size()) {
+                res.status = 404;
+                return;
+            }
+            if(std::string(name) == "index.m3u8") {
+                res.set_content(MediaPlaylist(variants[variant]), "application/vnd.apple.mpegurl");
+                return;
+            }
+            // Segment size matches declared bandwidth
+            const size_t size = (size_t)(variants[variant].bandwidth / 8 * c_segmentDuration);
+            TestOrigin::SetThrottledContent(res, std::string(size, (char)variant), [] {return s_throughput.load();});
+        };
+    }
+
+    struct LoadedSegment
+    {
+        unsigned int variant;
+        uint64_t mediaSequence;
+    };
+
+    bool DownloadSegment(MutableSegment* segment)
+    {
+        const auto started = std::chrono::steady_clock::now();
+        kodi::vfs::CFile f;
+        if(!f.OpenFile(segment->info.url))
+            return false;
+        uint8_t buffer[32 * 1024];
+        ssize_t bytesRead;
+        while((bytesRead = f.Read(buffer, sizeof(buffer))) > 0) {
+            segment->Push(buffer, bytesRead);
+        }
+        const std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - started;
+        segment->SetDownloadTime(elapsed.count());
+        return 0 == bytesRead;
+    }
+
+    // Loads segments one by one like PlaylistBuffer's loader,
+    // switching variants when cache decides to.
+    std::vector<LoadedSegment> Play(PlaylistCache& cache, int segments)
+    {
+        std::vector<LoadedSegment> loaded;
+        for (int i = 0; i < segments; ++i) {
+            MutableSegment* segment = cache.SegmentToFill();
+            TEST_CHECK(nullptr != segment);
+            if(nullptr == segment)
+                break;
+            LoadedSegment info;
+            const auto url = segment->info.url;
+            TEST_CHECK(2 == sscanf(url.substr(url.find("/v")).c_str(), "/v%u/%" SCNu64, &info.variant, &info.mediaSequence));
+            loaded.push_back(info);
+            TEST_CHECK(DownloadSegment(segment));
+            cache.SegmentReady(segment);
+            size_t variant = 0;
+            if(cache.VariantToAdapt(variant)) {
+                std::string data, effectiveUrl;
+                TEST_CHECK(cache.LoadVariant(variant, data, effectiveUrl, nullptr));
+                cache.SwitchToVariant(variant, data, effectiveUrl);
+            }
+        }
+        return loaded;
+    }
+
+    // Segments follow each other without gaps and repeats
+    void CheckContinuity(const std::vector<LoadedSegment>& loaded)
+    {
+        for (size_t i = 1; i < loaded.size(); ++i) {
+            TEST_CHECK(loaded[i].mediaSequence == loaded[i - 1].mediaSequence + 1);
+        }
+    }
+
+    // Throughput below the best variant switches down to the best fitting one
+    void TestDownSwitch()
+    {
+        const std::vector<VariantInfo> variants = {{400000, 100}, {1200000, 100}, {4000000, 100}};
+        TestOrigin origin(OriginHandler(variants));
+        TEST_CHECK(origin.IsRunning());
+        // 2 Mbps, i.e. 1.5 Mbps with ABR headroom
+        s_throughput = 250 * 1024;
+        PlaylistCache cache(origin.Url("/master.m3u8"), nullptr, false);
+        const auto loaded = Play(cache, 8);
+        TEST_CHECK(loaded.size() == 8);
+        if(loaded.size() != 8)
+            return;
+        // Starts from the best variant (nothing is measured yet)
+        TEST_CHECK(2 == loaded.front().variant);
+        // Decision is made on segment boundaries after few segments
+        TEST_CHECK(2 == loaded[1].variant);
+        TEST_CHECK(1 == loaded.back().variant);
+        // And is stable while throughput is the same
+        for (size_t i = 1; i < loaded.size(); ++i) {
+            TEST_CHECK(loaded[i].variant <= loaded[i - 1].variant);
+            TEST_CHECK(0 != loaded[i].variant);
+        }
+        CheckContinuity(loaded);
+    }
+
+    // Variant with different media sequence numbering can't continue playback,
+    // current one is kept.
+    void TestMisalignedVariant()
+    {
+        const std::vector<VariantInfo> variants = {{400000, 100}, {4000000, 5000}};
+        TestOrigin origin(OriginHandler(variants));
+        TEST_CHECK(origin.IsRunning());
+        // Previous measurement (~2 Mbps) selects the lowest variant,
+        // unlimited throughput votes for up-switch.
+        s_throughput = 0;
+        PlaylistCache cache(origin.Url("/master.m3u8"), nullptr, false);
+        const auto loaded = Play(cache, 16);
+        TEST_CHECK(loaded.size() == 16);
+        for (const auto& segment : loaded) {
+            TEST_CHECK(0 == segment.variant);
+        }
+        CheckContinuity(loaded);
+    }
+}
+
+int main()
+{
+    TestDownSwitch();
+    TestMisalignedVariant();
+    return TestResult("variant_switch_test");
+}